@@ -0,0 +1,864 @@
+#include "codec.hpp"
+#include "domain.hpp"
+#include "relations.hpp"
+#include "state.hpp"
+#include "costs.hpp"
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+// zigzag mapping so that small negative deltas stay small
+
+static boost::uint64_t zigzag(boost::int64_t value) {
+	return (boost::uint64_t(value) << 1) ^ boost::uint64_t(value >> 63);
+}
+
+static boost::int64_t unzigzag(boost::uint64_t value) {
+	return boost::int64_t(value >> 1) ^ -boost::int64_t(value & 1);
+}
+
+
+template<typename ValueType>
+void State::FunctionState<ValueType>::encode(BinaryEncoder& encoder) const {
+	encoder.writeUInt(values.size());
+	Variable::Index base(0);
+	for (typename Values::const_iterator it = values.begin(); it != values.end(); ++it) {
+		const Variables& variables(it->first);
+		// keys are sorted, so delta against the previous key's first index
+		encoder.writeVariables(variables, base);
+		if (!variables.empty())
+			base = variables.front().index;
+		encoder.write(it->second);
+	}
+}
+
+template<typename ValueType>
+void State::FunctionState<ValueType>::decode(BinaryDecoder& decoder, size_t arity) {
+	values.clear();
+	const size_t count(decoder.readCount(arity + 1));
+	Variable::Index base(0);
+	for (size_t i = 0; i < count; ++i) {
+		const Variables variables(decoder.readVariables(arity, base));
+		if (!variables.empty())
+			base = variables.front().index;
+		values[variables] = decoder.read<ValueType>();
+	}
+}
+
+template<>
+void State::FunctionState<bool>::encode(BinaryEncoder& encoder) const {
+	encoder.writeUInt(values.size());
+	Variable::Index base(0);
+	for (Values::const_iterator it = values.begin(); it != values.end(); ++it) {
+		const Variables& variables(it->first);
+		encoder.writeVariables(variables, base);
+		if (!variables.empty())
+			base = variables.front().index;
+	}
+}
+
+template<>
+void State::FunctionState<bool>::decode(BinaryDecoder& decoder, size_t arity) {
+	values.clear();
+	// entries of nullary relations take no byte, and there is at most one
+	const size_t count(arity ? decoder.readCount(arity) : decoder.readUInt());
+	if (arity == 0 && count > 1)
+		throw std::runtime_error("Invalid count in binary node data");
+	Variable::Index base(0);
+	for (size_t i = 0; i < count; ++i) {
+		const Variables variables(decoder.readVariables(arity, base));
+		if (!variables.empty())
+			base = variables.front().index;
+		values[variables] = true;
+	}
+}
+
+template void State::FunctionState<int>::encode(BinaryEncoder& encoder) const;
+template void State::FunctionState<int>::decode(BinaryDecoder& decoder, size_t arity);
+template void State::FunctionState<float>::encode(BinaryEncoder& encoder) const;
+template void State::FunctionState<float>::decode(BinaryDecoder& decoder, size_t arity);
+template void State::FunctionState<double>::encode(BinaryEncoder& encoder) const;
+template void State::FunctionState<double>::decode(BinaryDecoder& decoder, size_t arity);
+
+
+// how a state is written when a dictionary is used
+enum StateEncoding {
+	STATE_FULL, //!< all functions, the state is then cached
+	STATE_REFERENCE, //!< hash of a cached state
+	STATE_DELTA, //!< functions removed and changed from a cached state, the state is then cached
+	STATE_UNCACHED //!< as without dictionary, in case of hash collision
+};
+
+StateDictionary::StateDictionary(size_t capacity) :
+	capacity(std::max<size_t>(capacity, 1)),
+	baseHash(0),
+	hasBase(false) {
+}
+
+// FNV-1a on relation indices, sizes and contents of the functions
+StateDictionary::Hash StateDictionary::hash(const EncodedFunctions& functions) {
+	Hash hash(14695981039346656037ULL);
+	const Hash prime(1099511628211ULL);
+	for (EncodedFunctions::const_iterator it = functions.begin(); it != functions.end(); ++it) {
+		hash = (hash ^ Hash(it->first)) * prime;
+		hash = (hash ^ Hash(it->second.size())) * prime;
+		for (Bytes::const_iterator jt = it->second.begin(); jt != it->second.end(); ++jt)
+			hash = (hash ^ *jt) * prime;
+	}
+	return hash;
+}
+
+const StateDictionary::EncodedFunctions* StateDictionary::find(Hash hash) const {
+	Entries::const_iterator it(entries.find(hash));
+	if (it == entries.end())
+		return 0;
+	return &it->second;
+}
+
+void StateDictionary::insert(Hash hash, const EncodedFunctions& functions) {
+	if (entries.find(hash) == entries.end()) {
+		if (entries.size() >= capacity) {
+			const Hash evicted(order.front());
+			order.pop_front();
+			entries.erase(evicted);
+			if (evicted == baseHash)
+				hasBase = false;
+		}
+		entries[hash] = functions;
+		order.push_back(hash);
+	}
+	use(hash);
+}
+
+void StateDictionary::use(Hash hash) {
+	baseHash = hash;
+	hasBase = true;
+}
+
+const StateDictionary::EncodedFunctions* StateDictionary::getBase() const {
+	if (!hasBase)
+		return 0;
+	return find(baseHash);
+}
+
+
+BinaryEncoder::BinaryEncoder(const Domain& domain, StateDictionary* states) :
+	domain(domain),
+	states(states) {
+}
+
+void BinaryEncoder::writeUInt(boost::uint64_t value) {
+	while (value >= 0x80) {
+		buffer.push_back((unsigned char)(value | 0x80));
+		value >>= 7;
+	}
+	buffer.push_back((unsigned char)value);
+}
+
+void BinaryEncoder::writeInt(boost::int64_t value) {
+	writeUInt(zigzag(value));
+}
+
+void BinaryEncoder::writeString(const std::string& value) {
+	writeUInt(value.size());
+	buffer.insert(buffer.end(), value.begin(), value.end());
+}
+
+/// write variables as differences to the previous one, the first being relative to base
+void BinaryEncoder::writeVariables(const Variables& variables, Variable::Index base) {
+	boost::int64_t previous(base);
+	for (Variables::const_iterator it = variables.begin(); it != variables.end(); ++it) {
+		const boost::int64_t index(it->index);
+		writeInt(index - previous);
+		previous = index;
+	}
+}
+
+void BinaryEncoder::writeHash(StateDictionary::Hash hash) {
+	for (size_t i = 0; i < sizeof(hash); ++i)
+		buffer.push_back((unsigned char)(hash >> (8 * i)));
+}
+
+/// write state as a reference to, or a delta from, a state already sent if possible
+void BinaryEncoder::writeState(const State& state, StateDictionary& dictionary) {
+	typedef StateDictionary::EncodedFunctions EncodedFunctions;
+	
+	// encode every function separately, to compare them with the cached ones
+	EncodedFunctions functions;
+	for (State::Functions::const_iterator it = state.functions.begin(); it != state.functions.end(); ++it) {
+		assert(domain.getRelationIndex(it->first) != (size_t)-1);
+		BinaryEncoder encoder(domain);
+		it->second->encode(encoder);
+		functions[domain.getRelationIndex(it->first)].swap(encoder.buffer);
+	}
+	const StateDictionary::Hash hash(StateDictionary::hash(functions));
+	
+	const EncodedFunctions* cached(dictionary.find(hash));
+	dictionary.counters.cacheAccessed(cached && *cached == functions);
+	if (cached) {
+		if (*cached == functions) {
+			writeUInt(STATE_REFERENCE);
+			writeHash(hash);
+			dictionary.use(hash);
+		} else {
+			writeUInt(STATE_UNCACHED);
+			write(state);
+		}
+		return;
+	}
+	
+	// compare with the base to see whether a delta is smaller
+	const EncodedFunctions* base(dictionary.getBase());
+	size_t fullSize(0);
+	size_t deltaSize(0);
+	std::vector<size_t> changed;
+	std::vector<size_t> removed;
+	for (EncodedFunctions::const_iterator it = functions.begin(); it != functions.end(); ++it) {
+		fullSize += it->second.size() + 2;
+		if (base) {
+			EncodedFunctions::const_iterator baseIt(base->find(it->first));
+			if (baseIt == base->end() || baseIt->second != it->second) {
+				changed.push_back(it->first);
+				deltaSize += it->second.size() + 2;
+			}
+		}
+	}
+	if (base) {
+		for (EncodedFunctions::const_iterator it = base->begin(); it != base->end(); ++it) {
+			if (functions.find(it->first) == functions.end()) {
+				removed.push_back(it->first);
+				deltaSize += 1;
+			}
+		}
+	}
+	
+	if (base && deltaSize + sizeof(StateDictionary::Hash) < fullSize) {
+		writeUInt(STATE_DELTA);
+		writeHash(dictionary.getBaseHash());
+		writeUInt(removed.size());
+		for (std::vector<size_t>::const_iterator it = removed.begin(); it != removed.end(); ++it)
+			writeUInt(*it);
+		writeUInt(changed.size());
+		for (std::vector<size_t>::const_iterator it = changed.begin(); it != changed.end(); ++it) {
+			const StateDictionary::Bytes& bytes(functions[*it]);
+			writeUInt(*it);
+			writeUInt(bytes.size());
+			buffer.insert(buffer.end(), bytes.begin(), bytes.end());
+		}
+	} else {
+		writeUInt(STATE_FULL);
+		writeUInt(functions.size());
+		for (EncodedFunctions::const_iterator it = functions.begin(); it != functions.end(); ++it) {
+			writeUInt(it->first);
+			writeUInt(it->second.size());
+			buffer.insert(buffer.end(), it->second.begin(), it->second.end());
+		}
+	}
+	dictionary.insert(hash, functions);
+}
+
+template<>
+void BinaryEncoder::write(const bool& value) {
+	buffer.push_back(value ? 1 : 0);
+}
+
+template<>
+void BinaryEncoder::write(const int& value) {
+	writeInt(value);
+}
+
+template<>
+void BinaryEncoder::write(const float& value) {
+	boost::uint32_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	for (size_t i = 0; i < sizeof(bits); ++i)
+		buffer.push_back((unsigned char)(bits >> (8 * i)));
+}
+
+template<>
+void BinaryEncoder::write(const double& value) {
+	boost::uint64_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	for (size_t i = 0; i < sizeof(bits); ++i)
+		buffer.push_back((unsigned char)(bits >> (8 * i)));
+}
+
+template<>
+void BinaryEncoder::write(const Scope& scope) {
+	writeUInt(scope.getSize());
+	for (size_t i = 0; i < scope.getSize(); ++i)
+		writeString(scope.names[i]);
+}
+
+template<>
+void BinaryEncoder::write(const Task& task) {
+	writeUInt(domain.getHeadIndex(task.head));
+	writeVariables(task.params);
+}
+
+template<>
+void BinaryEncoder::write(const Plan& plan) {
+	writeUInt(plan.size());
+	for (Plan::const_iterator it = plan.begin(); it != plan.end(); ++it)
+		write(*it);
+}
+
+template<>
+void BinaryEncoder::write(const CNF& cnf) {
+	// write variables
+	writeUInt(cnf.variables.size());
+	writeVariables(cnf.variables);
+	// write literals, variables offsets are relative to the end of the previous literal
+	writeUInt(cnf.literals.size());
+	Variables::size_type expectedOffset(0);
+	for (NormalForm::Literals::const_iterator it = cnf.literals.begin(); it != cnf.literals.end(); ++it) {
+		const NormalForm::Literal& literal(*it);
+		assert(domain.getRelationIndex(literal.function) != (size_t)-1);
+		writeUInt(domain.getRelationIndex(literal.function));
+		writeInt(boost::int64_t(literal.variables) - boost::int64_t(expectedOffset));
+		expectedOffset = literal.variables + literal.function->arity;
+	}
+	// write negations, packed 8 per byte
+	unsigned char bits(0);
+	for (size_t i = 0; i < cnf.literals.size(); ++i) {
+		if (cnf.literals[i].negated)
+			bits |= 1 << (i % 8);
+		if (i % 8 == 7 || i + 1 == cnf.literals.size()) {
+			buffer.push_back(bits);
+			bits = 0;
+		}
+	}
+	// write junctions, which are increasing
+	writeUInt(cnf.junctions.size());
+	NormalForm::Literals::size_type previous(0);
+	for (NormalForm::Junctions::const_iterator it = cnf.junctions.begin(); it != cnf.junctions.end(); ++it) {
+		assert(*it >= previous);
+		writeUInt(*it - previous);
+		previous = *it;
+	}
+}
+
+template<>
+void BinaryEncoder::write(const State& state) {
+	writeUInt(state.functions.size());
+	for (State::Functions::const_iterator it = state.functions.begin(); it != state.functions.end(); ++it) {
+		assert(domain.getRelationIndex(it->first) != (size_t)-1);
+		writeUInt(domain.getRelationIndex(it->first));
+		it->second->encode(*this);
+	}
+}
+
+template<>
+void BinaryEncoder::write(const TaskNetwork& network) {
+	typedef std::map<TaskNetwork::Node*, size_t> NodesMap;
+	NodesMap nodesMap;
+	size_t nodesCount = 0;
+
+	// fill nodes map
+	for (TaskNetwork::Tasks::const_iterator it = network.first.begin(); it != network.first.end(); ++it) {
+		nodesMap[*it] = nodesCount++;
+	}
+	for (TaskNetwork::Predecessors::const_iterator it = network.predecessors.begin(); it != network.predecessors.end(); ++it) {
+		nodesMap[it->first] = nodesCount++;
+	}
+
+	// store first
+	writeUInt(network.first.size());
+	for (TaskNetwork::Tasks::const_iterator it = network.first.begin(); it != network.first.end(); ++it) {
+		const TaskNetwork::Node* node(*it);
+		write(node->task);
+		writeUInt(node->successors.size());
+		for (TaskNetwork::Tasks::const_iterator jt = node->successors.begin(); jt != node->successors.end(); ++jt) {
+			writeUInt(nodesMap[*jt]);
+		}
+	}
+	// store predecessors
+	writeUInt(network.predecessors.size());
+	for (TaskNetwork::Predecessors::const_iterator it = network.predecessors.begin(); it != network.predecessors.end(); ++it) {
+		const TaskNetwork::Node* node(it->first);
+		write(node->task);
+		writeUInt(node->successors.size());
+		for (TaskNetwork::Tasks::const_iterator jt = node->successors.begin(); jt != node->successors.end(); ++jt) {
+			writeUInt(nodesMap[*jt]);
+		}
+		writeUInt(it->second);
+	}
+}
+
+template<>
+void BinaryEncoder::write(const Planner9::SearchNode& node) {
+	write(node.plan);
+	write(node.network);
+	writeUInt(node.allocatedVariablesCount);
+	write(node.preconditions);
+	if (states)
+		writeState(node.state, *states);
+	else
+		write(node.state);
+	write(double(node.pathCost));
+	write(double(node.heuristicCost));
+}
+
+template<>
+void BinaryEncoder::write(const SearchCounters& counters) {
+	writeUInt(counters.nodesExpanded);
+	writeUInt(counters.nodesGenerated);
+	writeUInt(counters.nodesPruned);
+	writeUInt(counters.preconditionsFailures);
+	writeUInt(counters.cacheHits);
+	writeUInt(counters.cacheMisses);
+	for (size_t i = 0; i < SearchCounters::PHASES_COUNT; ++i)
+		writeUInt(counters.phasesTimes[i]);
+	for (size_t i = 0; i < SearchCounters::branchingBinsCount; ++i)
+		writeUInt(counters.branchingFactors[i]);
+	writeUInt(counters.frontierSamplingInterval);
+	writeUInt(counters.frontierSamplesCount);
+	for (size_t i = 0; i < counters.frontierSamplesCount; ++i)
+		writeUInt(counters.frontierSizes[i]);
+}
+
+// parameters of cost functions are written as they are, so that the decoded ones order nodes identically
+
+template<>
+void BinaryEncoder::write(const Planner9::CostFunction* const& costFunction) {
+	writeString(costFunction->getName());
+	if (dynamic_cast<const AlternativesCost*>(costFunction))
+		return;
+	
+	const ContextualizedActionCost* contextualizedActionCost(dynamic_cast<const ContextualizedActionCost*>(costFunction));
+	if (!contextualizedActionCost)
+		throw std::runtime_error("Cannot encode cost function " + costFunction->getName());
+	write(contextualizedActionCost->maxSuccessRate);
+	write(contextualizedActionCost->defaultRate);
+	const ContextualizedActionCost::SuccessUtilites& utilities(contextualizedActionCost->successUtilities);
+	writeUInt(utilities.size());
+	for (ContextualizedActionCost::SuccessUtilites::const_iterator it = utilities.begin(); it != utilities.end(); ++it) {
+		writeString(it->first);
+		write(it->second);
+	}
+	const ContextualizedActionCost::SuccessRates& rates(contextualizedActionCost->successRates);
+	writeUInt(rates.size());
+	for (ContextualizedActionCost::SuccessRates::const_iterator it = rates.begin(); it != rates.end(); ++it) {
+		writeUInt(it->first.size());
+		for (size_t i = 0; i < it->first.size(); ++i)
+			writeString(it->first[i]);
+		write(it->second);
+	}
+}
+
+
+BinaryDecoder::BinaryDecoder(const Domain& domain, const unsigned char* data, size_t size, StateDictionary* states) :
+	domain(domain),
+	states(states),
+	pos(data),
+	end(data + size) {
+}
+
+unsigned char BinaryDecoder::readByte() {
+	if (pos == end)
+		throw std::runtime_error("Truncated binary node data");
+	return *pos++;
+}
+
+boost::uint64_t BinaryDecoder::readUInt() {
+	boost::uint64_t value(0);
+	for (unsigned shift = 0; ; shift += 7) {
+		if (shift >= 64)
+			throw std::runtime_error("Invalid variable-length integer in binary node data");
+		const unsigned char byte(readByte());
+		value |= boost::uint64_t(byte & 0x7f) << shift;
+		if ((byte & 0x80) == 0)
+			return value;
+	}
+}
+
+boost::int64_t BinaryDecoder::readInt() {
+	return unzigzag(readUInt());
+}
+
+size_t BinaryDecoder::readCount(size_t itemMinSize) {
+	const boost::uint64_t count(readUInt());
+	if (count > boost::uint64_t(end - pos) / std::max<size_t>(itemMinSize, 1))
+		throw std::runtime_error("Truncated binary node data");
+	return size_t(count);
+}
+
+std::string BinaryDecoder::readString() {
+	const size_t length(readUInt());
+	if (size_t(end - pos) < length)
+		throw std::runtime_error("Truncated binary node data");
+	const std::string value(reinterpret_cast<const char*>(pos), length);
+	pos += length;
+	return value;
+}
+
+Variables BinaryDecoder::readVariables(size_t count, Variable::Index base) {
+	// every variable takes at least one byte
+	if (count > size_t(end - pos))
+		throw std::runtime_error("Truncated binary node data");
+	Variables variables;
+	variables.reserve(count);
+	boost::int64_t previous(base);
+	for (size_t i = 0; i < count; ++i) {
+		const boost::int64_t delta(readInt());
+		if (delta < -previous || (delta > 0 && previous > std::numeric_limits<boost::int64_t>::max() - delta))
+			throw std::runtime_error("Invalid variable in binary node data");
+		previous += delta;
+		variables.push_back(Variable(previous));
+	}
+	return variables;
+}
+
+StateDictionary::Hash BinaryDecoder::readHash() {
+	StateDictionary::Hash hash(0);
+	for (size_t i = 0; i < sizeof(hash); ++i)
+		hash |= StateDictionary::Hash(readByte()) << (8 * i);
+	return hash;
+}
+
+void BinaryDecoder::readFunctionBytes(StateDictionary::EncodedFunctions& functions, size_t relationIndex) {
+	const size_t length(readUInt());
+	if (size_t(end - pos) < length)
+		throw std::runtime_error("Truncated binary node data");
+	functions[relationIndex].assign(pos, pos + length);
+	pos += length;
+}
+
+State BinaryDecoder::decodeFunctions(const StateDictionary::EncodedFunctions& functions) const {
+	State state;
+	for (StateDictionary::EncodedFunctions::const_iterator it = functions.begin(); it != functions.end(); ++it) {
+		const AbstractFunction* function(domain.getRelation(it->first));
+		if (!function)
+			throw std::runtime_error("Unknown function in binary node data");
+		State::AbstractFunctionState* functionState(function->createFunctionState());
+		state.functions[function] = functionState;
+		BinaryDecoder decoder(domain, it->second.empty() ? 0 : &it->second[0], it->second.size());
+		functionState->decode(decoder, function->arity);
+	}
+	return state;
+}
+
+/// read a state written by BinaryEncoder::writeState, updating the dictionary the same way
+State BinaryDecoder::readState(StateDictionary& dictionary) {
+	typedef StateDictionary::EncodedFunctions EncodedFunctions;
+	
+	switch (readUInt()) {
+		case STATE_REFERENCE: {
+			const StateDictionary::Hash hash(readHash());
+			const EncodedFunctions* cached(dictionary.find(hash));
+			if (!cached)
+				throw std::runtime_error("Unknown state reference in binary node data");
+			dictionary.use(hash);
+			return decodeFunctions(*cached);
+		}
+		
+		case STATE_UNCACHED:
+			return read<State>();
+		
+		case STATE_FULL: {
+			EncodedFunctions functions;
+			const size_t count(readCount(2));
+			for (size_t i = 0; i < count; ++i)
+				readFunctionBytes(functions, readUInt());
+			dictionary.insert(StateDictionary::hash(functions), functions);
+			return decodeFunctions(functions);
+		}
+		
+		case STATE_DELTA: {
+			const EncodedFunctions* base(dictionary.find(readHash()));
+			if (!base)
+				throw std::runtime_error("Unknown base state in binary node data");
+			EncodedFunctions functions(*base);
+			const size_t removedCount(readCount());
+			for (size_t i = 0; i < removedCount; ++i)
+				functions.erase(readUInt());
+			const size_t changedCount(readCount(2));
+			for (size_t i = 0; i < changedCount; ++i)
+				readFunctionBytes(functions, readUInt());
+			dictionary.insert(StateDictionary::hash(functions), functions);
+			return decodeFunctions(functions);
+		}
+		
+		default:
+			throw std::runtime_error("Invalid state encoding in binary node data");
+	}
+}
+
+template<>
+bool BinaryDecoder::read() {
+	return readByte() != 0;
+}
+
+template<>
+int BinaryDecoder::read() {
+	return int(readInt());
+}
+
+template<>
+float BinaryDecoder::read() {
+	boost::uint32_t bits(0);
+	for (size_t i = 0; i < sizeof(bits); ++i)
+		bits |= boost::uint32_t(readByte()) << (8 * i);
+	float value;
+	std::memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+template<>
+double BinaryDecoder::read() {
+	boost::uint64_t bits(0);
+	for (size_t i = 0; i < sizeof(bits); ++i)
+		bits |= boost::uint64_t(readByte()) << (8 * i);
+	double value;
+	std::memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+template<>
+Scope BinaryDecoder::read() {
+	Scope scope;
+	const size_t size(readCount());
+	scope.names.resize(size);
+	for (size_t i = 0; i < size; ++i)
+		scope.names[i] = readString();
+	return scope;
+}
+
+template<>
+Task BinaryDecoder::read() {
+	const Head* head(domain.getHead(readUInt()));
+	if (!head)
+		throw std::runtime_error("Unknown head in binary node data");
+	return Task(head, readVariables(head->getParamsCount()));
+}
+
+template<>
+Plan BinaryDecoder::read() {
+	const size_t planSize(readCount());
+	Plan plan;
+	plan.reserve(planSize);
+	for (size_t i = 0; i < planSize; ++i)
+		plan.push_back(read<Task>());
+	return plan;
+}
+
+template<>
+CNF BinaryDecoder::read() {
+	CNF cnf;
+	// read variables
+	const Variables::size_type variablesSize(readCount());
+	cnf.variables = readVariables(variablesSize);
+	// read literals, which must refer to boolean relations and to ranges of the variables
+	const NormalForm::Literals::size_type literalsSize(readCount(2));
+	cnf.literals.reserve(literalsSize);
+	Variables::size_type expectedOffset(0);
+	for (NormalForm::Literals::size_type i = 0; i < literalsSize; ++i) {
+		const AbstractFunction* function(domain.getRelation(readUInt()));
+		if (!function)
+			throw std::runtime_error("Unknown relation in binary node data");
+		NormalForm::Literal literal;
+		literal.function = dynamic_cast<const Atom::BoolFunction*>(function);
+		if (!literal.function)
+			throw std::runtime_error("Non-boolean relation in binary node data");
+		const boost::int64_t offset(readInt());
+		if (offset < -boost::int64_t(expectedOffset) || offset > boost::int64_t(variablesSize))
+			throw std::runtime_error("Invalid literal variables in binary node data");
+		literal.variables = expectedOffset + offset;
+		if (literal.variables + function->arity > variablesSize)
+			throw std::runtime_error("Invalid literal variables in binary node data");
+		literal.negated = false;
+		expectedOffset = literal.variables + function->arity;
+		cnf.literals.push_back(literal);
+	}
+	// read negations
+	unsigned char bits(0);
+	for (NormalForm::Literals::size_type i = 0; i < literalsSize; ++i) {
+		if (i % 8 == 0)
+			bits = readByte();
+		cnf.literals[i].negated = (bits >> (i % 8)) & 1;
+	}
+	// read junctions
+	const NormalForm::Junctions::size_type junctionsSize(readCount());
+	cnf.junctions.reserve(junctionsSize);
+	NormalForm::Literals::size_type previous(0);
+	for (NormalForm::Junctions::size_type i = 0; i < junctionsSize; ++i) {
+		const boost::uint64_t delta(readUInt());
+		if (delta > literalsSize - previous)
+			throw std::runtime_error("Invalid junction in binary node data");
+		previous += delta;
+		cnf.junctions.push_back(previous);
+	}
+	return cnf;
+}
+
+template<>
+State BinaryDecoder::read() {
+	State state;
+
+	const size_t count(readCount(2));
+	for (size_t i = 0; i < count; ++i) {
+		const AbstractFunction* function(domain.getRelation(readUInt()));
+		if (!function)
+			throw std::runtime_error("Unknown function in binary node data");
+		State::AbstractFunctionState* functionState(function->createFunctionState());
+		state.functions[function] = functionState;
+		functionState->decode(*this, function->arity);
+	}
+
+	return state;
+}
+
+//! owns a node of a network being decoded until the network does, so that it is freed if a read throws
+struct DecodedNode {
+	DecodedNode(const Task& task): node(new TaskNetwork::Node(task)) {}
+	~DecodedNode() { delete node; }
+	
+	TaskNetwork::Node* release() {
+		TaskNetwork::Node* released(node);
+		node = 0;
+		return released;
+	}
+	
+	TaskNetwork::Node* node;
+
+private:
+	DecodedNode(const DecodedNode&);
+	DecodedNode& operator=(const DecodedNode&);
+};
+
+template<>
+TaskNetwork BinaryDecoder::read() {
+	TaskNetwork::Tasks nodes;
+
+	// Note: as in the Qt serializer, we temporary store indexes in Node*
+	// and resolve them once all nodes are read. Nodes are owned by network
+	// as soon as they are inserted, whose destructor frees them if a later read throws.
+	TaskNetwork network;
+
+	// read first nodes
+	const size_t firstSize(readCount(2));
+	network.first.reserve(firstSize);
+	nodes.reserve(firstSize);
+	for (size_t i = 0; i < firstSize; ++i) {
+		DecodedNode node(read<Task>());
+		const size_t successorsCount(readCount());
+		node.node->successors.reserve(successorsCount);
+		for (size_t j = 0; j < successorsCount; ++j) {
+			node.node->successors.push_back((TaskNetwork::Node*)(size_t)readUInt());
+		}
+		nodes.push_back(node.node);
+		network.first.push_back(node.release());
+	}
+
+	// read predecessors nodes
+	const size_t predecessorsSize(readCount(3));
+	for (size_t i = 0; i < predecessorsSize; ++i) {
+		DecodedNode node(read<Task>());
+		const size_t successorsCount(readCount());
+		node.node->successors.reserve(successorsCount);
+		for (size_t j = 0; j < successorsCount; ++j) {
+			node.node->successors.push_back((TaskNetwork::Node*)(size_t)readUInt());
+		}
+		const size_t predecessorsCount(readUInt());
+		nodes.push_back(node.node);
+		network.predecessors[node.node] = predecessorsCount;
+		node.release();
+	}
+
+	// resolve cross-references, successors can only be nodes with predecessors
+	std::map<TaskNetwork::Node*, size_t> predecessorsCounts;
+	for (TaskNetwork::Tasks::iterator it = nodes.begin(); it != nodes.end(); ++it) {
+		TaskNetwork::Node* node(*it);
+		for (TaskNetwork::Tasks::iterator jt = node->successors.begin(); jt != node->successors.end(); ++jt) {
+			const size_t index((size_t)*jt);
+			if (index < firstSize || index >= nodes.size())
+				throw std::runtime_error("Invalid successor in binary node data");
+			*jt = nodes[index];
+			++predecessorsCounts[*jt];
+		}
+	}
+	// the counts of predecessors drive the network when tasks are erased, so they must be exact
+	for (TaskNetwork::Predecessors::const_iterator it = network.predecessors.begin(); it != network.predecessors.end(); ++it)
+		if (it->second != predecessorsCounts[it->first])
+			throw std::runtime_error("Invalid predecessors count in binary node data");
+
+	return network;
+}
+
+//! throw if variables refer beyond the variables allocated in a node
+static void checkVariables(const Variables& variables, size_t allocatedVariablesCount) {
+	if (!variables.allLessThan(allocatedVariablesCount))
+		throw std::runtime_error("Variable out of scope in binary node data");
+}
+
+template<>
+Planner9::SearchNode BinaryDecoder::read() {
+	const Plan plan(read<Plan>());
+	const TaskNetwork network(read<TaskNetwork>());
+	const size_t allocatedVariablesCount(readUInt());
+	const CNF preconditions(read<CNF>());
+	const State state(states ? readState(*states) : read<State>());
+	const Planner9::Cost pathCost(read<double>());
+	const Planner9::Cost heuristicCost(read<double>());
+	
+	// indices of variables are used to index substitutions, check them against the scope of the node
+	for (Plan::const_iterator it = plan.begin(); it != plan.end(); ++it)
+		checkVariables(it->params, allocatedVariablesCount);
+	for (TaskNetwork::Tasks::const_iterator it = network.first.begin(); it != network.first.end(); ++it)
+		checkVariables((*it)->task.params, allocatedVariablesCount);
+	for (TaskNetwork::Predecessors::const_iterator it = network.predecessors.begin(); it != network.predecessors.end(); ++it)
+		checkVariables(it->first->task.params, allocatedVariablesCount);
+	checkVariables(preconditions.variables, allocatedVariablesCount);
+	
+	return Planner9::SearchNode(plan, network, allocatedVariablesCount, preconditions, state, pathCost, heuristicCost);
+}
+
+template<>
+SearchCounters BinaryDecoder::read() {
+	SearchCounters counters;
+	counters.nodesExpanded = readUInt();
+	counters.nodesGenerated = readUInt();
+	counters.nodesPruned = readUInt();
+	counters.preconditionsFailures = readUInt();
+	counters.cacheHits = readUInt();
+	counters.cacheMisses = readUInt();
+	for (size_t i = 0; i < SearchCounters::PHASES_COUNT; ++i)
+		counters.phasesTimes[i] = readUInt();
+	for (size_t i = 0; i < SearchCounters::branchingBinsCount; ++i)
+		counters.branchingFactors[i] = readUInt();
+	counters.frontierSamplingInterval = readUInt();
+	counters.frontierSamplesCount = readUInt();
+	if (counters.frontierSamplesCount > SearchCounters::frontierSamplesMax)
+		throw std::runtime_error("Too many frontier samples in binary counters data");
+	for (size_t i = 0; i < counters.frontierSamplesCount; ++i)
+		counters.frontierSizes[i] = readUInt();
+	return counters;
+}
+
+template<>
+const Planner9::CostFunction* BinaryDecoder::read() {
+	const std::string name(readString());
+	if (name == AlternativesCost().getName())
+		return new AlternativesCost;
+	
+	if (name != ContextualizedActionCost().getName())
+		throw std::runtime_error("Unknown cost function " + name + " in binary data");
+	// allocate once fully read, not to leak on truncated data
+	ContextualizedActionCost contextualizedActionCost;
+	contextualizedActionCost.maxSuccessRate = read<double>();
+	contextualizedActionCost.defaultRate = read<double>();
+	const size_t utilitiesCount(readCount(1 + sizeof(double)));
+	for (size_t i = 0; i < utilitiesCount; ++i) {
+		const std::string actionName(readString());
+		contextualizedActionCost.successUtilities[actionName] = read<double>();
+	}
+	const size_t ratesCount(readCount(1 + sizeof(double)));
+	for (size_t i = 0; i < ratesCount; ++i) {
+		ContextualizedActionCost::ContextualizedAction action(readCount());
+		for (size_t j = 0; j < action.size(); ++j)
+			action[j] = readString();
+		contextualizedActionCost.successRates[action] = read<double>();
+	}
+	return new ContextualizedActionCost(contextualizedActionCost);
+}
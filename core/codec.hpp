@@ -0,0 +1,141 @@
+#ifndef CODEC_HPP_
+#define CODEC_HPP_
+
+#include "planner9.hpp"
+#include <vector>
+#include <string>
+#include <map>
+#include <deque>
+#include <boost/cstdint.hpp>
+
+struct Domain;
+
+// Compact binary encoding of search nodes, independent of any toolkit.
+// Counts and indices are stored as variable-length integers, sequences of
+// variables are delta-encoded and literal negations are packed as bits,
+// so there is no limit on the size of scopes, domains or nodes.
+
+// States already transferred on a connection, identified by a hash of their content.
+// Each end keeps one per direction: the encoder inserts every state it sends
+// in full or as a delta and the decoder every state it receives, in the same
+// order, so that both evict the same entries and stay in sync.
+struct StateDictionary {
+	typedef std::vector<unsigned char> Bytes;
+	typedef std::map<size_t, Bytes> EncodedFunctions; //!< encoded values by relation index
+	typedef boost::uint64_t Hash;
+
+	StateDictionary(size_t capacity = 1024);
+
+	static Hash hash(const EncodedFunctions& functions);
+
+	const EncodedFunctions* find(Hash hash) const;
+	void insert(Hash hash, const EncodedFunctions& functions);
+	//! make hash the base of the next delta
+	void use(Hash hash);
+	//! last state inserted or used, 0 if none
+	const EncodedFunctions* getBase() const;
+	Hash getBaseHash() const { return baseHash; }
+	
+	SearchCounters counters; //!< hits and misses of the states written with this dictionary
+
+private:
+	typedef std::map<Hash, EncodedFunctions> Entries;
+	typedef std::deque<Hash> Order;
+
+	const size_t capacity;
+	Entries entries;
+	Order order; //!< insertion order, for eviction
+	Hash baseHash;
+	bool hasBase;
+};
+
+struct BinaryEncoder {
+	typedef std::vector<unsigned char> Buffer;
+
+	//! if states is given, states of search nodes are sent once and then referenced
+	BinaryEncoder(const Domain& domain, StateDictionary* states = 0);
+
+	void writeUInt(boost::uint64_t value);
+	void writeInt(boost::int64_t value);
+	void writeString(const std::string& value);
+	void writeVariables(const Variables& variables, Variable::Index base = 0);
+	void writeState(const State& state, StateDictionary& dictionary);
+
+	template<typename T>
+	void write(const T& t);
+
+	const unsigned char* data() const { return buffer.empty() ? 0 : &buffer[0]; }
+	size_t size() const { return buffer.size(); }
+	void clear() { buffer.clear(); }
+
+	const Domain& domain;
+	StateDictionary* states;
+	Buffer buffer;
+
+private:
+	void writeHash(StateDictionary::Hash hash);
+};
+
+struct BinaryDecoder {
+	// data is not copied and must outlive the decoder
+	// invalid data, truncated or corrupt, makes reads throw std::runtime_error without leaking
+	BinaryDecoder(const Domain& domain, const unsigned char* data, size_t size, StateDictionary* states = 0);
+
+	boost::uint64_t readUInt();
+	boost::int64_t readInt();
+	//! read a count of items taking at least itemMinSize bytes each, throw std::runtime_error if they cannot fit in the data left
+	size_t readCount(size_t itemMinSize = 1);
+	std::string readString();
+	Variables readVariables(size_t count, Variable::Index base = 0);
+	State readState(StateDictionary& dictionary);
+
+	template<typename T>
+	T read();
+
+	bool atEnd() const { return pos == end; }
+	const unsigned char* position() const { return pos; }
+
+	const Domain& domain;
+	StateDictionary* states;
+
+private:
+	unsigned char readByte();
+	StateDictionary::Hash readHash();
+	void readFunctionBytes(StateDictionary::EncodedFunctions& functions, size_t relationIndex);
+	State decodeFunctions(const StateDictionary::EncodedFunctions& functions) const;
+
+	const unsigned char* pos;
+	const unsigned char* end;
+};
+
+template<> void BinaryEncoder::write(const bool& value);
+template<> void BinaryEncoder::write(const int& value);
+template<> void BinaryEncoder::write(const float& value);
+template<> void BinaryEncoder::write(const double& value);
+template<> void BinaryEncoder::write(const Scope& scope);
+template<> void BinaryEncoder::write(const Task& task);
+template<> void BinaryEncoder::write(const Plan& plan);
+template<> void BinaryEncoder::write(const CNF& cnf);
+template<> void BinaryEncoder::write(const State& state);
+template<> void BinaryEncoder::write(const TaskNetwork& network);
+template<> void BinaryEncoder::write(const Planner9::SearchNode& node);
+template<> void BinaryEncoder::write(const SearchCounters& counters);
+//! the cost functions of costs.hpp, identified by their name, throw std::runtime_error for others
+template<> void BinaryEncoder::write(const Planner9::CostFunction* const& costFunction);
+
+template<> bool BinaryDecoder::read();
+template<> int BinaryDecoder::read();
+template<> float BinaryDecoder::read();
+template<> double BinaryDecoder::read();
+template<> Scope BinaryDecoder::read();
+template<> Task BinaryDecoder::read();
+template<> Plan BinaryDecoder::read();
+template<> CNF BinaryDecoder::read();
+template<> State BinaryDecoder::read();
+template<> TaskNetwork BinaryDecoder::read();
+template<> Planner9::SearchNode BinaryDecoder::read();
+template<> SearchCounters BinaryDecoder::read();
+//! return a new cost function, which the caller owns
+template<> const Planner9::CostFunction* BinaryDecoder::read();
+
+#endif // CODEC_HPP_
@@ -31,6 +31,9 @@ protected:
 	double defaultRate;
 	SuccessUtilites successUtilities; //!< utilities for every action, must be 0 < u(a) <= 1
 	SuccessRates successRates; //! success rates for every contextualised action, must be 0 <= r(ca) < 1
+	
+	friend struct BinaryEncoder;
+	friend struct BinaryDecoder;
 };
 
 std::ostream& operator<<(std::ostream& os, const ContextualizedActionCost::ContextualizedAction& action);
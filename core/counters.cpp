@@ -0,0 +1,60 @@
+#include "counters.hpp"
+
+const char* SearchCounters::phasesNames[PHASES_COUNT] = {
+	"ground",
+	"simplify",
+	"apply",
+	"copy",
+	"cost"
+};
+
+SearchCounters::SearchCounters() {
+	clear();
+}
+
+void SearchCounters::clear() {
+	nodesExpanded = 0;
+	nodesGenerated = 0;
+	nodesPruned = 0;
+	preconditionsFailures = 0;
+	cacheHits = 0;
+	cacheMisses = 0;
+	std::fill(phasesTimes, phasesTimes + PHASES_COUNT, 0);
+	std::fill(branchingFactors, branchingFactors + branchingBinsCount, 0);
+	std::fill(frontierSizes, frontierSizes + frontierSamplesMax, 0);
+	frontierSamplesCount = 0;
+	frontierSamplingInterval = 1;
+}
+
+SearchCounters& SearchCounters::operator+=(const SearchCounters& that) {
+	nodesExpanded += that.nodesExpanded;
+	nodesGenerated += that.nodesGenerated;
+	nodesPruned += that.nodesPruned;
+	preconditionsFailures += that.preconditionsFailures;
+	cacheHits += that.cacheHits;
+	cacheMisses += that.cacheMisses;
+	for (size_t i = 0; i < PHASES_COUNT; ++i)
+		phasesTimes[i] += that.phasesTimes[i];
+	for (size_t i = 0; i < branchingBinsCount; ++i)
+		branchingFactors[i] += that.branchingFactors[i];
+	return *this;
+}
+
+std::ostream& operator<<(std::ostream& os, const SearchCounters& counters) {
+	os << "nodes: " << counters.nodesExpanded << " expanded, " << counters.nodesGenerated << " generated, ";
+	os << counters.nodesPruned << " pruned, " << counters.preconditionsFailures << " preconditions failures" << std::endl;
+	os << "time (µs):";
+	for (size_t i = 0; i < SearchCounters::PHASES_COUNT; ++i)
+		os << " " << SearchCounters::phasesNames[i] << " " << counters.phasesTimes[i];
+	os << std::endl;
+	os << "branching factors:";
+	for (size_t i = 0; i < SearchCounters::branchingBinsCount; ++i)
+		os << " " << counters.branchingFactors[i];
+	os << std::endl;
+	os << "frontier every " << counters.frontierSamplingInterval << " iterations:";
+	for (size_t i = 0; i < counters.frontierSamplesCount; ++i)
+		os << " " << counters.frontierSizes[i];
+	os << std::endl;
+	os << "cache: " << counters.cacheHits << " hits, " << counters.cacheMisses << " misses" << std::endl;
+	return os;
+}
@@ -0,0 +1,132 @@
+#ifndef COUNTERS_HPP_
+#define COUNTERS_HPP_
+
+#include <boost/cstdint.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <algorithm>
+#include <iostream>
+#include <cstddef>
+
+//! measures of where a search spends its work
+/*!
+	Every thread of a planner counts in its own instance, which the planner
+	sums into its totals. Unless PLANNER9_NO_COUNTERS is defined, in which
+	case all counting functions do nothing and the counters stay at zero.
+*/
+struct SearchCounters {
+	enum Phase {
+		PHASE_GROUND, //!< grounding of variables, including the simplifications it makes
+		PHASE_SIMPLIFY, //!< simplification of the preconditions of actions and alternatives
+		PHASE_APPLY, //!< application of the effects of actions
+		PHASE_COPY, //!< copy and substitution of plans, networks, preconditions and nodes
+		PHASE_COST, //!< evaluation of the cost function
+		PHASES_COUNT
+	};
+	static const char* phasesNames[PHASES_COUNT];
+
+	static const size_t branchingBinsCount = 16;
+	static const size_t frontierSamplesMax = 64;
+
+	//! accounts the time spent in consecutive phases of a computation
+	struct Timer {
+		Timer(SearchCounters& counters);
+		//! add the time since construction or the previous lap to phase
+		void lap(Phase phase);
+		//! start the next lap now, the time since the previous one being accounted elsewhere
+		void skip();
+
+#ifndef PLANNER9_NO_COUNTERS
+	private:
+		SearchCounters& counters;
+		boost::posix_time::ptime lastTime;
+#endif
+	};
+
+	SearchCounters();
+	void clear();
+	//! sum all counters but the frontier samples, which only make sense for a single frontier
+	SearchCounters& operator+=(const SearchCounters& that);
+
+	void nodeExpanded(size_t childrenCount);
+	void nodeGenerated();
+	void nodePruned();
+	void preconditionsFailed();
+	void cacheAccessed(bool hit);
+	//! record the size of the frontier, if a sample is due at iteration
+	void sampleFrontier(size_t iteration, size_t size);
+
+	boost::uint64_t nodesExpanded;
+	boost::uint64_t nodesGenerated;
+	boost::uint64_t nodesPruned; //!< generated nodes dropped because of the cost bound
+	boost::uint64_t preconditionsFailures; //!< actions and alternatives whose preconditions cannot hold
+	boost::uint64_t cacheHits;
+	boost::uint64_t cacheMisses;
+	boost::uint64_t phasesTimes[PHASES_COUNT]; //!< µs spent in every phase
+	//! expanded nodes by number of children, the last bin counting all larger numbers
+	boost::uint64_t branchingFactors[branchingBinsCount];
+	//! size of the frontier every frontierSamplingInterval iterations, the interval doubling whenever samples are full
+	size_t frontierSizes[frontierSamplesMax];
+	size_t frontierSamplesCount;
+	size_t frontierSamplingInterval;
+};
+
+std::ostream& operator<<(std::ostream& os, const SearchCounters& counters);
+
+#ifndef PLANNER9_NO_COUNTERS
+
+inline SearchCounters::Timer::Timer(SearchCounters& counters):
+	counters(counters),
+	lastTime(boost::posix_time::microsec_clock::universal_time()) {
+}
+
+inline void SearchCounters::Timer::lap(Phase phase) {
+	const boost::posix_time::ptime time(boost::posix_time::microsec_clock::universal_time());
+	if (time > lastTime)
+		counters.phasesTimes[phase] += (time - lastTime).total_microseconds();
+	lastTime = time;
+}
+
+inline void SearchCounters::Timer::skip() {
+	lastTime = boost::posix_time::microsec_clock::universal_time();
+}
+
+inline void SearchCounters::nodeExpanded(size_t childrenCount) {
+	++nodesExpanded;
+	++branchingFactors[std::min(childrenCount, branchingBinsCount - 1)];
+}
+
+inline void SearchCounters::nodeGenerated() { ++nodesGenerated; }
+inline void SearchCounters::nodePruned() { ++nodesPruned; }
+inline void SearchCounters::preconditionsFailed() { ++preconditionsFailures; }
+inline void SearchCounters::cacheAccessed(bool hit) { ++(hit ? cacheHits : cacheMisses); }
+
+inline void SearchCounters::sampleFrontier(size_t iteration, size_t size) {
+	if (iteration < frontierSamplesCount * frontierSamplingInterval)
+		return;
+	if (frontierSamplesCount == frontierSamplesMax) {
+		// keep every other sample
+		for (size_t i = 0; i < frontierSamplesMax / 2; ++i)
+			frontierSizes[i] = frontierSizes[i * 2];
+		frontierSamplesCount = frontierSamplesMax / 2;
+		frontierSamplingInterval *= 2;
+		if (iteration < frontierSamplesCount * frontierSamplingInterval)
+			return;
+	}
+	frontierSizes[frontierSamplesCount++] = size;
+}
+
+#else // PLANNER9_NO_COUNTERS
+
+inline SearchCounters::Timer::Timer(SearchCounters&) {}
+inline void SearchCounters::Timer::lap(Phase) {}
+inline void SearchCounters::Timer::skip() {}
+inline void SearchCounters::nodeExpanded(size_t) {}
+inline void SearchCounters::nodeGenerated() {}
+inline void SearchCounters::nodePruned() {}
+inline void SearchCounters::preconditionsFailed() {}
+inline void SearchCounters::cacheAccessed(bool) {}
+inline void SearchCounters::sampleFrontier(size_t, size_t) {}
+
+#endif // PLANNER9_NO_COUNTERS
+
+#endif // COUNTERS_HPP_
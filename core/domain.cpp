@@ -222,9 +222,9 @@ void Action::Effects::substitute(const Substitution& subst) {
 	}
 }
 
-void Action::Effects::updateAffectedFunctionsAndVariables(FunctionsSet& affectedFunctions, VariablesSet& affectedVariables, const size_t constantsCount) const {
+void Action::Effects::updateAffectedVariables(VariablesSet& affectedVariables, const size_t constantsCount) const {
 	for (const_iterator it = begin(); it != end(); ++it) {
-		(*it)->updateAffectedFunctionsAndVariables(affectedFunctions, affectedVariables, constantsCount);
+		(*it)->updateAffectedVariables(affectedVariables, constantsCount);
 	}
 }
 
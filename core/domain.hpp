@@ -94,7 +94,7 @@ callFusion(const boost::function<UserFunction>& userFunction, const ScopedArgume
 	Variables variables;
 	CallFusion callFusion(scope, variables);
 	typename Function::Lookups lookups(fusion::transform(arguments, callFusion));
-	const Function* function(new Function(userFunction, lookups));
+	const Function* function(new Function(userFunction, lookups, variables.size()));
 	return ReturnScopeLookup(scope, Lookup(function, variables));
 }
 
@@ -171,7 +171,7 @@ struct Action: Head {
 		virtual AbstractEffect* clone() const = 0;
 		virtual void apply(const State& state, State& newState, const Substitution subst) const = 0;
 		virtual void substitute(const Substitution& subst) = 0;
-		virtual void updateAffectedFunctionsAndVariables(FunctionsSet& affectedFunctions, VariablesSet& affectedVariables, const size_t constantsCount) const = 0;
+		virtual void updateAffectedVariables(VariablesSet& affectedVariables, const size_t constantsCount) const = 0;
 	};
 
 	template<typename ValueType>
@@ -211,11 +211,9 @@ struct Action: Head {
 			}
 		}
 		
-		virtual void updateAffectedFunctionsAndVariables(FunctionsSet& affectedFunctions, VariablesSet& affectedVariables, const size_t constantsCount) const {
-			// for left part, get function (because it will be written) and variables (because they must be ground)
-			affectedFunctions.insert(left.function);
+		virtual void updateAffectedVariables(VariablesSet& affectedVariables, const size_t constantsCount) const {
+			// both parts must be ground, the written function is known by the action
 			updateAffectedVariables(left.params, affectedVariables, constantsCount);
-			// for right part, get only variables (because they must be ground)
 			updateAffectedVariables(right.params, affectedVariables, constantsCount);
 		}
 	};
@@ -226,12 +224,13 @@ struct Action: Head {
 		~Effects();
 		State apply(const State& state, const Substitution subst) const;
 		void substitute(const Substitution& subst);
-		void updateAffectedFunctionsAndVariables(FunctionsSet& affectedFunctions, VariablesSet& affectedVariables, const size_t constantsCount) const;
+		void updateAffectedVariables(VariablesSet& affectedVariables, const size_t constantsCount) const;
 	};
 
 	const Scope& getScope() const { return scope; }
 	const CNF& getPrecondition() const { return precondition; }
 	const Effects& getEffects() const { return effects; }
+	const FunctionsSet& getAffectedFunctions() const { return affectedFunctions; }
 
 	template<typename ValueType>
 	void assign(const ScopedLookup<ValueType>& left, const ScopedLookup<ValueType>& right) {
@@ -248,6 +247,7 @@ struct Action: Head {
 		domain->registerFunction(leftLookup.function);
 		domain->registerFunction(rightLookup.function);
 		effects.push_back(new Effect<ValueType>(leftLookup, rightLookup));
+		affectedFunctions.insert(leftLookup.function);
 	}
 	
 	template<typename ValueType>
@@ -260,6 +260,7 @@ private:
 	Scope scope;
 	CNF precondition;
 	Effects effects;
+	FunctionsSet affectedFunctions; //!< functions written by the effects, computed once for all searches
 };
 
 struct Method: Head {
@@ -0,0 +1,48 @@
+#include "histogram.hpp"
+#include <algorithm>
+#include <cmath>
+
+CostHistogram::CostHistogram():
+	counts(bucketsCount, 0) {
+}
+
+size_t CostHistogram::getBucket(Planner9::Cost cost) {
+	if (!(cost > 0))
+		return 0;
+	if (cost == Planner9::InfiniteCost)
+		return bucketsCount - 1;
+	
+	const double position(std::floor((std::log(cost) / std::log(2.) - minExponent) * bucketsPerOctave) + 1);
+	if (position < 1)
+		return 0;
+	return size_t(std::min(position, double(bucketsCount - 1)));
+}
+
+Planner9::Cost CostHistogram::getBucketEnd(size_t bucket) {
+	if (bucket >= bucketsCount - 1)
+		return Planner9::InfiniteCost;
+	return std::pow(2., double(bucket) / bucketsPerOctave + minExponent);
+}
+
+void CostHistogram::clear() {
+	std::fill(counts.begin(), counts.end(), 0);
+}
+
+size_t CostHistogram::countUpTo(size_t bucket) const {
+	size_t count(0);
+	for (size_t i = 0; i <= bucket && i < bucketsCount; ++i)
+		count += counts[i];
+	return count;
+}
+
+CostHistogram& CostHistogram::operator+=(const CostHistogram& that) {
+	for (size_t i = 0; i < bucketsCount; ++i)
+		counts[i] += that.counts[i];
+	return *this;
+}
+
+CostHistogram& CostHistogram::operator-=(const CostHistogram& that) {
+	for (size_t i = 0; i < bucketsCount; ++i)
+		counts[i] -= std::min(counts[i], that.counts[i]);
+	return *this;
+}
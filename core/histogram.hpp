@@ -0,0 +1,45 @@
+#ifndef HISTOGRAM_HPP_
+#define HISTOGRAM_HPP_
+
+#include "planner9.hpp"
+#include <vector>
+
+//! number of search nodes by total cost
+/*!
+	Buckets are geometric and the same for every search, with
+	bucketsPerOctave buckets per power of two starting at 2^minExponent,
+	so that histograms of different planners can be compared and merged.
+	Bucket 0 holds costs below 2^minExponent and the last bucket holds
+	costs beyond the range, including InfiniteCost.
+*/
+struct CostHistogram {
+	static const size_t bucketsCount = 128;
+	static const size_t bucketsPerOctave = 4;
+	static const int minExponent = -8;
+	
+	typedef std::vector<size_t> Counts;
+	
+	CostHistogram();
+	
+	static size_t getBucket(Planner9::Cost cost);
+	//! lowest cost not in bucket
+	static Planner9::Cost getBucketEnd(size_t bucket);
+	
+	void add(Planner9::Cost cost) { ++counts[getBucket(cost)]; }
+	void remove(Planner9::Cost cost) { --counts[getBucket(cost)]; }
+	void clear();
+	
+	//! number of nodes in buckets up to and including bucket
+	size_t countUpTo(size_t bucket) const;
+	size_t getTotalCount() const { return countUpTo(bucketsCount - 1); }
+	
+	CostHistogram& operator+=(const CostHistogram& that);
+	//! removes the counts of that, saturating at 0 as the histograms may be slightly out of date
+	CostHistogram& operator-=(const CostHistogram& that);
+	bool operator==(const CostHistogram& that) const { return counts == that.counts; }
+	bool operator!=(const CostHistogram& that) const { return counts != that.counts; }
+	
+	Counts counts;
+};
+
+#endif // HISTOGRAM_HPP_
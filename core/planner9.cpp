@@ -31,20 +31,42 @@ std::ostream& operator<<(std::ostream& os, const Planner9::SearchNodeData& node)
 }
 
 
-Planner9::SearchNode::SearchNode(const Plan& plan, const TaskNetwork& network, size_t allocatedVariablesCount, const CNF& preconditions, const State& state, const Cost pathPlusAlternativeCost, const CostFunction* costFunction):
+Planner9::SearchNode::SearchNode(const Plan& plan, const TaskNetwork& network, size_t allocatedVariablesCount, const CNF& preconditions, const State& state, const Cost pathPlusAlternativeCost, const CostFunction* costFunction, SearchCounters* counters):
 	SearchNodeData(plan, network, allocatedVariablesCount, preconditions, state),
-	pathCost(costFunction->getPathCost(*this, pathPlusAlternativeCost)),
-	heuristicCost(costFunction->getHeuristicCost(*this))
+	pathCost(computePathCost(costFunction, pathPlusAlternativeCost, counters)),
+	heuristicCost(computeHeuristicCost(costFunction, counters)),
+	traceId(0),
+	lineage(0)
 {
 }
 
 Planner9::SearchNode::SearchNode(const Plan& plan, const TaskNetwork& network, size_t allocatedVariablesCount, const CNF& preconditions, const State& state, const Planner9::Cost pathCost, const Planner9::Cost heuristicCost):
 	SearchNodeData(plan, network, allocatedVariablesCount, preconditions, state),
 	pathCost(pathCost),
-	heuristicCost(heuristicCost)
+	heuristicCost(heuristicCost),
+	traceId(0),
+	lineage(0)
 {
 }
 
+Planner9::Cost Planner9::SearchNode::computePathCost(const CostFunction* costFunction, const Cost pathPlusAlternativeCost, SearchCounters* counters) const {
+	if (!counters)
+		return costFunction->getPathCost(*this, pathPlusAlternativeCost);
+	SearchCounters::Timer timer(*counters);
+	const Cost cost(costFunction->getPathCost(*this, pathPlusAlternativeCost));
+	timer.lap(SearchCounters::PHASE_COST);
+	return cost;
+}
+
+Planner9::Cost Planner9::SearchNode::computeHeuristicCost(const CostFunction* costFunction, SearchCounters* counters) const {
+	if (!counters)
+		return costFunction->getHeuristicCost(*this);
+	SearchCounters::Timer timer(*counters);
+	const Cost cost(costFunction->getHeuristicCost(*this));
+	timer.lap(SearchCounters::PHASE_COST);
+	return cost;
+}
+
 std::ostream& operator<<(std::ostream& os, const Planner9::SearchNode& node) {
 	os << (const Planner9::SearchNodeData&)node;
 	os << "cost path " << node.pathCost << ", heuristic " << node.heuristicCost << std::endl;
@@ -56,7 +78,8 @@ static AlternativesCost alternativesCost;
 Planner9::Planner9(const Scope& problemScope, const CostFunction* costFunction, std::ostream* debugStream):
 	problemScope(problemScope),
 	costFunction(costFunction),
-	debugStream(debugStream) {
+	debugStream(debugStream),
+	tracer(0) {
 	if (debugStream) {
 		*debugStream << Scope::setScope(this->problemScope); 
 		if (costFunction) {
@@ -169,195 +192,291 @@ Planner9::Groundings Planner9::ground(const VariablesSet& affectedVariables, con
 	return groundings;
 }
 
-void Planner9::visitNode(const SearchNode* n) {
-	visitNode(n->plan, n->network, n->allocatedVariablesCount, n->preconditions, n->state, n->pathCost);
-}
-
-void Planner9::visitNode(const Plan& plan, const TaskNetwork& network, const size_t allocatedVariablesCount, const CNF& preconditions, const State& state, Cost cost) {
+void Planner9::visitNode(const SearchNode* node) {
+	SearchCounters& counters(getLocalCounters());
+	const boost::uint64_t generatedCount(counters.nodesGenerated);
+	if (tracer)
+		traceExpansion(getLocalTrace(), node);
+	
 	// HTN: T0 ← {t ∈ T : no other task in T is constrained to precede t}
-	const TaskNetwork::Tasks& t0 = network.first;
+	const TaskNetwork::Tasks& t0 = node->network.first;
 	
 	// HTN: if T = ∅ then return P
-	if (t0.empty()) {
+	if (t0.empty())
+		visitGoal(node);
+
+	// HTN: nondeterministically choose any t ∈ T0
+	for (size_t ti = 0; ti < t0.size(); ++ti)
+		visitTask(node, ti);
+	
+	counters.nodeExpanded(counters.nodesGenerated - generatedCount);
+}
+
+void Planner9::visitGoal(const SearchNode* node) {
+	const Plan& plan(node->plan);
+	const size_t allocatedVariablesCount(node->allocatedVariablesCount);
+	const CNF& preconditions(node->preconditions);
+	const State& state(node->state);
+	
+	// look into preconditions for all remaining variables
+	VariablesSet remainingVariables;
+	for (Variables::const_iterator it = preconditions.variables.begin(); it != preconditions.variables.end(); ++it) {
+		const Variable& variable(*it);
+		if(variable.index >= problemScope.getSize())
+			remainingVariables.insert(variable);
+	}
+			
+	// ground remaining variables
+	SearchCounters::Timer timer(getLocalCounters());
+	Groundings groundings(ground(remainingVariables, preconditions, state, allocatedVariablesCount));
+	timer.lap(SearchCounters::PHASE_GROUND);
+
+	// Create plan with valid grounding
+	for (Groundings::iterator it = groundings.begin(); it != groundings.end(); ++it) {
+		Substitution& subst(it->first);
+		Plan assignedPlan(plan);
+		assignedPlan.substitute(subst);
+		timer.lap(SearchCounters::PHASE_COPY);
+		if (tracer)
+			getLocalTrace().goal(tracer->getTime(), node->traceId, node->getTotalCost());
+		success(assignedPlan, node->getTotalCost());
+	}
+}
+
+void Planner9::visitTask(const SearchNode* node, size_t ti) {
+	const Head* head(node->network.first[ti]->task.head);
+
+	const Action* action = dynamic_cast<const Action*>(head);
+	if(action != 0) {
+		if (debugStream)
+			*debugStream << "action " << std::endl;
+		visitAction(node, ti, action);
+	}
+
+	// if t is a method then decompose
+	const Method* method = dynamic_cast<const Method*>(head);
+	if (method != 0) {
+		if (debugStream)
+			*debugStream << "method" << std::endl;
+		// HTN: else
+
+		// HTN: M ← {(m, θ) : m is an instance of a method in D, θ uniﬁes {head(m), t},
+		// HTN: 			   pre(m) is true in s, and m and θ are as general as possible}
+		// HTN: if M = ∅ then return failure
+		// HTN: nondeterministically choose a pair (m, θ) ∈ M
+
+		// push all alternatives
+		for (size_t ai = 0; ai < method->alternatives.size(); ++ai)
+			visitAlternative(node, ti, method, ai);
+	}
+}
+
+void Planner9::visitAction(const SearchNode* node, size_t ti, const Action* action) {
+	const Plan& plan(node->plan);
+	const TaskNetwork& network(node->network);
+	const size_t allocatedVariablesCount(node->allocatedVariablesCount);
+	const CNF& preconditions(node->preconditions);
+	const State& state(node->state);
+	const Cost cost(node->pathCost);
+	const Task& t(network.first[ti]->task);
+	const Head* head(t.head);
+	
+	// HTN: if t is a primitive task then
+
+	// TODO: HTN: A ← {(a, θ) : a is a ground instance of an operator in D, θ is a substi-
+	// HTN: tution that uniﬁes {head(a), t}, and s satisﬁes a’s preconditions}
+	// HTN: if A = ∅ then return failure
+	// HTN: nondeterministically choose a pair (a, θ) ∈ A
+	// TODO: HTN: modify s by deleting del(a) and adding add(a)
+
+	SearchCounters& counters(getLocalCounters());
+	SearchCounters::Timer timer(counters);
+	TaskNetwork newNetwork(network);
+	newNetwork.erase(ti);
+
+	Substitution subst = t.getSubstitution(action->getScope().getSize(), allocatedVariablesCount);
+	size_t newAllocatedVariablesCount = allocatedVariablesCount + action->getScope().getSize() - head->getParamsCount();
+
+	CNF newPreconditions(action->getPrecondition());
+	newPreconditions.substitute(subst);
+	newPreconditions += preconditions;
+
+	if (debugStream) *debugStream << "raw pre:  " << Scope::setScope(problemScope) << newPreconditions << std::endl;
+	timer.lap(SearchCounters::PHASE_COPY);
+	OptionalVariables simplificationResult = newPreconditions.simplify(state, problemScope.getSize(), newAllocatedVariablesCount);
+	timer.lap(SearchCounters::PHASE_SIMPLIFY);
+	if (simplificationResult) {
+		if (debugStream) *debugStream << "simp. pre:  " << Scope::setScope(problemScope) << newPreconditions << std::endl;
+
+		Action::Effects effects(action->getEffects());
+		effects.substitute(subst);
+
+		Plan newPlan(plan);
+
+		Substitution simplificationSubst(simplificationResult.get());
+		newAllocatedVariablesCount = simplificationSubst.defrag(problemScope.getSize());
+		newPreconditions.substitute(simplificationSubst);
+		newPlan.substitute(simplificationSubst);
+		newNetwork.substitute(simplificationSubst);
+		effects.substitute(simplificationSubst);
+		timer.lap(SearchCounters::PHASE_COPY);
+
+		// discover which variables must be grounded
+
+		// collect all variables and relation affected by the effects
+		VariablesSet affectedVariables;
+		const FunctionsSet& affectedRelations(action->getAffectedFunctions());
+
+		// first iterate on all effects and get a list of affected variables
+		effects.updateAffectedVariables(affectedVariables, problemScope.getSize());
 		
-		// look into preconditions for all remaining variables
-		VariablesSet remainingVariables;
-		for (Variables::const_iterator it = preconditions.variables.begin(); it != preconditions.variables.end(); ++it) {
-			const Variable& variable(*it);
-			if(variable.index >= problemScope.getSize())
-				remainingVariables.insert(variable);
+		// then look into preconditions for all indirectly affected variables
+		for(NormalForm::Literals::const_iterator it = newPreconditions.literals.begin(); it != newPreconditions.literals.end(); ++it) {
+			const NormalForm::Literal& literal(*it);
+			if (affectedRelations.find(literal.function) != affectedRelations.end()) {
+				// the relation of this literal is affected, all its variables must be grounded
+				const Variables params(newPreconditions.getParams(literal));
+				for (Variables::const_iterator kt = params.begin(); kt != params.end(); ++kt) {
+					const Variable& variable = *kt;
+					if(variable.index >= problemScope.getSize())
+						affectedVariables.insert(variable);
+				}
+			}
 		}
-				
-		// ground remaining variables
-		Groundings groundings(ground(remainingVariables, preconditions, state, allocatedVariablesCount));
+		
+		// ground affected variables
+		Groundings groundings(ground(affectedVariables, newPreconditions, state, newAllocatedVariablesCount));
+		timer.lap(SearchCounters::PHASE_GROUND);
 
-		// Create plan with valid grounding
+		// Create new nodes with valid groundings
 		for (Groundings::iterator it = groundings.begin(); it != groundings.end(); ++it) {
 			Substitution& subst(it->first);
-			Plan assignedPlan(plan);
+			CNF& remainingPreconditions(it->second);
+			size_t assignedAllocatedVariablesCount = subst.defrag(problemScope.getSize());
+			remainingPreconditions.substitute(subst);
+
+			// create new task network
+			TaskNetwork assignedNetwork(newNetwork);
+			assignedNetwork.substitute(subst);
+
+			// HTN: append a to P
+			Plan assignedPlan(newPlan);
+			assignedPlan.push_back(t);
 			assignedPlan.substitute(subst);
-			success(assignedPlan);
+			timer.lap(SearchCounters::PHASE_COPY);
+
+			// apply effects
+			const State newState = effects.apply(state, subst);
+			timer.lap(SearchCounters::PHASE_APPLY);
+
+			// HTN: T0 ← {t ∈ T : no task in T is constrained to precede t}
+			pushNode(assignedPlan, assignedNetwork, assignedAllocatedVariablesCount, remainingPreconditions, newState, cost, node, ti);
+			timer.skip();
 		}
+	} else {
+		counters.preconditionsFailed();
+		if (tracer)
+			getLocalTrace().fail(tracer->getTime(), node->traceId, ti, head, 0);
+		if (debugStream) *debugStream << "simp. pre failed" << std::endl;
 	}
+}
 
-	// HTN: nondeterministically choose any t ∈ T0
-	for (size_t ti = 0; ti < t0.size(); ++ti)
-	{
-		const Task& t(t0[ti]->task);
-		const Head* head(t.head);
-
-		const Action* action = dynamic_cast<const Action*>(head);
-		if(action != 0) {
-			if (debugStream)
-				*debugStream << "action " << std::endl;
-			// HTN: if t is a primitive task then
-
-			// TODO: HTN: A ← {(a, θ) : a is a ground instance of an operator in D, θ is a substi-
-			// HTN: tution that uniﬁes {head(a), t}, and s satisﬁes a’s preconditions}
-			// HTN: if A = ∅ then return failure
-			// HTN: nondeterministically choose a pair (a, θ) ∈ A
-			// TODO: HTN: modify s by deleting del(a) and adding add(a)
-
-			TaskNetwork newNetwork(network);
-			newNetwork.erase(ti);
-
-			Substitution subst = t.getSubstitution(action->getScope().getSize(), allocatedVariablesCount);
-			size_t newAllocatedVariablesCount = allocatedVariablesCount + action->getScope().getSize() - head->getParamsCount();
-
-			CNF newPreconditions(action->getPrecondition());
-			newPreconditions.substitute(subst);
-			newPreconditions += preconditions;
-
-			if (debugStream) *debugStream << "raw pre:  " << Scope::setScope(problemScope) << newPreconditions << std::endl;
-			OptionalVariables simplificationResult = newPreconditions.simplify(state, problemScope.getSize(), newAllocatedVariablesCount);
-			if (simplificationResult) {
-				if (debugStream) *debugStream << "simp. pre:  " << Scope::setScope(problemScope) << newPreconditions << std::endl;
-
-				Action::Effects effects(action->getEffects());
-				effects.substitute(subst);
-
-				Plan newPlan(plan);
-
-				Substitution simplificationSubst(simplificationResult.get());
-				newAllocatedVariablesCount = simplificationSubst.defrag(problemScope.getSize());
-				newPreconditions.substitute(simplificationSubst);
-				newPlan.substitute(simplificationSubst);
-				newNetwork.substitute(simplificationSubst);
-				effects.substitute(simplificationSubst);
-
-				// discover which variables must be grounded
-
-				// collect all variables and relation affected by the effects
-				VariablesSet affectedVariables;
-				FunctionsSet affectedRelations;
-
-				// first iterate on all effects and get a list of affected functions and variables
-				effects.updateAffectedFunctionsAndVariables(affectedRelations, affectedVariables, problemScope.getSize());
-				
-				// then look into preconditions for all indirectly affected variables
-				for(NormalForm::Literals::const_iterator it = newPreconditions.literals.begin(); it != newPreconditions.literals.end(); ++it) {
-					const NormalForm::Literal& literal(*it);
-					if (affectedRelations.find(literal.function) != affectedRelations.end()) {
-						// the relation of this literal is affected, all its variables must be grounded
-						const Variables params(newPreconditions.getParams(literal));
-						for (Variables::const_iterator kt = params.begin(); kt != params.end(); ++kt) {
-							const Variable& variable = *kt;
-							if(variable.index >= problemScope.getSize())
-								affectedVariables.insert(variable);
-						}
-					}
-				}
-				
-				// ground affected variables
-				Groundings groundings(ground(affectedVariables, newPreconditions, state, newAllocatedVariablesCount));
-
-				// Create new nodes with valid groundings
-				for (Groundings::iterator it = groundings.begin(); it != groundings.end(); ++it) {
-					Substitution& subst(it->first);
-					CNF& remainingPreconditions(it->second);
-					size_t assignedAllocatedVariablesCount = subst.defrag(problemScope.getSize());
-					remainingPreconditions.substitute(subst);
-
-					// create new task network
-					TaskNetwork assignedNetwork(newNetwork);
-					assignedNetwork.substitute(subst);
-
-					// HTN: append a to P
-					Plan assignedPlan(newPlan);
-					assignedPlan.push_back(t);
-					assignedPlan.substitute(subst);
-
-					// apply effects
-					const State newState = effects.apply(state, subst);
-
-					// HTN: T0 ← {t ∈ T : no task in T is constrained to precede t}
-					pushNode(assignedPlan, assignedNetwork, assignedAllocatedVariablesCount, remainingPreconditions, newState, cost);
-				}
-			} else {
-				if (debugStream) *debugStream << "simp. pre failed" << std::endl;
-			}
-		}
+void Planner9::visitAlternative(const SearchNode* node, size_t ti, const Method* method, size_t ai) {
+	const Plan& plan(node->plan);
+	const TaskNetwork& network(node->network);
+	const size_t allocatedVariablesCount(node->allocatedVariablesCount);
+	const CNF& preconditions(node->preconditions);
+	const State& state(node->state);
+	const Cost cost(node->pathCost);
+	const Task& t(network.first[ti]->task);
+	const Head* head(t.head);
+	const Method::Alternative& alternative = method->alternatives[ai];
+
+	SearchCounters& counters(getLocalCounters());
+	SearchCounters::Timer timer(counters);
+	Substitution subst = t.getSubstitution(alternative.scope.getSize(), allocatedVariablesCount);
+	size_t newAllocatedVariablesCount = allocatedVariablesCount + alternative.scope.getSize() - head->getParamsCount();
+
+	if (debugStream) *debugStream << "* alternative " << alternative.name << std::endl;
+	CNF newPreconditions(alternative.precondition);
+	newPreconditions.substitute(subst);
+	newPreconditions += preconditions;
+	if (debugStream) *debugStream << "raw pre:  " << Scope::setScope(problemScope) << newPreconditions << std::endl;
+	timer.lap(SearchCounters::PHASE_COPY);
+	OptionalVariables simplificationResult = newPreconditions.simplify(state, problemScope.getSize(), newAllocatedVariablesCount);
+	timer.lap(SearchCounters::PHASE_SIMPLIFY);
+	if (simplificationResult) {
+		if (debugStream) *debugStream << "simp. pre:  " << Scope::setScope(problemScope) << newPreconditions << std::endl;
+
+		Plan newPlan(plan);
+
+		// HTN: modify T by removing t, adding sub(m), constraining each task
+		// HTN: in sub(m) to precede the tasks that t preceded, and applying θ
+		TaskNetwork decomposition(alternative.tasks);
+		decomposition.substitute(subst);
+		TaskNetwork newNetwork(network);
+		newNetwork.replace(ti, decomposition);
+		
+		Substitution simplificationSubst(simplificationResult.get());
+		newAllocatedVariablesCount = simplificationSubst.defrag(problemScope.getSize());
+		newPreconditions.substitute(simplificationSubst);
+		newPlan.substitute(simplificationSubst);
+		newNetwork.substitute(simplificationSubst);
+
+		Cost newCost = cost + alternative.cost;
+		timer.lap(SearchCounters::PHASE_COPY);
+
+		// HTN: if sub(m) = ∅ then
+		// HTN: T0 ← {t ∈ sub(m) : no task in T is constrained to precede t}
+		// HTN: else T0 ← {t ∈ T : no task in T is constrained to precede t}
+		pushNode(newPlan, newNetwork, newAllocatedVariablesCount, newPreconditions, state, newCost, node, ti, ai);
+	} else {
+		counters.preconditionsFailed();
+		if (tracer)
+			getLocalTrace().fail(tracer->getTime(), node->traceId, ti, head, ai);
+		if (debugStream)
+			*debugStream << "simp. pre failed" << std::endl;
+	}
+}
 
-		// if t is a method then decompose
-		const Method* method = dynamic_cast<const Method*>(head);
-		if (method != 0) {
-			if (debugStream)
-				*debugStream << "method" << std::endl;
-			// HTN: else
-
-			// HTN: M ← {(m, θ) : m is an instance of a method in D, θ uniﬁes {head(m), t},
-			// HTN: 			   pre(m) is true in s, and m and θ are as general as possible}
-			// HTN: if M = ∅ then return failure
-			// HTN: nondeterministically choose a pair (m, θ) ∈ M
-
-			// push all alternatives
-			for (Method::Alternatives::const_iterator altIt = method->alternatives.begin(); altIt != method->alternatives.end(); ++altIt) {
-				const Method::Alternative& alternative = *altIt;
-
-				Substitution subst = t.getSubstitution(alternative.scope.getSize(), allocatedVariablesCount);
-				size_t newAllocatedVariablesCount = allocatedVariablesCount + alternative.scope.getSize() - head->getParamsCount();
-
-				if (debugStream) *debugStream << "* alternative " << alternative.name << std::endl;
-				CNF newPreconditions(alternative.precondition);
-				newPreconditions.substitute(subst);
-				newPreconditions += preconditions;
-				if (debugStream) *debugStream << "raw pre:  " << Scope::setScope(problemScope) << newPreconditions << std::endl;
-				OptionalVariables simplificationResult = newPreconditions.simplify(state, problemScope.getSize(), newAllocatedVariablesCount);
-				if (simplificationResult) {
-					if (debugStream) *debugStream << "simp. pre:  " << Scope::setScope(problemScope) << newPreconditions << std::endl;
-
-					Plan newPlan(plan);
-
-					// HTN: modify T by removing t, adding sub(m), constraining each task
-					// HTN: in sub(m) to precede the tasks that t preceded, and applying θ
-					TaskNetwork decomposition(alternative.tasks);
-					decomposition.substitute(subst);
-					TaskNetwork newNetwork(network);
-					newNetwork.replace(ti, decomposition);
-					
-					Substitution simplificationSubst(simplificationResult.get());
-					newAllocatedVariablesCount = simplificationSubst.defrag(problemScope.getSize());
-					newPreconditions.substitute(simplificationSubst);
-					newPlan.substitute(simplificationSubst);
-					newNetwork.substitute(simplificationSubst);
-
-					Cost newCost = cost + alternative.cost;
-
-					// HTN: if sub(m) = ∅ then
-					// HTN: T0 ← {t ∈ sub(m) : no task in T is constrained to precede t}
-					// HTN: else T0 ← {t ∈ T : no task in T is constrained to precede t}
-					pushNode(newPlan, newNetwork, newAllocatedVariablesCount, newPreconditions, state, newCost);
-				} else {
-					if (debugStream)
-						*debugStream << "simp. pre failed" << std::endl;
-				}
-			}
+void Planner9::pushNode(const Plan& plan, const TaskNetwork& network, size_t freeVariablesCount, const CNF& preconditions, const State& state, const Cost pathPlusAlternativeCost, const SearchNode* parent, size_t taskIndex, size_t alternativeIndex) {
+	SearchCounters& counters(getLocalCounters());
+	counters.nodeGenerated();
+	
+	// the node accounts the time of the cost function, the rest of its construction is a copy
+	const boost::uint64_t costTime(counters.phasesTimes[SearchCounters::PHASE_COST]);
+	SearchCounters::Timer timer(counters);
+	SearchNode* node(new SearchNode(plan, network, freeVariablesCount, preconditions, state, pathPlusAlternativeCost, costFunction, &counters));
+	timer.lap(SearchCounters::PHASE_COPY);
+	boost::uint64_t& copyTime(counters.phasesTimes[SearchCounters::PHASE_COPY]);
+	copyTime -= std::min(copyTime, counters.phasesTimes[SearchCounters::PHASE_COST] - costTime);
+	if (parent)
+		node->lineage = parent->lineage;
+	
+	if (tracer) {
+		SearchTraceBuffer& trace(getLocalTrace());
+		node->traceId = trace.newId();
+		if (parent) {
+			// actions are grounded in the child, while alternatives keep the variables of the parent
+			const Task& task(parent->network.first[taskIndex]->task);
+			const Variables& params(dynamic_cast<const Action*>(task.head) ? plan.back().params : task.params);
+			trace.generate(tracer->getTime(), node->traceId, parent->traceId, taskIndex, task.head, alternativeIndex, params, node->pathCost, node->heuristicCost, plan.size());
+		} else {
+			trace.generate(tracer->getTime(), node->traceId, 0, 0, 0, 0, Variables(), node->pathCost, node->heuristicCost, plan.size());
 		}
 	}
+	
+	pushNode(node);
 }
 
-void Planner9::pushNode(const Plan& plan, const TaskNetwork& network, size_t freeVariablesCount, const CNF& preconditions, const State& state, const Cost pathPlusAlternativeCost) {
-	pushNode(new SearchNode(plan, network, freeVariablesCount, preconditions, state, pathPlusAlternativeCost, costFunction));
+void Planner9::traceExpansion(SearchTraceBuffer& trace, const SearchNode* node) {
+	// nodes that come from elsewhere get an id when expanded
+	if (!node->traceId)
+		node->traceId = trace.newId();
+	boost::uint64_t signature(SearchTracer::signature(node->network, problemScope));
+	signature = SearchTracer::signature(node->preconditions, problemScope, signature);
+	signature = SearchTracer::signature(node->state, problemScope, signature);
+	trace.expand(tracer->getTime(), node->traceId, signature);
 }
 
 
@@ -404,10 +523,16 @@ bool SimplePlanner9::plan(size_t steps) {
 			*debugStream << "- " << *node << std::endl;
 		
 		++iterationCount;
+		counters.sampleFrontier(iterationCount, nodes.size());
 		visitNode(node);
 		
 		delete node;
+		
+		if (tracer && traceBuffer.bytes.size() >= traceFlushSize)
+			tracer->write(traceBuffer);
 	}
+	if (tracer)
+		tracer->write(traceBuffer);
 	
 	if (!plans.empty() || nodes.empty())
 		return false;
@@ -429,6 +554,7 @@ void SimplePlanner9::pushNode(SearchNode* node) {
 	nodes.insert(SearchNodes::value_type(node->getTotalCost(), node));
 }
 
-void SimplePlanner9::success(const Plan& plan) {
+void SimplePlanner9::success(const Plan& plan, Cost cost) {
 	plans.push_back(plan);
+	plansCosts.push_back(cost);
 }
@@ -5,6 +5,8 @@
 #include "plan.hpp"
 #include "logic.hpp"
 #include "domain.hpp"
+#include "counters.hpp"
+#include "trace.hpp"
 #include <iostream>
 #include <limits>
 
@@ -36,38 +38,59 @@ struct Planner9 {
 	struct CostFunction;
 	
 	struct SearchNode: SearchNodeData {
-		SearchNode(const Plan& plan, const TaskNetwork& network, size_t allocatedVariablesCount, const CNF& preconditions, const State& state, const Cost pathPlusAlternativeCost, const CostFunction* costFunction);
+		//! if counters is given, the time spent in costFunction is added to them
+		SearchNode(const Plan& plan, const TaskNetwork& network, size_t allocatedVariablesCount, const CNF& preconditions, const State& state, const Cost pathPlusAlternativeCost, const CostFunction* costFunction, SearchCounters* counters = 0);
 		SearchNode(const Plan& plan, const TaskNetwork& network, size_t allocatedVariablesCount, const CNF& preconditions, const State& state, const Cost pathCost, const Cost heuristicCost);
 		Cost getTotalCost() const { return pathCost + heuristicCost; }
 		friend std::ostream& operator<<(std::ostream& os, const SearchNode& node);
 		
 		const Cost pathCost;
 		const Cost heuristicCost;
+		mutable boost::uint64_t traceId; //!< id of the node in the search trace, 0 until traced
+		mutable boost::uint64_t lineage; //!< id given to the node it descends from when it was received from elsewhere, 0 if none
+	
+	private:
+		Cost computePathCost(const CostFunction* costFunction, const Cost pathPlusAlternativeCost, SearchCounters* counters) const;
+		Cost computeHeuristicCost(const CostFunction* costFunction, SearchCounters* counters) const;
 	};
 	
 	//! functions that return the cost of a node
 	struct CostFunction {
+		virtual ~CostFunction() {}
 		virtual Planner9::Cost getPathCost(const Planner9::SearchNodeData& node, const Cost pathPlusAlternativeCost) const = 0;
 		virtual Planner9::Cost getHeuristicCost(const Planner9::SearchNodeData& node) const = 0;
 		virtual std::string getName() const = 0;
 	};
 	
+	//! record the events of the search to tracer, which must outlive the search
+	void setTracer(SearchTracer* tracer) { this->tracer = tracer; }
+	
 protected:
 	void visitNode(const SearchNode* node);
-	void pushNode(const Plan& plan, const TaskNetwork& network, size_t freeVariablesCount, const CNF& preconditions, const State& state, const Cost pathPlusAlternativeCost);
+	void visitGoal(const SearchNode* node);
+	void visitTask(const SearchNode* node, size_t taskIndex);
+	void visitAction(const SearchNode* node, size_t taskIndex, const Action* action);
+	void visitAlternative(const SearchNode* node, size_t taskIndex, const Method* method, size_t alternativeIndex);
+	//! if parent is given, the node comes from the alternative of its task of the given index
+	void pushNode(const Plan& plan, const TaskNetwork& network, size_t freeVariablesCount, const CNF& preconditions, const State& state, const Cost pathPlusAlternativeCost, const SearchNode* parent = 0, size_t taskIndex = 0, size_t alternativeIndex = 0);
 	virtual void pushNode(SearchNode* node) = 0;
-	virtual void success(const Plan& plan) = 0;
+	//! a plan was found from a goal node of the given cost
+	virtual void success(const Plan& plan, Cost cost) = 0;
+	//! counters of the calling thread
+	virtual SearchCounters& getLocalCounters() = 0;
+	//! trace buffer of the calling thread, used if there is a tracer
+	virtual SearchTraceBuffer& getLocalTrace() = 0;
+	void traceExpansion(SearchTraceBuffer& trace, const SearchNode* node);
 	
-private:
 	typedef std::pair<Substitution, CNF> Grounding;
 	typedef std::vector<Grounding> Groundings;
+	//! all substitutions of variables that satisfy preconditions in state, along with the remaining preconditions
 	Groundings ground(const VariablesSet& variables, const CNF& preconditions, const State& state, size_t allocatedVariablesCount);
-	void visitNode(const Plan& plan, const TaskNetwork& network, size_t freeVariablesCount, const CNF& preconditions, const State& state, Cost cost);
 
-protected:
 	const Scope problemScope;
 	const CostFunction* costFunction;
 	std::ostream*const debugStream;
+	SearchTracer* tracer;
 };
 
 struct SimplePlanner9: Planner9 {
@@ -81,14 +104,26 @@ struct SimplePlanner9: Planner9 {
 	
 	SearchNode* popNode();
 	virtual void pushNode(SearchNode* node);
-	virtual void success(const Plan& plan);
+	virtual void success(const Plan& plan, Cost cost);
+	
+	const SearchCounters& getCounters() const { return counters; }
+
+	static const size_t traceFlushSize = 1 << 20; //!< bytes of events above which they are written to the tracer
 
 	typedef std::multimap<Cost, SearchNode*> SearchNodes;
 	typedef std::vector<Plan> Plans;
+	typedef std::vector<Cost> Costs;
 
 	SearchNodes nodes;
 	Plans plans;
+	Costs plansCosts; //!< cost of every plan of plans
 	size_t iterationCount;
+	SearchCounters counters;
+	SearchTraceBuffer traceBuffer;
+
+protected:
+	virtual SearchCounters& getLocalCounters() { return counters; }
+	virtual SearchTraceBuffer& getLocalTrace() { return traceBuffer; }
 };
 
 #endif // PLANNER9_HPP_
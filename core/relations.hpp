@@ -116,8 +116,9 @@ struct CallFunction: Function<typename boost::function<UserFunction>::result_typ
 	BoostUserFunction userFunction;
 	Lookups lookups;
 
-	CallFunction(const BoostUserFunction& userFunction, Lookups lookups) :
-		Function<ResultType>(boost::units::detail::demangle(typeid(UserFunction).name()), BoostUserFunction::arity, true),
+	//! arity is the total number of parameters of lookups, which may differ from the number of arguments of userFunction
+	CallFunction(const BoostUserFunction& userFunction, Lookups lookups, size_t arity) :
+		Function<ResultType>(boost::units::detail::demangle(typeid(UserFunction).name()), arity, true),
 		userFunction(userFunction),
 		lookups(lookups) {
 	}
@@ -10,7 +10,8 @@
 #include <sstream>
 
 struct AbstractFunction;
-struct Serializer;
+struct BinaryEncoder;
+struct BinaryDecoder;
 
 struct State {
 	struct AbstractFunctionState {
@@ -22,8 +23,8 @@ struct State {
 		
 		virtual void dump(std::ostream& os, bool& first, const std::string& functionName) const = 0;
 		
-		virtual void serialize(Serializer& serializer) const = 0;
-		virtual void deserialize(Serializer& serializer, size_t arity) = 0;		
+		virtual void encode(BinaryEncoder& encoder) const = 0;
+		virtual void decode(BinaryDecoder& decoder, size_t arity) = 0;
 	};
 	
 	template <typename T>
@@ -64,8 +65,8 @@ struct State {
 		
 		// do not call these function unless you implement them;
 		// the weak attribute will prevent a compilation error but will result in a runtime crash.
-		__attribute__ ((weak)) virtual void serialize(Serializer& serializer) const;
-		__attribute__ ((weak)) virtual void deserialize(Serializer& serializer, size_t arity);
+		__attribute__ ((weak)) virtual void encode(BinaryEncoder& encoder) const;
+		__attribute__ ((weak)) virtual void decode(BinaryDecoder& decoder, size_t arity);
 	};
 	
 	typedef std::map<const AbstractFunction*, AbstractFunctionState*> Functions;
@@ -0,0 +1,217 @@
+#include "trace.hpp"
+#include "domain.hpp"
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+
+const char traceMagic[8] = { 'P', '9', 'T', 'R', 'A', 'C', 'E', 1 };
+
+SearchTraceBuffer::SearchTraceBuffer(boost::uint64_t idsBase):
+	nextId(idsBase + 1) {
+}
+
+void SearchTraceBuffer::generate(boost::uint64_t time, boost::uint64_t id, boost::uint64_t parentId, size_t taskIndex, const Head* head, size_t alternativeIndex, const Variables& params, double pathCost, double heuristicCost, size_t planSize) {
+	writeHead(head);
+	bytes.push_back(TRACE_GENERATE);
+	writeUInt(time);
+	writeUInt(id);
+	writeUInt(parentId);
+	writeUInt(taskIndex);
+	writeUInt(boost::uint64_t(size_t(head)));
+	writeUInt(alternativeIndex);
+	writeUInt(params.size());
+	for (Variables::const_iterator it = params.begin(); it != params.end(); ++it)
+		writeUInt(it->index);
+	writeDouble(pathCost);
+	writeDouble(heuristicCost);
+	writeUInt(planSize);
+}
+
+void SearchTraceBuffer::expand(boost::uint64_t time, boost::uint64_t id, boost::uint64_t signature) {
+	bytes.push_back(TRACE_EXPAND);
+	writeUInt(time);
+	writeUInt(id);
+	writeUInt(signature);
+}
+
+void SearchTraceBuffer::goal(boost::uint64_t time, boost::uint64_t id, double cost) {
+	bytes.push_back(TRACE_GOAL);
+	writeUInt(time);
+	writeUInt(id);
+	writeDouble(cost);
+}
+
+void SearchTraceBuffer::prune(boost::uint64_t time, boost::uint64_t id) {
+	bytes.push_back(TRACE_PRUNE);
+	writeUInt(time);
+	writeUInt(id);
+}
+
+void SearchTraceBuffer::fail(boost::uint64_t time, boost::uint64_t parentId, size_t taskIndex, const Head* head, size_t alternativeIndex) {
+	writeHead(head);
+	bytes.push_back(TRACE_FAIL);
+	writeUInt(time);
+	writeUInt(parentId);
+	writeUInt(taskIndex);
+	writeUInt(boost::uint64_t(size_t(head)));
+	writeUInt(alternativeIndex);
+}
+
+void SearchTraceBuffer::writeUInt(boost::uint64_t value) {
+	while (value >= 0x80) {
+		bytes.push_back((unsigned char)(value | 0x80));
+		value >>= 7;
+	}
+	bytes.push_back((unsigned char)value);
+}
+
+void SearchTraceBuffer::writeDouble(double value) {
+	boost::uint64_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	for (size_t i = 0; i < sizeof(bits); ++i)
+		bytes.push_back((unsigned char)(bits >> (8 * i)));
+}
+
+// heads are described once per buffer, the reader ignores repeated descriptions
+void SearchTraceBuffer::writeHead(const Head* head) {
+	if (!head || !heads.insert(head).second)
+		return;
+	bytes.push_back(TRACE_HEAD);
+	writeUInt(boost::uint64_t(size_t(head)));
+	bytes.push_back(dynamic_cast<const Action*>(head) != 0);
+	writeUInt(head->name.size());
+	bytes.insert(bytes.end(), head->name.begin(), head->name.end());
+}
+
+SearchTracer::SearchTracer(std::ostream& stream):
+	stream(stream),
+	startTime(boost::posix_time::microsec_clock::universal_time()) {
+	stream.write(traceMagic, sizeof(traceMagic));
+}
+
+boost::uint64_t SearchTracer::getTime() const {
+	const boost::posix_time::ptime time(boost::posix_time::microsec_clock::universal_time());
+	if (time < startTime)
+		return 0;
+	return (time - startTime).total_microseconds();
+}
+
+void SearchTracer::write(SearchTraceBuffer& buffer) {
+	if (!buffer.bytes.empty())
+		stream.write(reinterpret_cast<const char*>(&buffer.bytes[0]), buffer.bytes.size());
+	buffer.bytes.clear();
+}
+
+// FNV-1a
+boost::uint64_t SearchTracer::hashText(const std::string& text, boost::uint64_t hash) {
+	const boost::uint64_t prime(1099511628211ULL);
+	for (std::string::const_iterator it = text.begin(); it != text.end(); ++it)
+		hash = (hash ^ (unsigned char)*it) * prime;
+	return hash;
+}
+
+SearchTraceReader::SearchTraceReader(std::istream& stream):
+	stream(stream) {
+	char magic[sizeof(traceMagic)];
+	if (!stream.read(magic, sizeof(magic)) || std::memcmp(magic, traceMagic, sizeof(magic)) != 0)
+		throw std::runtime_error("Not a search trace, or of another version");
+}
+
+bool SearchTraceReader::read(Event& event) {
+	const int type(stream.get());
+	if (type == std::char_traits<char>::eof())
+		return false;
+	event.type = TraceEventType(type);
+	switch (event.type) {
+		case TRACE_HEAD: {
+			event.headId = readUInt();
+			event.isAction = readByte() != 0;
+			readText(event.name);
+		} break;
+		
+		case TRACE_GENERATE: {
+			event.time = readUInt();
+			event.id = readUInt();
+			event.parentId = readUInt();
+			event.taskIndex = readUInt();
+			event.headId = readUInt();
+			event.alternativeIndex = readUInt();
+			// the count comes from the file, a corrupt one must fail as truncated before exhausting memory
+			event.params.clear();
+			for (boost::uint64_t count = readUInt(); count > 0; --count)
+				event.params.push_back(readUInt());
+			event.pathCost = readDouble();
+			event.heuristicCost = readDouble();
+			event.planSize = readUInt();
+		} break;
+		
+		case TRACE_EXPAND: {
+			event.time = readUInt();
+			event.id = readUInt();
+			event.signature = readUInt();
+		} break;
+		
+		case TRACE_GOAL: {
+			event.time = readUInt();
+			event.id = readUInt();
+			event.cost = readDouble();
+		} break;
+		
+		case TRACE_PRUNE: {
+			event.time = readUInt();
+			event.id = readUInt();
+		} break;
+		
+		case TRACE_FAIL: {
+			event.time = readUInt();
+			event.parentId = readUInt();
+			event.taskIndex = readUInt();
+			event.headId = readUInt();
+			event.alternativeIndex = readUInt();
+		} break;
+		
+		default:
+			throw std::runtime_error("Unknown event in search trace");
+	}
+	return true;
+}
+
+unsigned char SearchTraceReader::readByte() {
+	const int byte(stream.get());
+	if (byte == std::char_traits<char>::eof())
+		throw std::runtime_error("Truncated search trace");
+	return (unsigned char)byte;
+}
+
+boost::uint64_t SearchTraceReader::readUInt() {
+	boost::uint64_t value(0);
+	for (unsigned shift = 0; shift < 64; shift += 7) {
+		const unsigned char byte(readByte());
+		value |= boost::uint64_t(byte & 0x7f) << shift;
+		if (!(byte & 0x80))
+			return value;
+	}
+	throw std::runtime_error("Invalid integer in search trace");
+}
+
+// read by chunks, as the length comes from the file
+void SearchTraceReader::readText(std::string& text) {
+	char chunk[256];
+	text.clear();
+	for (boost::uint64_t left = readUInt(); left > 0;) {
+		const size_t chunkSize(size_t(std::min<boost::uint64_t>(left, sizeof(chunk))));
+		if (!stream.read(chunk, chunkSize))
+			throw std::runtime_error("Truncated search trace");
+		text.append(chunk, chunkSize);
+		left -= chunkSize;
+	}
+}
+
+double SearchTraceReader::readDouble() {
+	boost::uint64_t bits(0);
+	for (size_t i = 0; i < sizeof(bits); ++i)
+		bits |= boost::uint64_t(readByte()) << (8 * i);
+	double value;
+	std::memcpy(&value, &bits, sizeof(value));
+	return value;
+}
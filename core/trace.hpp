@@ -0,0 +1,122 @@
+#ifndef TRACE_HPP_
+#define TRACE_HPP_
+
+#include "variable.hpp"
+#include "scope.hpp"
+#include <boost/cstdint.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <set>
+
+struct Head;
+
+// Binary log of the events of a search, for offline analysis by p9trace.
+// A trace starts with traceMagic, followed by events made of a type byte
+// and fields stored as variable-length integers, doubles as their 8 bytes
+// in little endian. Times are µs since the start of the trace and node ids
+// are unique within a trace, 0 meaning a node whose origin is not traced.
+
+enum TraceEventType {
+	TRACE_HEAD = 1, //!< id, whether it is an action, name: a task head, described before its first use
+	TRACE_GENERATE, //!< time, id, parent id, task index, head id, alternative index, params, path cost, heuristic cost, plan size
+	TRACE_EXPAND, //!< time, id, signature of the network, preconditions and state of the node
+	TRACE_GOAL, //!< time, id, cost: a plan was found from a node
+	TRACE_PRUNE, //!< time, id: a node was dropped because of the cost bound
+	TRACE_FAIL //!< time, parent id, task index, head id, alternative index: preconditions cannot hold
+};
+
+extern const char traceMagic[8];
+
+//! events recorded by one thread, written to the trace in bulk
+struct SearchTraceBuffer {
+	typedef std::vector<unsigned char> Bytes;
+
+	//! ids of the nodes generated by this buffer start after idsBase
+	SearchTraceBuffer(boost::uint64_t idsBase = 0);
+
+	boost::uint64_t newId() { return nextId++; }
+
+	//! params are those of the task in the child for actions, in the parent for alternatives
+	void generate(boost::uint64_t time, boost::uint64_t id, boost::uint64_t parentId, size_t taskIndex, const Head* head, size_t alternativeIndex, const Variables& params, double pathCost, double heuristicCost, size_t planSize);
+	void expand(boost::uint64_t time, boost::uint64_t id, boost::uint64_t signature);
+	void goal(boost::uint64_t time, boost::uint64_t id, double cost);
+	void prune(boost::uint64_t time, boost::uint64_t id);
+	void fail(boost::uint64_t time, boost::uint64_t parentId, size_t taskIndex, const Head* head, size_t alternativeIndex);
+
+	Bytes bytes;
+
+private:
+	void writeUInt(boost::uint64_t value);
+	void writeDouble(double value);
+	void writeHead(const Head* head);
+
+	std::set<const Head*> heads; //!< heads already described by this buffer
+	boost::uint64_t nextId;
+};
+
+//! writes the events of search trace buffers to a stream
+struct SearchTracer {
+	SearchTracer(std::ostream& stream);
+
+	//! µs since the tracer was created
+	boost::uint64_t getTime() const;
+	//! append the events of buffer to the trace and clear it, calls must not be concurrent
+	void write(SearchTraceBuffer& buffer);
+
+	//! hash of the text of an object, with constants named from scope, to recognize nodes expanded more than once
+	template<typename T>
+	static boost::uint64_t signature(const T& t, const Scope& scope, boost::uint64_t hash = 14695981039346656037ULL);
+
+private:
+	static boost::uint64_t hashText(const std::string& text, boost::uint64_t hash);
+
+	std::ostream& stream;
+	const boost::posix_time::ptime startTime;
+};
+
+//! reads the events of a trace
+struct SearchTraceReader {
+	struct Event {
+		TraceEventType type;
+		boost::uint64_t time;
+		boost::uint64_t id;
+		boost::uint64_t parentId;
+		size_t taskIndex;
+		boost::uint64_t headId;
+		size_t alternativeIndex;
+		std::vector<boost::uint64_t> params;
+		double pathCost;
+		double heuristicCost;
+		size_t planSize;
+		boost::uint64_t signature;
+		double cost;
+		bool isAction;
+		std::string name;
+	};
+
+	//! throw std::runtime_error if stream does not start with a trace
+	SearchTraceReader(std::istream& stream);
+
+	//! read the next event, return false at the end of the trace, throw std::runtime_error if it is truncated
+	bool read(Event& event);
+
+private:
+	unsigned char readByte();
+	boost::uint64_t readUInt();
+	void readText(std::string& text);
+	double readDouble();
+
+	std::istream& stream;
+};
+
+template<typename T>
+boost::uint64_t SearchTracer::signature(const T& t, const Scope& scope, boost::uint64_t hash) {
+	std::ostringstream oss;
+	oss << Scope::setScope(scope) << t;
+	return hashText(oss.str(), hash);
+}
+
+#endif // TRACE_HPP_
@@ -1,15 +1,24 @@
 #include "chunked.h"
-#include <QDataStream>
+#include <QtEndian>
 #include <QtDebug>
 #include <cassert>
+#include <cstring>
 
 #include "chunked.moc"
 
 
+//! the size of messages is sent as a big endian qint64, as QDataStream does
+static const int headerSize = sizeof(qint64);
+
 ChunkedDevice::ChunkedDevice(QIODevice* device):
-	QIODevice(device) {
-	readBuffer.open(ReadOnly);
-	writeBuffer.open(WriteOnly);
+	QIODevice(device),
+	receiveBegin(0),
+	receiveEnd(0),
+	messageEnd(-1),
+	sendBuffer(headerSize, 0),
+	sendSize(headerSize),
+	bytesReceived(0),
+	bytesSent(0) {
 
 	connect(device, SIGNAL(readyRead()), SLOT(parentReadyRead()));
 	connect(device, SIGNAL(disconnected()), SIGNAL(disconnected()));
@@ -27,76 +36,117 @@ bool ChunkedDevice::open(OpenMode mode) {
 	return parentDevice()->open(mode);
 }
 
-void ChunkedDevice::parentReadyRead(bool emitReadyRead) {
+void ChunkedDevice::receive() {
 	QIODevice* device = parentDevice();
-	if (readBuffer.isReadable() && readBuffer.atEnd()
-	 && device->bytesAvailable() >= sizeof(qint64)) {
-		QDataStream stream(device);
-		qint64 size;
-		stream >> size;
-		assert(size > 0);
-		readBuffer.buffer().resize(size);
-		readBuffer.close();
-		readBuffer.open(WriteOnly);
-		if (device->bytesAvailable() > 0)
-			parentReadyRead(emitReadyRead);
+	const qint64 available(device->bytesAvailable());
+	if (available <= 0)
+		return;
+	
+	// make room at the end, first by moving the bytes still needed to the front
+	if (receiveBuffer.size() - receiveEnd < available) {
+		if (receiveBegin > 0) {
+			std::memmove(receiveBuffer.data(), receiveBuffer.constData() + receiveBegin, receiveEnd - receiveBegin);
+			receiveEnd -= receiveBegin;
+			if (messageEnd >= 0)
+				messageEnd -= receiveBegin;
+			receiveBegin = 0;
+		}
+		if (receiveBuffer.size() - receiveEnd < available)
+			receiveBuffer.resize(qMax<qint64>(receiveEnd + available, 2 * receiveBuffer.size()));
 	}
-	if (readBuffer.isWritable()) {
-		qint64 bytesToRead = readBuffer.size() - readBuffer.pos();
-		if (bytesToRead > 0) {
-			readBuffer.write(device->read(bytesToRead));
-			if (readBuffer.atEnd()) {
-				readBuffer.close();
-				readBuffer.open(ReadOnly);
-				//qDebug() << "* received message of size " << readBuffer.size() << emitReadyRead;
-				if (emitReadyRead)
-					emit readyRead();
-			}
+	
+	const qint64 read(device->read(receiveBuffer.data() + receiveEnd, available));
+	if (read > 0) {
+		receiveEnd += read;
+		bytesReceived += read;
+	}
+}
+
+bool ChunkedDevice::nextMessage() {
+	assert(messageEnd < 0);
+	
+	// skip empty messages
+	while (receiveEnd - receiveBegin >= headerSize) {
+		const qint64 size(qFromBigEndian<qint64>(reinterpret_cast<const uchar*>(receiveBuffer.constData() + receiveBegin)));
+		if (receiveEnd - receiveBegin - headerSize < size)
+			return false;
+		receiveBegin += headerSize;
+		if (size > 0) {
+			messageEnd = receiveBegin + size;
+			return true;
 		}
 	}
+	return false;
+}
+
+void ChunkedDevice::consume(qint64 size) {
+	receiveBegin += size;
+	if (receiveBegin == messageEnd) {
+		messageEnd = -1;
+		if (receiveBegin == receiveEnd)
+			receiveBegin = receiveEnd = 0;
+		// make the next message available to the reading loop, without signaling it
+		if (parentDevice()->bytesAvailable() > 0)
+			receive();
+		nextMessage();
+	}
+}
+
+void ChunkedDevice::parentReadyRead(bool emitReadyRead) {
+	receive();
+	if (messageEnd < 0 && nextMessage()) {
+		//qDebug() << "* received message of size " << messageEnd - receiveBegin << emitReadyRead;
+		if (emitReadyRead)
+			emit readyRead();
+	}
 }
 
 qint64 ChunkedDevice::readData(char* data, qint64 maxSize) {
 	//qDebug() << "ChunkedDevice::readData" << this;
-	if (readBuffer.isReadable()) {
-		//qDebug() << "* read stat" << readBuffer.pos() << readBuffer.size();
-		qint64 read = readBuffer.read(data, maxSize);
-		//qDebug() << "* read" << read << maxSize << readBuffer.pos();
-		if (parentDevice()->bytesAvailable() > 0)
-			parentReadyRead(false);
-		return read;
-	} else {
+	if (messageEnd < 0)
 		return -1;
+	
+	const qint64 read(qMin<qint64>(maxSize, messageEnd - receiveBegin));
+	std::memcpy(data, receiveBuffer.constData() + receiveBegin, read);
+	consume(read);
+	return read;
+}
+
+const char* ChunkedDevice::readInPlace(qint64 size) {
+	if (messageEnd < 0 || messageEnd - receiveBegin < size)
+		return 0;
+	
+	// only look for the next message in the bytes already received, so that the returned bytes stay in place
+	const char* data(receiveBuffer.constData() + receiveBegin);
+	receiveBegin += size;
+	if (receiveBegin == messageEnd) {
+		messageEnd = -1;
+		nextMessage();
 	}
+	return data;
 }
 
 qint64 ChunkedDevice::writeData(const char* data, qint64 maxSize) {
-	if (writeBuffer.isWritable()) {
-		qint64 written = writeBuffer.write(data, maxSize);
-		return written;
-	} else {
-		return -1;
-	}
+	if (sendBuffer.size() - sendSize < maxSize)
+		sendBuffer.resize(qMax<qint64>(sendSize + maxSize, 2 * sendBuffer.size()));
+	std::memcpy(sendBuffer.data() + sendSize, data, maxSize);
+	sendSize += maxSize;
+	return maxSize;
 }
 
 bool ChunkedDevice::flush() {
-	if (writeBuffer.isWritable()) {
-		QIODevice* device = parentDevice();
-		QDataStream stream(device);
-		qint64 bytes = writeBuffer.pos();
-		stream << bytes;
-		device->write(writeBuffer.buffer().data(), bytes);
-		//qDebug() << "* sending message of size " << writeBuffer.size();
-		emit bytesWritten(sizeof(qint64) + bytes);
-		writeBuffer.reset();
-		return true;
-	} else {
-		return false;
-	}
+	// fill the room reserved for the header and send everything at once
+	const qint64 bytes(sendSize - headerSize);
+	qToBigEndian<qint64>(bytes, reinterpret_cast<uchar*>(sendBuffer.data()));
+	parentDevice()->write(sendBuffer.constData(), sendSize);
+	//qDebug() << "* sending message of size " << bytes;
+	emit bytesWritten(sendSize);
+	bytesSent += sendSize;
+	sendSize = headerSize;
+	return true;
 }
 
 bool ChunkedDevice::isMessage() const {
 	//qDebug() << "ChunkedDevice::isMessage" << this;
-	//qDebug() << "* ismsg" << readBuffer.isReadable() << readBuffer.pos() << readBuffer.size();
-	return (readBuffer.isReadable() && !readBuffer.atEnd());
+	return messageEnd >= 0 && receiveBegin < messageEnd;
 }
@@ -2,9 +2,17 @@
 #define CHUNKED_H_
 
 
-#include <QBuffer>
+#include <QIODevice>
+#include <QByteArray>
 
 
+//! splits the byte stream of a device into messages prefixed by their size
+/*!
+	Received bytes are read straight into a buffer that is reused between
+	messages, and messages can be decoded in place with readInPlace().
+	Written bytes are appended after room reserved for the header, so that
+	flush() sends header and payload with a single write.
+*/
 struct ChunkedDevice: QIODevice {
 
 	Q_OBJECT
@@ -17,6 +25,13 @@ public:
 	qint64 writeData(const char* data, qint64 maxSize);
 	bool flush();
 	bool isMessage() const;
+	//! return the next size bytes of the current message and skip them, or 0 if the message is shorter; valid until the next read
+	const char* readInPlace(qint64 size);
+	//! bytes received from the parent device, including headers, since the counters were cleared
+	quint64 getBytesReceived() const { return bytesReceived; }
+	//! bytes sent to the parent device, including headers, since the counters were cleared
+	quint64 getBytesSent() const { return bytesSent; }
+	void clearByteCounters() { bytesReceived = bytesSent = 0; }
 	
 signals:
 	void disconnected();
@@ -25,8 +40,18 @@ protected slots:
 	void parentReadyRead(bool emitReadyRead = true);
 
 private:
-	QBuffer readBuffer;
-	QBuffer writeBuffer;
+	void receive();
+	bool nextMessage();
+	void consume(qint64 size);
+
+	QByteArray receiveBuffer; //!< reused storage for received bytes
+	int receiveBegin; //!< first byte not consumed yet
+	int receiveEnd; //!< end of received bytes
+	int messageEnd; //!< end of the current message, or -1 if there is none
+	QByteArray sendBuffer; //!< header followed by the payload of the message being written
+	int sendSize; //!< bytes of sendBuffer in use, including the header
+	quint64 bytesReceived;
+	quint64 bytesSent;
 };
 
 
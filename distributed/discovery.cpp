@@ -0,0 +1,118 @@
+#include "discovery.h"
+#include "avahi-server.h"
+#include "avahi-entry-group.h"
+#include "avahi-service-browser.h"
+#include <avahi-client/client.h>
+#include <avahi-client/publish.h>
+#include <QFile>
+#include <QTextStream>
+#include <stdexcept>
+
+#include "discovery.moc"
+
+
+SlaveAnnouncer::SlaveAnnouncer(QObject* parent):
+	QObject(parent) {
+}
+
+SlaveFinder::SlaveFinder(QObject* parent):
+	QObject(parent) {
+}
+
+/////
+
+AvahiSlaveAnnouncer::AvahiSlaveAnnouncer(QObject* parent):
+	SlaveAnnouncer(parent),
+	avahiServer(new AvahiServer("org.freedesktop.Avahi", "/", QDBusConnection::systemBus(), this)),
+	avahiEntryGroup(0) {
+}
+
+void AvahiSlaveAnnouncer::announce(quint16 port) {
+	Q_ASSERT(avahiEntryGroup == 0);
+
+	QString serviceName(QString("planner9:%0").arg(port));
+
+	QDBusObjectPath groupPath(avahiServer->EntryGroupNew());
+	avahiEntryGroup = new AvahiEntryGroup("org.freedesktop.Avahi", groupPath.path(), QDBusConnection::systemBus(), this);
+	avahiEntryGroup->AddService(AVAHI_IF_UNSPEC, AVAHI_PROTO_UNSPEC, 0, serviceName, "_planner9._tcp", "", "", port, QList<QByteArray>());
+	avahiEntryGroup->Commit().waitForFinished();
+}
+
+void AvahiSlaveAnnouncer::withdraw() {
+	if (avahiEntryGroup == 0)
+		return;
+	avahiEntryGroup->Free().waitForFinished();
+	avahiEntryGroup->deleteLater();
+	avahiEntryGroup = 0;
+}
+
+/////
+
+AvahiSlaveFinder::AvahiSlaveFinder(QObject* parent):
+	SlaveFinder(parent),
+	avahiServer(new AvahiServer("org.freedesktop.Avahi", "/", QDBusConnection::systemBus(), this)),
+	avahiServiceBrowser(0) {
+}
+
+void AvahiSlaveFinder::start() {
+	Q_ASSERT(avahiServiceBrowser == 0);
+	
+	QDBusObjectPath browserPath(avahiServer->ServiceBrowserNew(AVAHI_IF_UNSPEC, AVAHI_PROTO_UNSPEC, "_planner9._tcp", "", 0));
+	avahiServiceBrowser = new AvahiServiceBrowser("org.freedesktop.Avahi", browserPath.path(), QDBusConnection::systemBus(), this);
+	connect(avahiServiceBrowser,
+		SIGNAL(ItemNew(int, int, const QString &, const QString &, const QString &, uint)),
+		SLOT(serviceFound(int, int, const QString &, const QString &, const QString &, uint))
+	);
+}
+
+void AvahiSlaveFinder::serviceFound(int interface, int protocol, const QString &name, const QString &type, const QString &domain, uint flags) {
+
+	int outProtocol;
+	QString outName;
+	QString outType;
+	QString outDomain;
+	QString outHost;
+	int outAProtocol;
+	QString outAddress;
+	ushort outPort;
+	QList<QByteArray> outTxt;
+	uint outFlags;
+
+	avahiServer->ResolveService(interface, protocol, name, type, domain, AVAHI_PROTO_UNSPEC, 0, outProtocol, outName, outType, outDomain, outHost, outAProtocol, outAddress, outPort, outTxt, outFlags);
+
+	emit slaveFound(outHost, outPort);
+}
+
+/////
+
+StaticSlaveFinder::StaticSlaveFinder(const QStringList& addresses, QObject* parent):
+	SlaveFinder(parent),
+	addresses(addresses) {
+}
+
+StaticSlaveFinder* StaticSlaveFinder::fromFile(const QString& fileName, QObject* parent) {
+	QFile file(fileName);
+	if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+		throw std::runtime_error(QString("Cannot open slaves list %0: %1").arg(fileName).arg(file.errorString()).toStdString());
+	
+	QStringList addresses;
+	QTextStream stream(&file);
+	while (!stream.atEnd()) {
+		const QString line(stream.readLine().trimmed());
+		if (line.isEmpty() || line.startsWith('#'))
+			continue;
+		addresses.append(line);
+	}
+	return new StaticSlaveFinder(addresses, parent);
+}
+
+void StaticSlaveFinder::start() {
+	for (QStringList::const_iterator it = addresses.begin(); it != addresses.end(); ++it) {
+		const int separator(it->lastIndexOf(':'));
+		bool ok(separator > 0);
+		const quint16 port(ok ? it->mid(separator + 1).toUShort(&ok) : 0);
+		if (!ok)
+			throw std::runtime_error(QString("Invalid slave address %0, expected host:port").arg(*it).toStdString());
+		emit slaveFound(it->left(separator), port);
+	}
+}
@@ -0,0 +1,90 @@
+#ifndef DISCOVERY_H_
+#define DISCOVERY_H_
+
+#include <QObject>
+#include <QStringList>
+
+class AvahiServer;
+class AvahiEntryGroup;
+class AvahiServiceBrowser;
+
+//! makes a slave known to masters while it waits for one
+struct SlaveAnnouncer: QObject {
+
+	Q_OBJECT
+
+public:
+	SlaveAnnouncer(QObject* parent = 0);
+	
+	//! the slave accepts a master on port
+	virtual void announce(quint16 port) = 0;
+	//! the slave does not accept masters any more
+	virtual void withdraw() = 0;
+};
+
+//! tells a master where slaves are
+struct SlaveFinder: QObject {
+
+	Q_OBJECT
+
+public:
+	SlaveFinder(QObject* parent = 0);
+	
+	//! begin emitting slaveFound
+	virtual void start() = 0;
+
+signals:
+	void slaveFound(const QString& hostName, quint16 port);
+};
+
+//! publishes slaves as _planner9._tcp services through the Avahi daemon on the system D-Bus
+struct AvahiSlaveAnnouncer: SlaveAnnouncer {
+
+	Q_OBJECT
+
+public:
+	AvahiSlaveAnnouncer(QObject* parent = 0);
+	
+	void announce(quint16 port);
+	void withdraw();
+
+private:
+	AvahiServer* avahiServer;
+	AvahiEntryGroup* avahiEntryGroup;
+};
+
+//! browses _planner9._tcp services through the Avahi daemon on the system D-Bus
+struct AvahiSlaveFinder: SlaveFinder {
+
+	Q_OBJECT
+
+public:
+	AvahiSlaveFinder(QObject* parent = 0);
+	
+	void start();
+
+protected slots:
+	void serviceFound(int interface, int protocol, const QString &name, const QString &type, const QString &domain, uint flags);
+
+private:
+	AvahiServer* avahiServer;
+	AvahiServiceBrowser* avahiServiceBrowser;
+};
+
+//! finds slaves in a fixed list of "host:port" addresses, without any daemon
+struct StaticSlaveFinder: SlaveFinder {
+
+	Q_OBJECT
+
+public:
+	StaticSlaveFinder(const QStringList& addresses, QObject* parent = 0);
+	//! read addresses from a file, one per line, ignoring empty lines and those starting with #
+	static StaticSlaveFinder* fromFile(const QString& fileName, QObject* parent = 0);
+	
+	void start();
+
+private:
+	const QStringList addresses;
+};
+
+#endif // DISCOVERY_H_
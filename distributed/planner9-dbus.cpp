@@ -44,29 +44,95 @@ const QDBusArgument &operator>>(const QDBusArgument &argument, DBusTask &task) {
 	return argument;
 }
 
+DBusMetrics::DBusMetrics():
+	searching(false),
+	elapsedTime(0),
+	bestsMinCost(Planner9::InfiniteCost),
+	bestCost(Planner9::InfiniteCost),
+	nodesTransferred(0),
+	balanceMessages(0),
+	reinjectedNodes(0),
+	masterBytes(0) {
+}
+
+DBusMetrics::DBusMetrics(const SearchProgress& progress):
+	searching(progress.searching),
+	elapsedTime(progress.elapsedTime),
+	bestsMinCost(progress.bestsMinCost),
+	bestCost(progress.bestCost),
+	nodesTransferred(progress.nodesTransferred),
+	balanceMessages(progress.balanceMessages),
+	reinjectedNodes(progress.reinjectedNodes),
+	masterBytes(progress.masterBytes) {
+	for (SearchProgress::Slaves::const_iterator it = progress.slaves.begin(); it != progress.slaves.end(); ++it) {
+		DBusSlaveMetrics slave;
+		slave.address = it->address;
+		slave.bestsMinCost = it->bestsMinCost;
+		slave.frontierSize = it->frontierSize;
+		slave.throughput = it->throughput;
+		slave.masterBytes = it->masterBytes;
+		slaves.push_back(slave);
+	}
+}
+
+QDBusArgument &operator<<(QDBusArgument &argument, const DBusSlaveMetrics &slave) {
+	argument.beginStructure();
+	argument << slave.address << slave.bestsMinCost << slave.frontierSize << slave.throughput << slave.masterBytes;
+	argument.endStructure();
+	return argument;
+}
+
+const QDBusArgument &operator>>(const QDBusArgument &argument, DBusSlaveMetrics &slave) {
+	argument.beginStructure();
+	argument >> slave.address >> slave.bestsMinCost >> slave.frontierSize >> slave.throughput >> slave.masterBytes;
+	argument.endStructure();
+	return argument;
+}
+
+QDBusArgument &operator<<(QDBusArgument &argument, const DBusMetrics &metrics) {
+	argument.beginStructure();
+	argument << metrics.searching << metrics.elapsedTime << metrics.bestsMinCost << metrics.bestCost;
+	argument << metrics.nodesTransferred << metrics.balanceMessages << metrics.reinjectedNodes << metrics.masterBytes;
+	argument << metrics.slaves;
+	argument.endStructure();
+	return argument;
+}
+
+const QDBusArgument &operator>>(const QDBusArgument &argument, DBusMetrics &metrics) {
+	argument.beginStructure();
+	argument >> metrics.searching >> metrics.elapsedTime >> metrics.bestsMinCost >> metrics.bestCost;
+	argument >> metrics.nodesTransferred >> metrics.balanceMessages >> metrics.reinjectedNodes >> metrics.masterBytes;
+	argument >> metrics.slaves;
+	argument.endStructure();
+	return argument;
+}
+
 void MasterAdaptor::registerDBusTypes() {
 	qDBusRegisterMetaType<DBusParams>();
 	qDBusRegisterMetaType<DBusAtom>();
 	qDBusRegisterMetaType<DBusState>();
 	qDBusRegisterMetaType<DBusTask>();
 	qDBusRegisterMetaType<DBusPlan>();
+	qDBusRegisterMetaType<DBusSlaveMetrics>();
+	qDBusRegisterMetaType<DBusSlavesMetrics>();
+	qDBusRegisterMetaType<DBusMetrics>();
 }
 
 MasterAdaptor::MasterAdaptor(MasterPlanner9* master) :
 	QDBusAbstractAdaptor(master),
 	master(master) {
 	
-	connect(master, SIGNAL(planningStarted()), SIGNAL(PlanningStarted()));
-	connect(master, SIGNAL(planningStarted()), SIGNAL(PlanningStarted()));
-	connect(master, SIGNAL(planningSucceded(Plan)), SLOT(emitPlanningSucceeded(Plan)));
-	connect(master, SIGNAL(planningFailed()), SIGNAL(PlanningFailed()));
-	connect(master, SIGNAL(planningFinished(uint)), SIGNAL(PlanningFinished(uint)));
+	connect(master, SIGNAL(planningStarted(quint32)), SIGNAL(PlanningStarted(quint32)));
+	connect(master, SIGNAL(planningSucceded(quint32,Plan)), SLOT(emitPlanningSucceeded(quint32,Plan)));
+	connect(master, SIGNAL(planningFailed(quint32)), SIGNAL(PlanningFailed(quint32)));
+	connect(master, SIGNAL(planningFinished(quint32,uint)), SIGNAL(PlanningFinished(quint32,uint)));
+	connect(master, SIGNAL(planningProgressed(quint32)), SLOT(emitPlanningProgress(quint32)));
 	
 	QDBusConnection::sessionBus().registerObject("/", master);
 	QDBusConnection::sessionBus().registerService("ch.epfl.mobots.Planner9");
 }
 
-void MasterAdaptor::emitPlanningSucceeded(const Plan& plan) {
+void MasterAdaptor::emitPlanningSucceeded(const quint32& session, const Plan& plan) {
 	DBusPlan dbusPlan;
 	
 	for (Plan::const_iterator it = plan.begin(); it != plan.end(); ++it) {
@@ -74,7 +140,11 @@ void MasterAdaptor::emitPlanningSucceeded(const Plan& plan) {
 		dbusPlan.push_back(task);
 	}
 	
-	emit PlanningSucceeded(dbusPlan);
+	emit PlanningSucceeded(session, dbusPlan);
+}
+
+void MasterAdaptor::emitPlanningProgress(const quint32& session) {
+	emit PlanningProgress(session, DBusMetrics(master->getProgress(session)));
 }
 
 static Variables fromDBusParams(const DBusParams& params) {
@@ -86,7 +156,7 @@ static Variables fromDBusParams(const DBusParams& params) {
 	return variables;
 }
 
-void MasterAdaptor::StartPlanning(const QStringList& constants, const DBusState& state, const DBusTask& task) {
+quint32 MasterAdaptor::StartPlanning(const QStringList& constants, const DBusState& state, const DBusTask& task) {
 	// Create scope
 	Scope scope;
 	scope.names.reserve(constants.size());
@@ -118,8 +188,8 @@ void MasterAdaptor::StartPlanning(const QStringList& constants, const DBusState&
 	const Head* head(master->getDomain().getHead(headName.toStdString()));
 	problem.network.first.push_back(new TaskNetwork::Node(Task(head, fromDBusParams(task.params))));
 	
-	// Start planning
-	master->plan(problem);
+	// Start planning, alongside the sessions already running
+	return master->plan(problem);
 }
 
 
@@ -128,3 +198,15 @@ void MasterAdaptor::RestartPlanning()
 	master->replan();
 }
 
+void MasterAdaptor::CancelPlanning(quint32 session)
+{
+	master->cancel(session);
+}
+
+DBusMetrics MasterAdaptor::GetMetrics(quint32 session) {
+	// sessions finished long ago are forgotten
+	if (!master->hasSession(session))
+		return DBusMetrics();
+	return DBusMetrics(master->getProgress(session));
+}
+
@@ -8,6 +8,7 @@ class MasterPlanner9;
 class Plan;
 class Task;
 class Scope;
+struct SearchProgress;
 
 typedef QList<quint16> DBusParams;
 
@@ -27,6 +28,32 @@ struct DBusTask {
 };
 typedef QList<DBusTask> DBusPlan;
 
+//! see SearchProgress::Slave, costs are infinite when there is none
+struct DBusSlaveMetrics {
+	QString address;
+	double bestsMinCost;
+	quint32 frontierSize;
+	double throughput;
+	quint64 masterBytes;
+};
+typedef QList<DBusSlaveMetrics> DBusSlavesMetrics;
+
+//! see SearchProgress, costs are infinite when there is none
+struct DBusMetrics {
+	bool searching;
+	qint32 elapsedTime;
+	double bestsMinCost;
+	double bestCost;
+	quint32 nodesTransferred;
+	quint32 balanceMessages;
+	quint32 reinjectedNodes;
+	quint64 masterBytes;
+	DBusSlavesMetrics slaves;
+	
+	DBusMetrics();
+	DBusMetrics(const SearchProgress& progress);
+};
+
 class MasterAdaptor: public QDBusAbstractAdaptor {
 	
 	Q_OBJECT
@@ -41,17 +68,23 @@ public:
 	MasterAdaptor(MasterPlanner9* master);
 	
 private slots:
-	void emitPlanningSucceeded(const Plan& plan);
+	void emitPlanningSucceeded(const quint32& session, const Plan& plan);
+	void emitPlanningProgress(const quint32& session);
 	
 public slots:
-	Q_NOREPLY void StartPlanning(const QStringList& constants, const DBusState& state, const DBusTask& task);
+	//! return the id of the new session, which all signals about it carry
+	quint32 StartPlanning(const QStringList& constants, const DBusState& state, const DBusTask& task);
 	Q_NOREPLY void RestartPlanning();
+	Q_NOREPLY void CancelPlanning(quint32 session);
+	DBusMetrics GetMetrics(quint32 session);
 
 signals:
-	void PlanningStarted();
-	void PlanningSucceeded(const DBusPlan& plan);
-	void PlanningFailed();
-	void PlanningFinished(const unsigned& totalIterationsCount);
+	void PlanningStarted(quint32 session);
+	void PlanningSucceeded(quint32 session, const DBusPlan& plan);
+	void PlanningFailed(quint32 session);
+	void PlanningFinished(quint32 session, const unsigned& totalIterationsCount);
+	//! emitted periodically while searching, for every running session
+	void PlanningProgress(quint32 session, const DBusMetrics& metrics);
 };
 
 Q_DECLARE_METATYPE(DBusParams)
@@ -59,6 +92,9 @@ Q_DECLARE_METATYPE(DBusAtom)
 Q_DECLARE_METATYPE(DBusState)
 Q_DECLARE_METATYPE(DBusTask)
 Q_DECLARE_METATYPE(DBusPlan)
+Q_DECLARE_METATYPE(DBusSlaveMetrics)
+Q_DECLARE_METATYPE(DBusSlavesMetrics)
+Q_DECLARE_METATYPE(DBusMetrics)
 
 
 
@@ -3,166 +3,291 @@
 #include "../core/planner9.hpp"
 #include "../core/tasks.hpp"
 #include "../core/costs.hpp"
+#include "../core/codec.hpp"
+#include "../threaded/planner9-threaded.hpp"
 #include <boost/cast.hpp>
 #include <QTcpSocket>
-#include "avahi-server.h"
-#include "avahi-entry-group.h"
-#include "avahi-service-browser.h"
-#include <avahi-client/client.h>
-#include <avahi-client/publish.h>
+#include <QTimerEvent>
+#include <QTimer>
+#include <QUuid>
+#include "discovery.h"
 #include <stdexcept>
 
 #include "planner9-distributed.moc"
 
 
-// force the use of specialized versions
-
-template<> void Serializer::write(const Command& cmd);
-template<> void Serializer::write(const Scope& scope);
-template<> void Serializer::write(const Task& task);
-template<> void Serializer::write(const Plan& plan);
-template<> void Serializer::write(const Atom& atom);
-template<> void Serializer::write(const CNF& cnf);
-template<> void Serializer::write(const State& state);
-template<> void Serializer::write(const TaskNetwork& network);
-template<> void Serializer::write(const Planner9::SearchNode& node);
-
-template<> Command Serializer::read();
-template<> Scope Serializer::read();
-template<> Task Serializer::read();
-template<> Plan Serializer::read();
-template<> Atom Serializer::read();
-template<> CNF Serializer::read();
-template<> State Serializer::read();
-template<> TaskNetwork Serializer::read();
-template<> Planner9::SearchNode Serializer::read();
-
-//TODO: tune
-const size_t toBalanceCount = 10;
-const size_t toBalanceRatio = 3;
+//! number of best nodes per slave over which the work is equalized
+const size_t balanceWindow = 64;
+//! fraction of its fair share that a slave must lack before receiving nodes, to avoid oscillations
+const double balanceHysteresis = 0.25;
+//! maximum number of nodes moved by a single transfer
+const size_t maxTransferCount = 256;
+//! period in ms at which the network thread checks the progress of the search
+const int searchCheckPeriod = 5;
+//! time in ms to wait for a connection to another slave, the nodes to send it staying here if it does not answer
+const int peerConnectionTimeout = 1000;
+//! number of nodes per message sent to another slave
+const size_t peerBatchSize = 16;
+//! number of node messages in flight to another slave, before it acknowledges their processing
+const size_t peerInitialCredits = 4;
+//! default period in ms at which the master reports the progress of the search
+const int defaultProgressPeriod = 1000;
+//! number of finished sessions whose statistics the master keeps
+const size_t maxFinishedSessionsCount = 16;
 
 static AlternativesCost alternativesCost;
 
-SlavePlanner9::SlavePlanner9(const Domain& domain, std::ostream* debugStream):
-	timerId(-1),
+//! leases outlive connections, so they are encoded without state dictionary
+static QByteArray encodeLease(const Domain& domain, const Planner9::SearchNode& node) {
+	BinaryEncoder encoder(domain);
+	encoder.write(node);
+	return QByteArray(reinterpret_cast<const char*>(encoder.data()), encoder.size());
+}
+
+static Planner9::SearchNode decodeLease(const Domain& domain, const QByteArray& lease) {
+	BinaryDecoder decoder(domain, reinterpret_cast<const unsigned char*>(lease.constData()), lease.size());
+	return decoder.read<Planner9::SearchNode>();
+}
+
+SearchStatistics::Slave::Slave():
+	iterationCount(0),
+	idleTime(0),
+	peerBytes(0) {
+}
+
+SearchStatistics::SearchStatistics() {
+	clear();
+}
+
+void SearchStatistics::clear() {
+	nodesTransferred = 0;
+	balanceMessages = 0;
+	reinjectedNodes = 0;
+	masterBytes = 0;
+	slaves.clear();
+	counters.clear();
+}
+
+SearchProgress::Slave::Slave():
+	bestsMinCost(Planner9::InfiniteCost),
+	frontierSize(0),
+	throughput(0),
+	masterBytes(0) {
+}
+
+SearchProgress::SearchProgress():
+	searching(false),
+	elapsedTime(0),
+	bestsMinCost(Planner9::InfiniteCost),
+	bestCost(Planner9::InfiniteCost),
+	nodesTransferred(0),
+	balanceMessages(0),
+	reinjectedNodes(0),
+	masterBytes(0) {
+}
+
+SlavePlanner9::Search::Search():
 	planner(0),
-	costFunction(&alternativesCost), // TODO: get cost function from networks
-	device(0),
+	costFunction(0),
+	master(0),
+	reportedPlansCount(0),
+	anytime(false),
+	running(false),
+	busyTime(0),
+	lastSentMinCost(Planner9::InfiniteCost),
+	lastSentIterationCount(0),
+	peerBytes(0),
+	lastOriginId(0),
+	noPlanPending(false) {
+}
+
+SlavePlanner9::Origin::Origin(ChunkedDevice* device, bool peer, quint32 leaseId, size_t remainingCount):
+	device(device),
+	peer(peer),
+	leaseId(leaseId),
+	remainingCount(remainingCount) {
+}
+
+SlavePlanner9::HeldLease::HeldLease(const SearchKey& key):
+	key(key) {
+}
+
+SlavePlanner9::Owed::Owed():
+	transferId(0),
+	count(0) {
+}
+
+SlavePlanner9::Peer::Peer(ChunkedDevice* device, bool connected):
+	device(device),
+	connected(connected),
+	connectionStartTime(QTime::currentTime()),
+	credits(peerInitialCredits),
+	lastLeaseId(0) {
+}
+
+SlavePlanner9::SlavePlanner9(const Domain& domain, std::ostream* debugStream, size_t threadsCount, SlaveAnnouncer* announcer, const QHostAddress& address, quint16 port):
+	timerId(-1),
+	threadPool(threadsCount ? new ThreadPool(threadsCount) : new ThreadPool()),
 	stream(domain),
+	peerStream(domain),
 	debugStream(debugStream),
-	avahiServer(new AvahiServer("org.freedesktop.Avahi", "/", QDBusConnection::systemBus(), this)),
-	avahiEntryGroup(0) {
+	announcer(announcer) {
 
-	tcpServer.setMaxPendingConnections(1);
+	if (announcer)
+		announcer->setParent(this);
 
 	connect(&tcpServer, SIGNAL(newConnection()), SLOT(newConnection()));
+	connect(&peerServer, SIGNAL(newConnection()), SLOT(newPeerConnection()));
 
-	if (!tcpServer.listen()) {
+	if (!tcpServer.listen(address, port)) {
 		throw std::runtime_error(tcpServer.errorString().toStdString());
 	}
+	if (!peerServer.listen(address)) {
+		throw std::runtime_error(peerServer.errorString().toStdString());
+	}
 
-	if (debugStream) *debugStream << "Listening on port " << tcpServer.serverPort() << std::endl;
+	if (debugStream) *debugStream << "Listening on port " << tcpServer.serverPort() << " with " << threadPool->getThreadsCount() << " threads" << std::endl;
 
+	// masters may connect at any time, so the slave stays announced
 	registerService();
 }
 
 SlavePlanner9::~SlavePlanner9() {
 	unregisterService();
+	killPlanners();
+	threadPool.reset();
 }
 
 void SlavePlanner9::newConnection() {
-	Q_ASSERT(device == 0);
-
-	QTcpSocket* socket = tcpServer.nextPendingConnection();
-	Q_ASSERT(socket);
-	tcpServer.close();
-
-	device = new ChunkedDevice(socket);
-	stream.setDevice(device);
-
-	connect(device, SIGNAL(disconnected()), SLOT(disconnected()));
-	connect(device, SIGNAL(readyRead()), SLOT(messageAvailable()));
-
-	if (debugStream) *debugStream << "Connection from " << socket->peerAddress().toString().toStdString() << std::endl;
-
-	unregisterService();
+	while (tcpServer.hasPendingConnections()) {
+		QTcpSocket* socket = tcpServer.nextPendingConnection();
+		ChunkedDevice* device = new ChunkedDevice(socket);
+		masters[device] = 0;
+
+		connect(device, SIGNAL(disconnected()), SLOT(disconnected()));
+		connect(device, SIGNAL(readyRead()), SLOT(messageAvailable()));
+
+		if (debugStream) *debugStream << "Connection from " << socket->peerAddress().toString().toStdString() << std::endl;
+
+		// tell the master where other slaves can send us nodes, and how much work we can take
+		stream.setDevice(device);
+		stream.write(CMD_PEER_PORT);
+		stream.write<quint16>(peerServer.serverPort());
+		stream.write(CMD_SLAVE_CAPACITY);
+		stream.write<quint32>(threadPool->getThreadsCount());
+		stream.write<quint32>(boost::thread::hardware_concurrency());
+		device->flush();
+	}
 }
 
 void SlavePlanner9::disconnected() {
-	stopTimer();
-	killPlanner();
-
-	if (debugStream) *debugStream << "Connection closed"  << std::endl;
-
-	device->deleteLater();
-	device = 0;
-
-	if (!tcpServer.listen()) {
-		throw std::runtime_error(tcpServer.errorString().toStdString());
+	ChunkedDevice* device(boost::polymorphic_downcast<ChunkedDevice*>(sender()));
+	const quint64 masterId(masters.take(device));
+	
+	// the searches of this master are over, those of the others go on
+	const QList<SearchKey> keys(searches.keys());
+	for (QList<SearchKey>::const_iterator it = keys.begin(); it != keys.end(); ++it) {
+		if (it->first == masterId) {
+			cancelPeerTransfers(*it);
+			killPlanner(*it);
+		}
 	}
 
-	if (debugStream) *debugStream << "Listening on port " << tcpServer.serverPort() << std::endl;
+	if (debugStream) *debugStream << "Connection closed"  << std::endl;
 
-	registerService();
+	stream.forgetDevice(device);
+	device->parentDevice()->deleteLater();
 }
 
 void SlavePlanner9::messageAvailable() {
+	ChunkedDevice* device(boost::polymorphic_downcast<ChunkedDevice*>(sender()));
+	MastersMap::iterator masterIt(masters.find(device));
+	if (masterIt == masters.end())
+		return;
+	
 	while (device->isMessage()) {
-		// fetch command from master
+		stream.setDevice(device);
+		// fetch command from master, followed by the session it is about except for its id
 		Command cmd(stream.read<Command>());
+		if (cmd == CMD_MASTER_ID) {
+			masterIt.value() = stream.read<quint64>();
+			continue;
+		}
+		const quint32 session(stream.read<quint32>());
+		const SearchKey key(masterIt.value(), session);
 
-		qDebug() << "\n*" << commandsNames[cmd];
+		qDebug() << "\n*" << commandsNames[cmd] << session;
 
 		switch (cmd) {
 			// new node to insert
 			case CMD_PUSH_NODE: {
-				assert(planner);
+				// nodes of a session that is over are dropped
+				Search* search(getSearch(key));
+				const quint32 leaseId(stream.read<quint32>());
 				const size_t toReceiveCount(stream.read<quint32>());
-				qDebug() << "inserting" << toReceiveCount << "nodes";
-				for (size_t i = 0; i < toReceiveCount; ++i) {
-					SimplePlanner9::SearchNode* node(new SimplePlanner9::SearchNode(stream.read<SimplePlanner9::SearchNode>()));
-					planner->pushNode(node);
+				qDebug() << (search ? "inserting" : "dropping") << toReceiveCount << "nodes";
+				receiveNodes(key, stream, toReceiveCount, Origin(device, false, leaseId, toReceiveCount));
+				if (search) {
+					search->planner->start();
+					runTimer(*search);
 				}
-				runTimer();
 			} break;
 
-			// node to send
-			case CMD_GET_NODE: {
-				if (planner) {
-					stream.write(CMD_PUSH_NODE);
-					const size_t toSendCount(getBestsCount());
-					qDebug() << "Sending" << toSendCount << "nodes on" << planner->nodes.size();
-					stream.write<quint32>(toSendCount);
-					for (size_t i = 0; i < toSendCount; ++i) {
-						const Planner9::SearchNode* node(planner->nodes.begin()->second);
-						stream.write(*node);
-						qDebug() << "cost " << node->getTotalCost() << " - path " << node->pathCost << ", heuristic " << node->heuristicCost;
-						delete node;
-						planner->nodes.erase(planner->nodes.begin());
-						//if (debugStream) *debugStream  << "sending:\n" << *(planner->nodes.begin()->second) << "\ndone" << std::endl;
-					}
-					device->flush();
-				}
+			// nodes to send to another slave
+			case CMD_SEND_NODES: {
+				const quint32 transferId(stream.read<quint32>());
+				const QString hostName(stream.read<QString>());
+				const quint16 port(stream.read<quint16>());
+				const size_t count(stream.read<quint32>());
+				sendNodesToPeer(key, transferId, hostName, port, count);
 			} break;
 
 			// new problem scope
 			case CMD_PROBLEM_SCOPE: {
-				killPlanner();
+				cancelPeerTransfers(key);
 				const Scope scope(stream.read<Scope>());
-				// TODO: get cost function
-				runPlanner(scope);
+				const bool anytime(stream.read<bool>());
+				// nodes are ordered with the cost function of the master, whatever slave expands them
+				const Planner9::CostFunction* costFunction(stream.read<const Planner9::CostFunction*>());
+				runPlanner(key, device, scope, anytime, costFunction);
+			} break;
+
+			// better plan found somewhere
+			case CMD_COST_BOUND: {
+				const Planner9::Cost bound(stream.read<Planner9::Cost>());
+				Search* search(getSearch(key));
+				if (search)
+					search->planner->setCostBound(bound);
 			} break;
 
 			// stop processing
 			case CMD_STOP: {
-				stopTimer();
-				qDebug() << "Stopped after" << planner->iterationCount << "iterations";
-				// acknowledge stop
+				cancelPeerTransfers(key);
+				// acknowledge stop, with empty measures if the session is not known here
+				Search* search(getSearch(key));
 				stream.write(CMD_STOP);
-				stream.write<quint32>(planner->iterationCount);
+				stream.write<quint32>(session);
+				if (search) {
+					stopTimer(*search);
+					search->planner->stop();
+					qDebug() << "Stopped after" << search->planner->getIterationCount() << "iterations";
+					stream.write<quint32>(search->planner->getIterationCount());
+					stream.write<quint32>(getIdleTime(*search));
+					stream.write<quint64>(search->peerBytes);
+					// caches are shared by all sessions, their hits are counted in the first to stop
+					SearchCounters counters(search->planner->getCounters());
+					counters += stream.takeSentStatesCounters();
+					counters += peerStream.takeSentStatesCounters();
+					stream.write(counters);
+				} else {
+					stream.write<quint32>(0);
+					stream.write<quint32>(0);
+					stream.write<quint64>(0);
+					stream.write(SearchCounters());
+				}
 				device->flush();
 				// delete planner
-				killPlanner();
+				killPlanner(key);
 			} break;
 
 			default:
@@ -172,218 +297,731 @@ void SlavePlanner9::messageAvailable() {
 	}
 }
 
-size_t SlavePlanner9::getBestsCount() const {
-	if ((planner == 0) || planner->nodes.empty())
-		return 0;
-	
-	size_t toSendCount = planner->nodes.size() / toBalanceRatio;
-	toSendCount = std::min(toSendCount, toBalanceCount);
-	
-	return toSendCount;
+SlavePlanner9::Search* SlavePlanner9::getSearch(const SearchKey& key) {
+	Searches::iterator it(searches.find(key));
+	return it != searches.end() ? &it.value() : 0;
 }
 
-Planner9::Cost SlavePlanner9::getBestsMinCost() const {
-	if ((planner == 0) || planner->nodes.empty())
-		return Planner9::InfiniteCost;
-	
-	return planner->nodes.begin()->first;
+ChunkedDevice* SlavePlanner9::getMasterDevice(quint64 masterId) const {
+	for (MastersMap::const_iterator it = masters.begin(); it != masters.end(); ++it)
+		if (it.value() == masterId)
+			return it.key();
+	return 0;
 }
 
-Planner9::Cost SlavePlanner9::getBestsMaxCost() const {
-	if ((planner == 0) || planner->nodes.empty())
-		return Planner9::InfiniteCost;
-	
-	const size_t toSendCount(getBestsCount());
-	
-	if (toSendCount == 0)
-		return Planner9::InfiniteCost;
-	
-	SimplePlanner9::SearchNodes::const_iterator nodeIt(planner->nodes.begin());
-	for (size_t i = 1; i < toSendCount; ++i)
-		++nodeIt;
-	
-	return nodeIt->first;
+float SlavePlanner9::getSpareThreads() const {
+	// the searches share the pool
+	size_t runningCount(0);
+	for (Searches::const_iterator it = searches.begin(); it != searches.end(); ++it)
+		if (it.value().running)
+			++runningCount;
+	return float(threadPool->getThreadsCount()) / std::max<size_t>(runningCount, 1);
 }
 
 void SlavePlanner9::timerEvent(QTimerEvent *event) {
-	Q_ASSERT(planner);
-
-	// TODO: improve the performances of this loop by using a thread
-	// and not polling of the event loop
-	// plan for a specified duration
-	const bool cont = planner->plan(1);
+	// the searches run on the pool, this only reports their progress to the masters
+	for (Searches::iterator it = searches.begin(); it != searches.end(); ++it)
+		if (it.value().running)
+			checkSearch(it.key(), it.value());
+}
 
-	if (cont) {
+void SlavePlanner9::checkSearch(const SearchKey& key, Search& search) {
+	ThreadedPlanner9* planner(search.planner);
+	Q_ASSERT(planner);
+	const quint32 session(key.second);
+	retireLineages(key, search);
+	stream.setDevice(search.master);
+
+	// report plans as soon as they are found, in anytime mode the search goes on
+	Plan plan;
+	Planner9::Cost planCost;
+	while (planner->getPlan(search.reportedPlansCount, plan, planCost)) {
+		qDebug() << "\n* plan found of cost" << planCost << "in session" << session;
+		stream.write(CMD_PLAN_FOUND);
+		stream.write<quint32>(session);
+		stream.write(plan);
+		stream.write(planCost);
+		search.master->flush();
+		++search.reportedPlansCount;
+	}
+	
+	if (!planner->isFinished()) {
 		// check for periodical update of cost
 		const QTime currentTime(QTime::currentTime());
-		if (lastSentCostTime.msecsTo(currentTime) > 30) {
-			const Planner9::Cost currentMinCost(getBestsMinCost());
-			const Planner9::Cost currentMaxCost(getBestsMaxCost());
-			if (currentMinCost != lastSentMinCost || currentMaxCost != lastSentMaxCost) {
-				qDebug() << "\n* new current costs" << currentMinCost << currentMaxCost;
+		const int elapsed(search.lastSentCostTime.msecsTo(currentTime));
+		if (elapsed > 30) {
+			const Planner9::Cost currentMinCost(planner->getNodeCost(0));
+			const CostHistogram currentHistogram(planner->getCostHistogram());
+			if (currentMinCost != search.lastSentMinCost || currentHistogram != search.lastSentHistogram) {
+				const size_t iterationCount(planner->getIterationCount());
+				const float throughput((iterationCount - search.lastSentIterationCount) * 1000.f / elapsed);
+				qDebug() << "\n* new current costs" << currentMinCost << throughput << "in session" << session;
 				stream.write(CMD_CURRENT_COST);
+				stream.write<quint32>(session);
 				stream.write(currentMinCost);
-				stream.write(currentMaxCost);
-				device->flush();
+				stream.write(currentHistogram);
+				stream.write(throughput);
+				stream.write(getSpareThreads());
+				search.master->flush();
 				
-				lastSentMinCost = currentMinCost;
-				lastSentMaxCost = currentMaxCost;
-				lastSentCostTime = currentTime;
+				search.lastSentMinCost = currentMinCost;
+				search.lastSentHistogram = currentHistogram;
+				search.lastSentIterationCount = iterationCount;
+				search.lastSentCostTime = currentTime;
 			}
 		}
 	} else {
-		if (planner->plans.empty()) {
-			// no more nodes, report failure
-			qDebug() << "\n* no plan found";
-			stream.write(CMD_NOPLAN_FOUND);
-			device->flush();
-		} else {
-			// report plan
-			qDebug() << "\n* plan found";
-			for (SimplePlanner9::Plans::const_iterator it = planner->plans.begin(); it != planner->plans.end(); ++it) {
-				stream.write(CMD_PLAN_FOUND);
-				stream.write(planner->plans.front());
-				device->flush();
+		if (search.reportedPlansCount == 0 || search.anytime) {
+			if (!planner->isExhausted()) {
+				// nodes were received while the workers were finishing
+				planner->start();
+				return;
 			}
+			// no more nodes below the bound, the subtrees of the leases received are searched
+			qDebug() << "\n* no plan found in session" << session;
+			retireOrigins(key, search);
+			reportNoPlan(key, search);
+		}
+		stopTimer(search);
+	}
+}
+
+void SlavePlanner9::reportNoPlan(const SearchKey& key, Search& search) {
+	// the nodes sent to peers are part of the search of this slave until they retire them
+	search.noPlanPending = isHoldingLeases(key);
+	if (search.noPlanPending)
+		return;
+	stream.setDevice(search.master);
+	stream.write(CMD_NOPLAN_FOUND);
+	stream.write<quint32>(key.second);
+	search.master->flush();
+}
+
+Planner9::Cost SlavePlanner9::receiveNodes(const SearchKey& key, Serializer& source, size_t nodesCount, const Origin& origin) {
+	Search* search(getSearch(key));
+	// the lineage of every node tells which lease to retire once its subtree is searched
+	const quint32 originId(search && nodesCount > 0 ? ++search->lastOriginId : 0);
+	if (originId)
+		search->origins[originId] = origin;
+	Planner9::Cost minCost(Planner9::InfiniteCost);
+	for (size_t i = 0; i < nodesCount; ++i) {
+		Planner9::SearchNode* node(new Planner9::SearchNode(source.read<Planner9::SearchNode>()));
+		if (search) {
+			minCost = std::min(minCost, node->getTotalCost());
+			node->lineage = (boost::uint64_t(originId) << 32) | i;
+			search->planner->pushNode(node);
+		} else
+			delete node;
+	}
+	return minCost;
+}
+
+void SlavePlanner9::retireLineages(const SearchKey& key, Search& search) {
+	const std::vector<boost::uint64_t> lineages(search.planner->takeRetiredLineages());
+	for (std::vector<boost::uint64_t>::const_iterator it = lineages.begin(); it != lineages.end(); ++it) {
+		// origins are forgotten when their holder leaves
+		Origins::iterator originIt(search.origins.find(quint32(*it >> 32)));
+		if (originIt == search.origins.end())
+			continue;
+		if (--originIt.value().remainingCount == 0) {
+			retireLease(key, originIt.value());
+			search.origins.erase(originIt);
+		}
+	}
+}
+
+void SlavePlanner9::retireOrigins(const SearchKey& key, Search& search) {
+	for (Origins::const_iterator it = search.origins.begin(); it != search.origins.end(); ++it)
+		retireLease(key, it.value());
+	search.origins.clear();
+}
+
+void SlavePlanner9::retireLease(const SearchKey& key, const Origin& origin) {
+	if (origin.peer) {
+		peerStream.setDevice(origin.device);
+		peerStream.write(CMD_PEER_RETIRE);
+		peerStream.write<quint32>(origin.leaseId);
+	} else {
+		stream.setDevice(origin.device);
+		stream.write(CMD_LEASE_RETIRED);
+		stream.write<quint32>(key.second);
+		stream.write<quint32>(origin.leaseId);
+	}
+	origin.device->flush();
+}
+
+
+void SlavePlanner9::newPeerConnection() {
+	while (peerServer.hasPendingConnections()) {
+		QTcpSocket* socket(peerServer.nextPendingConnection());
+		ChunkedDevice* peer(new ChunkedDevice(socket));
+		connect(peer, SIGNAL(disconnected()), SLOT(peerDisconnected()));
+		connect(peer, SIGNAL(readyRead()), SLOT(peerMessageAvailable()));
+		
+		if (debugStream) *debugStream << "Peer connection from " << socket->peerAddress().toString().toStdString() << std::endl;
+	}
+}
+
+void SlavePlanner9::peerConnected() {
+	QTcpSocket* socket(boost::polymorphic_downcast<QTcpSocket*>(sender()));
+	for (PeersMap::iterator it = peers.begin(); it != peers.end(); ++it) {
+		if (it.value().device->parentDevice() == socket) {
+			// send the batches queued while connecting
+			it.value().connected = true;
+			sendPeerBatches(it.value());
+			break;
+		}
+	}
+}
+
+void SlavePlanner9::peerConnectionError(QAbstractSocket::SocketError) {
+	QTcpSocket* socket(boost::polymorphic_downcast<QTcpSocket*>(sender()));
+	if (debugStream) *debugStream << "Connection to peer failed: " << socket->errorString().toStdString() << std::endl;
+	ChunkedDevice* peer(socket->findChild<ChunkedDevice*>());
+	if (peer)
+		removePeer(peer);
+}
+
+void SlavePlanner9::checkPeerConnections() {
+	QList<ChunkedDevice*> lates;
+	int nextCheck(peerConnectionTimeout + 1);
+	for (PeersMap::const_iterator it = peers.begin(); it != peers.end(); ++it) {
+		if (it.value().connected)
+			continue;
+		const int remaining(peerConnectionTimeout - it.value().connectionStartTime.msecsTo(QTime::currentTime()));
+		if (remaining <= 0)
+			lates.append(it.value().device);
+		else
+			nextCheck = std::min(nextCheck, remaining);
+	}
+	if (nextCheck <= peerConnectionTimeout)
+		QTimer::singleShot(nextCheck, this, SLOT(checkPeerConnections()));
+	
+	for (QList<ChunkedDevice*>::const_iterator it = lates.begin(); it != lates.end(); ++it) {
+		if (debugStream) *debugStream << "Peer did not answer within " << peerConnectionTimeout << " ms" << std::endl;
+		removePeer(*it);
+	}
+}
+
+void SlavePlanner9::peerDisconnected() {
+	removePeer(boost::polymorphic_downcast<ChunkedDevice*>(sender()));
+}
+
+void SlavePlanner9::removePeer(ChunkedDevice* device) {
+	for (PeersMap::iterator it = peers.begin(); it != peers.end(); ++it) {
+		if (it.value().device == device) {
+			// the masters must not wait for the rest of the transfers, nor for the receipt of the nodes in flight
+			const TransfersMap transfers(it.value().transfers);
+			const HeldLeasesMap leases(it.value().leases);
+			peers.erase(it);
+			for (TransfersMap::const_iterator transferIt = transfers.begin(); transferIt != transfers.end(); ++transferIt)
+				reportFailedTransfer(transferIt.key(), transferIt.value());
+			// the nodes the peer did not retire are searched here again
+			for (HeldLeasesMap::const_iterator leaseIt = leases.begin(); leaseIt != leases.end(); ++leaseIt)
+				reinjectHeldLease(leaseIt.value());
+			break;
+		}
+	}
+	// the leases received from this peer cannot be retired anymore, it searches them again
+	for (Searches::iterator it = searches.begin(); it != searches.end(); ++it) {
+		Origins& origins(it.value().origins);
+		for (Origins::iterator originIt = origins.begin(); originIt != origins.end();) {
+			if (originIt.value().device == device)
+				originIt = origins.erase(originIt);
+			else
+				++originIt;
+		}
+	}
+	// an error may follow a disconnection, or the reverse
+	peerStream.forgetDevice(device);
+	device->parentDevice()->deleteLater();
+}
+
+void SlavePlanner9::peerMessageAvailable() {
+	ChunkedDevice* peer(boost::polymorphic_downcast<ChunkedDevice*>(sender()));
+	
+	while (peer->isMessage()) {
+		// sending batches may have used the stream for another peer
+		peerStream.setDevice(peer);
+		const Command cmd(peerStream.read<Command>());
+		
+		switch (cmd) {
+			// nodes from another slave, for the search of a session of a master
+			case CMD_PEER_NODES: {
+				const quint64 masterId(peerStream.read<quint64>());
+				const quint32 session(peerStream.read<quint32>());
+				const quint32 transferId(peerStream.read<quint32>());
+				const quint32 leaseId(peerStream.read<quint32>());
+				const size_t toReceiveCount(peerStream.read<quint32>());
+				// nodes of a session that is not known here go back to the sender
+				const SearchKey key(masterId, session);
+				Search* search(getSearch(key));
+				qDebug() << (search ? "inserting" : "returning") << toReceiveCount << "nodes from peer";
+				const Planner9::Cost minCost(receiveNodes(key, peerStream, toReceiveCount, Origin(peer, true, leaseId, toReceiveCount)));
+				if (search && toReceiveCount > 0) {
+					search->planner->start();
+					runTimer(*search);
+				}
+				
+				// the master must not take an exhaustion reported before these nodes arrived for the end of the search
+				ChunkedDevice* master(getMasterDevice(masterId));
+				if (master) {
+					stream.setDevice(master);
+					stream.write(CMD_NODES_RECEIVED);
+					stream.write<quint32>(session);
+					stream.write<quint32>(transferId);
+					stream.write<quint32>(toReceiveCount);
+					stream.write(minCost);
+					master->flush();
+				}
+				
+				// the batch is processed, let the sender send another one
+				if (!search) {
+					peerStream.write(CMD_PEER_RETURN);
+					peerStream.write<quint32>(leaseId);
+				}
+				peerStream.write(CMD_PEER_CREDIT);
+				peerStream.write<quint32>(1);
+				peer->flush();
+			} break;
+			
+			// acknowledgement of batches we sent
+			case CMD_PEER_CREDIT: {
+				const size_t credits(peerStream.read<quint32>());
+				Peer* receiver(findPeer(peer));
+				if (receiver) {
+					receiver->credits += credits;
+					sendPeerBatches(*receiver);
+				}
+			} break;
+			
+			// end of the responsibility of the receiver of nodes we sent
+			case CMD_PEER_RETIRE:
+			case CMD_PEER_RETURN: {
+				const quint32 leaseId(peerStream.read<quint32>());
+				Peer* receiver(findPeer(peer));
+				if (!receiver || !receiver->leases.contains(leaseId))
+					break;
+				const HeldLease lease(receiver->leases.take(leaseId));
+				if (cmd == CMD_PEER_RETURN)
+					reinjectHeldLease(lease);
+				// this may have been the last lease the failure of the search waited for
+				Search* search(getSearch(lease.key));
+				if (search && search->noPlanPending)
+					reportNoPlan(lease.key, *search);
+			} break;
+			
+			default:
+				throw std::runtime_error(tr("Unexpected command received from peer: %0").arg(cmd).toStdString());
 		}
-		stopTimer();
 	}
 }
 
+SlavePlanner9::Peer* SlavePlanner9::findPeer(ChunkedDevice* device) {
+	for (PeersMap::iterator it = peers.begin(); it != peers.end(); ++it)
+		if (it.value().device == device)
+			return &it.value();
+	return 0;
+}
 
-void SlavePlanner9::runPlanner(const Scope& scope) {
-	Q_ASSERT(planner == 0);
-	costFunction = &alternativesCost;
-	planner = new SimplePlanner9(scope, costFunction, debugStream);
-	lastSentMinCost = Planner9::InfiniteCost;
-	lastSentMaxCost = Planner9::InfiniteCost;
-	lastSentCostTime = QTime::currentTime();
+void SlavePlanner9::sendNodesToPeer(const SearchKey& key, quint32 transferId, const QString& hostName, quint16 port, size_t count) {
+	Peer& peer(getPeer(hostName, port));
+	Owed& owed(peer.owed[key]);
+	owed.transferId = transferId;
+	owed.count += count;
+	peer.transfers[key] = transferId;
+	sendPeerBatches(peer);
 }
 
-void SlavePlanner9::killPlanner() {
-	if (planner) {
-		delete planner;
-		planner = 0;
-		// TODO: get cost function from networks
-		/*if (costFunction) {
-			delete costFunction;
-			costFunction = 0;
-		}*/
+void SlavePlanner9::sendPeerBatches(Peer& peer) {
+	if (!peer.connected)
+		return;
+	
+	// nodes are popped when sent, so that they are the best ones at that time
+	while (!peer.owed.empty() && peer.credits > 0) {
+		const OwedMap::iterator owedIt(peer.owed.begin());
+		const SearchKey key(owedIt.key());
+		Owed& owed(owedIt.value());
+		const quint32 transferId(owed.transferId);
+		Search* search(getSearch(key));
+		std::vector<Planner9::SearchNode*> toSend;
+		if (search)
+			toSend = search->planner->popNodes(std::min(owed.count, peerBatchSize));
+		if (toSend.empty()) {
+			peer.owed.erase(owedIt);
+			reportSentNodes(key, transferId, 0, Planner9::InfiniteCost, CostHistogram(), 0);
+			continue;
+		}
+		
+		qDebug() << "Sending" << toSend.size() << "nodes to peer";
+		Planner9::Cost minCost(Planner9::InfiniteCost);
+		CostHistogram sentHistogram;
+		const quint64 bytesSent(peer.device->getBytesSent());
+		// leases outlive connections, so they are encoded without state dictionary
+		const quint32 leaseId(++peer.lastLeaseId);
+		HeldLease& lease(peer.leases[leaseId] = HeldLease(key));
+		peerStream.setDevice(peer.device);
+		peerStream.write(CMD_PEER_NODES);
+		peerStream.write<quint64>(key.first);
+		peerStream.write<quint32>(key.second);
+		peerStream.write<quint32>(transferId);
+		peerStream.write<quint32>(leaseId);
+		peerStream.write<quint32>(toSend.size());
+		for (std::vector<Planner9::SearchNode*>::const_iterator it = toSend.begin(); it != toSend.end(); ++it) {
+			const Planner9::SearchNode* node(*it);
+			peerStream.write(*node);
+			lease.nodes.append(encodeLease(stream.domain, *node));
+			minCost = std::min(minCost, node->getTotalCost());
+			sentHistogram.add(node->getTotalCost());
+		}
+		peer.device->flush();
+		search->peerBytes += peer.device->getBytesSent() - bytesSent;
+		
+		--peer.credits;
+		owed.count -= std::min(owed.count, toSend.size());
+		const size_t remainingCount(owed.count);
+		if (remainingCount == 0)
+			peer.owed.erase(owedIt);
+		reportSentNodes(key, transferId, toSend.size(), minCost, sentHistogram, remainingCount);
+		for (std::vector<Planner9::SearchNode*>::const_iterator it = toSend.begin(); it != toSend.end(); ++it)
+			delete *it;
+		// the peer is now responsible for the subtrees of these nodes
+		retireLineages(key, *search);
 	}
 }
 
-void SlavePlanner9::runTimer() {
-	if(timerId == -1) {
-		timerId = startTimer(0);
+void SlavePlanner9::reportSentNodes(const SearchKey& key, quint32 transferId, size_t nodesCount, Planner9::Cost minCost, const CostHistogram& histogram, size_t remainingCount) {
+	ChunkedDevice* device(getMasterDevice(key.first));
+	if (!device)
+		return;
+	stream.setDevice(device);
+	stream.write(CMD_NODES_SENT);
+	stream.write<quint32>(key.second);
+	stream.write<quint32>(transferId);
+	stream.write<quint32>(nodesCount);
+	stream.write(minCost);
+	stream.write(histogram);
+	stream.write<quint32>(remainingCount);
+	device->flush();
+}
+
+void SlavePlanner9::reportFailedTransfer(const SearchKey& key, quint32 transferId) {
+	ChunkedDevice* device(getMasterDevice(key.first));
+	if (!device)
+		return;
+	stream.setDevice(device);
+	stream.write(CMD_TRANSFER_FAILED);
+	stream.write<quint32>(key.second);
+	stream.write<quint32>(transferId);
+	device->flush();
+}
+
+void SlavePlanner9::cancelPeerTransfers(const SearchKey& key) {
+	for (PeersMap::iterator it = peers.begin(); it != peers.end(); ++it) {
+		it.value().owed.remove(key);
+		it.value().transfers.remove(key);
+		HeldLeasesMap& leases(it.value().leases);
+		for (HeldLeasesMap::iterator leaseIt = leases.begin(); leaseIt != leases.end();) {
+			if (leaseIt.value().key == key)
+				leaseIt = leases.erase(leaseIt);
+			else
+				++leaseIt;
+		}
+	}
+}
+
+void SlavePlanner9::reinjectHeldLease(const HeldLease& lease) {
+	Search* search(getSearch(lease.key));
+	if (!search || lease.nodes.empty())
+		return;
+	qDebug() << "Searching again" << lease.nodes.size() << "nodes not retired by peer";
+	for (QList<QByteArray>::const_iterator it = lease.nodes.begin(); it != lease.nodes.end(); ++it)
+		search->planner->pushNode(new Planner9::SearchNode(decodeLease(stream.domain, *it)));
+	search->planner->start();
+	runTimer(*search);
+}
+
+bool SlavePlanner9::isHoldingLeases(const SearchKey& key) const {
+	for (PeersMap::const_iterator it = peers.begin(); it != peers.end(); ++it)
+		for (HeldLeasesMap::const_iterator leaseIt = it.value().leases.begin(); leaseIt != it.value().leases.end(); ++leaseIt)
+			if (leaseIt.value().key == key)
+				return true;
+	return false;
+}
+
+SlavePlanner9::Peer& SlavePlanner9::getPeer(const QString& hostName, quint16 port) {
+	const QString key(QString("%0:%1").arg(hostName).arg(port));
+	PeersMap::iterator it(peers.find(key));
+	if (it != peers.end())
+		return it.value();
+	
+	// this thread keeps serving the masters and the other peers while the connection is established
+	QTcpSocket* socket(new QTcpSocket(this));
+	connect(socket, SIGNAL(connected()), SLOT(peerConnected()));
+	connect(socket, SIGNAL(error(QAbstractSocket::SocketError)), SLOT(peerConnectionError(QAbstractSocket::SocketError)));
+	socket->connectToHost(hostName, port);
+	QTimer::singleShot(peerConnectionTimeout, this, SLOT(checkPeerConnections()));
+	
+	// the peer sends credits back on this connection
+	ChunkedDevice* peer(new ChunkedDevice(socket));
+	connect(peer, SIGNAL(disconnected()), SLOT(peerDisconnected()));
+	connect(peer, SIGNAL(readyRead()), SLOT(peerMessageAvailable()));
+	return peers[key] = Peer(peer, false);
+}
+
+void SlavePlanner9::runPlanner(const SearchKey& key, ChunkedDevice* master, const Scope& scope, bool anytime, const Planner9::CostFunction* costFunction) {
+	killPlanner(key);
+	// all planners share the pool, whatever their master, which runs their slices in turn
+	Search& search(searches[key]);
+	search.costFunction = costFunction;
+	search.master = master;
+	search.planner = new ThreadedPlanner9(scope, *threadPool, threadPool->getThreadsCount(), costFunction, debugStream);
+	search.planner->setAnytime(anytime);
+	search.anytime = anytime;
+	search.lastSentCostTime = QTime::currentTime();
+	search.startTime = search.lastSentCostTime;
+}
+
+void SlavePlanner9::killPlanner(const SearchKey& key) {
+	Searches::iterator it(searches.find(key));
+	if (it == searches.end())
+		return;
+	stopTimer(it.value());
+	// waits for the workers to leave the search
+	delete it.value().planner;
+	delete it.value().costFunction;
+	searches.erase(it);
+}
+
+void SlavePlanner9::killPlanners() {
+	while (!searches.empty())
+		killPlanner(searches.begin().key());
+}
+
+void SlavePlanner9::runTimer(Search& search) {
+	// the search has new nodes, its exhaustion is reported anew
+	search.noPlanPending = false;
+	if (!search.running) {
+		search.running = true;
+		search.busyStartTime = QTime::currentTime();
 	}
+	if (timerId == -1)
+		timerId = startTimer(searchCheckPeriod);
 }
 
-void SlavePlanner9::stopTimer() {
+void SlavePlanner9::stopTimer(Search& search) {
+	if (search.running) {
+		search.running = false;
+		search.busyTime += search.busyStartTime.msecsTo(QTime::currentTime());
+	}
+	for (Searches::const_iterator it = searches.begin(); it != searches.end(); ++it)
+		if (it.value().running)
+			return;
 	if (timerId != -1) {
 		killTimer(timerId);
 		timerId = -1;
 	}
 }
 
-void SlavePlanner9::registerService() {
-	Q_ASSERT(avahiEntryGroup == 0);
-
-	QString serviceName(QString("planner9:%0").arg(tcpServer.serverPort()));
+unsigned SlavePlanner9::getIdleTime(const Search& search) const {
+	const int elapsed(search.startTime.msecsTo(QTime::currentTime()));
+	return std::max(elapsed - search.busyTime, 0);
+}
 
-	QDBusObjectPath groupPath(avahiServer->EntryGroupNew());
-	avahiEntryGroup = new AvahiEntryGroup("org.freedesktop.Avahi", groupPath.path(), QDBusConnection::systemBus(), this);
-	avahiEntryGroup->AddService(AVAHI_IF_UNSPEC, AVAHI_PROTO_UNSPEC, 0, serviceName, "_planner9._tcp", "", "", tcpServer.serverPort(), QList<QByteArray>());
-	avahiEntryGroup->Commit().waitForFinished();
+void SlavePlanner9::registerService() {
+	if (announcer)
+		announcer->announce(tcpServer.serverPort());
 }
 
 void SlavePlanner9::unregisterService() {
-	assert(avahiEntryGroup != 0);
-	avahiEntryGroup->Free().waitForFinished();
-	avahiEntryGroup->deleteLater();
-	avahiEntryGroup = 0;
+	if (announcer)
+		announcer->withdraw();
 }
 
 /////
 
 MasterPlanner9::Client::Client() :
 	device(0),
-	bestsMinCost(Planner9::InfiniteCost),
-	bestsMaxCost(Planner9::InfiniteCost),
-	nodeRequested(false) {
+	peerPort(0),
+	threadsCount(0),
+	coresCount(0) {
 }
 
 MasterPlanner9::Client::Client(ChunkedDevice* device) :
 	device(device),
+	peerPort(0),
+	threadsCount(0),
+	coresCount(0) {
+}
+
+double MasterPlanner9::Client::getWeight() const {
+	// threads beyond the cores do not run in parallel
+	const unsigned parallelCount(coresCount ? std::min(threadsCount, coresCount) : threadsCount);
+	return std::max(parallelCount, 1u);
+}
+
+MasterPlanner9::Share::Share(quint64 startBytes) :
 	bestsMinCost(Planner9::InfiniteCost),
-	bestsMaxCost(Planner9::InfiniteCost),
-	nodeRequested(false) {
+	throughput(0),
+	spareThreads(0),
+	exhausted(true),
+	nodeRequested(false),
+	startBytes(startBytes) {
 }
 
-MasterPlanner9::MasterPlanner9(const Domain& domain, std::ostream* debugStream):
-	costFunction(&alternativesCost),
-	initialNode(0),
-	stream(domain),
-	stoppingCount(0),
-	newSearch(false),
+MasterPlanner9::Transfer::Transfer(QTcpSocket* source, QTcpSocket* target) :
+	source(source),
+	target(target),
+	sentCount(0),
+	receivedCount(0),
+	sending(true) {
+}
+
+MasterPlanner9::Session::Session(quint32 id, const Problem& problem, Planner9::CostFunction* costFunction, bool anytime) :
+	id(id),
+	problem(problem),
+	costFunction(costFunction ? costFunction : &alternativesCost),
+	initialNode(Plan(), this->problem.network, this->problem.scope.getSize(), CNF(), this->problem.state, 0, this->costFunction),
+	anytime(anytime),
+	lastTransferId(0),
+	lastLeaseId(0),
+	stopped(false),
+	bestCost(Planner9::InfiniteCost),
 	totalIterationCount(0),
+	startTime(QTime::currentTime()) {
+}
+
+MasterPlanner9::MasterPlanner9(const Domain& domain, std::ostream* debugStream, SlaveFinder* finder):
+	id(newId()),
+	lastSessionId(0),
+	stream(domain),
+	anytime(false),
+	progressPeriod(defaultProgressPeriod),
+	progressTimerId(0),
 	debugStream(debugStream),
-	avahiServer(new AvahiServer("org.freedesktop.Avahi", "/", QDBusConnection::systemBus(), this)),
-	avahiServiceBrowser(0) {
+	finder(finder),
+	localSlave(0) {
 
-	QDBusObjectPath browserPath(avahiServer->ServiceBrowserNew(AVAHI_IF_UNSPEC, AVAHI_PROTO_UNSPEC, "_planner9._tcp", "", 0));
-	avahiServiceBrowser = new AvahiServiceBrowser("org.freedesktop.Avahi", browserPath.path(), QDBusConnection::systemBus(), this);
-	connect(avahiServiceBrowser,
-		SIGNAL(ItemNew(int, int, const QString &, const QString &, const QString &, uint)),
-		SLOT(clientDiscovered(int, int, const QString &, const QString &, const QString &, uint))
-	);
+	if (finder) {
+		finder->setParent(this);
+		connect(finder, SIGNAL(slaveFound(const QString&, quint16)), SLOT(slaveFound(const QString&, quint16)));
+		finder->start();
+	}
 }
 
 MasterPlanner9::~MasterPlanner9() {
-	for (ClientsMap::const_iterator it = clients.begin(); it != clients.end(); ++it) {
-		QTcpSocket* client(it.key());
-		client->disconnectFromHost();
-	}
-	if (initialNode)
-		delete initialNode;
+	// disconnecting may remove the client at once
+	const QList<QTcpSocket*> sockets(clients.keys());
+	for (QList<QTcpSocket*>::const_iterator it = sockets.begin(); it != sockets.end(); ++it)
+		(*it)->disconnectFromHost();
+	qDeleteAll(sessions);
+	delete localSlave;
+}
+
+quint64 MasterPlanner9::newId() {
+	// slaves shared by several masters tell their searches apart with this id
+	const QUuid uuid(QUuid::createUuid());
+	const quint64 id((quint64(uuid.data1) << 32) | (quint64(uuid.data2) << 16) | quint64(uuid.data3));
+	return id ? id : 1;
 }
 
 bool MasterPlanner9::connectToSlave(const QString& hostName, quint16 port) {
 	QTcpSocket* client(new QTcpSocket);
-	client->connectToHost(hostName, port);
+	// connect first, connectToHost may fail at once
 	connect(client, SIGNAL(connected()), SLOT(clientConnected()));
 	connect(client, SIGNAL(disconnected()), SLOT(clientDisconnected()));
 	connect(client, SIGNAL(disconnected()), client, SLOT(deleteLater()));
 	connect(client, SIGNAL(error(QAbstractSocket::SocketError)), SLOT(clientConnectionError(QAbstractSocket::SocketError)));
 	connect(client, SIGNAL(error(QAbstractSocket::SocketError)), client, SLOT(deleteLater()));
-	return true;
+	client->connectToHost(hostName, port);
+	return client->state() != QAbstractSocket::UnconnectedState;
+}
+
+void MasterPlanner9::startLocalSearch(size_t threadsCount) {
+	if (localSlave)
+		return;
+	// the local slave listens on all interfaces, for other slaves to send it nodes
+	localSlave = new SlavePlanner9(getDomain(), debugStream, threadsCount, 0, QHostAddress::Any, 0);
+	if (!connectToSlave(QHostAddress(QHostAddress::LocalHost).toString(), localSlave->getPort())) {
+		delete localSlave;
+		localSlave = 0;
+		throw std::runtime_error(tr("Cannot connect to the local slave").toStdString());
+	}
 }
 
-void MasterPlanner9::plan(const Problem& problem, Planner9::CostFunction* costFunction) {
+quint32 MasterPlanner9::plan(const Problem& problem, Planner9::CostFunction* costFunction) {
 	if (debugStream) {
 		*debugStream << Scope::setScope(problem.scope);
 		*debugStream << "initial state: "<< problem.state << std::endl;
 		*debugStream << "initial network: " << problem.network << std::endl;
 	}
 	std::cerr << Scope::setScope(problem.scope);
-	this->problem = problem;
 
-	if (initialNode)
-		delete initialNode;
-	initialNode = new Planner9::SearchNode(Plan(), problem.network, problem.scope.getSize(), CNF(), problem.state, 0, costFunction);
-	this->costFunction = costFunction;
-	
-	replan();
+	// forget the oldest finished sessions
+	while (finishedSessions.size() > int(maxFinishedSessionsCount))
+		delete sessions.take(finishedSessions.takeFirst());
+
+	Session* session(new Session(++lastSessionId, problem, costFunction, anytime));
+	sessions[session->id] = session;
+	emit planningStarted(session->id);
+
+	// every slave searches in every session, the first one starting with the initial node
+	for (ClientsMap::const_iterator it = clients.begin(); it != clients.end(); ++it)
+		joinSession(*session, it.key());
+	updateProgressTimer();
+	return session->id;
+}
+
+void MasterPlanner9::cancel(quint32 session) {
+	Session* runningSession(getRunningSession(session));
+	if (runningSession)
+		stopSession(*runningSession);
 }
 
 void MasterPlanner9::replan() {
-	assert(initialNode);
+	Session* session(sessions.value(lastSessionId, 0));
+	assert(session);
 	
-	newSearch = true;
+	// the slaves search the new session while they stop the former one
+	const Problem problem(session->problem);
+	Planner9::CostFunction* costFunction(session->costFunction);
+	stopSession(*session);
+	plan(problem, costFunction);
+}
 
-	if (isAnyClientSearching())
-		stopClients();
+void MasterPlanner9::setProgressPeriod(int period) {
+	progressPeriod = period;
+	if (progressTimerId) {
+		killTimer(progressTimerId);
+		progressTimerId = 0;
+	}
+	updateProgressTimer();
+}
 
-	startSearchIfReady();
+SearchProgress MasterPlanner9::getProgress(quint32 sessionId) const {
+	const Session& session(*sessions.value(sessionId));
+	SearchProgress progress;
+	progress.searching = !session.stopped && isAnyClientSearching(session);
+	progress.elapsedTime = session.startTime.msecsTo(QTime::currentTime());
+	progress.bestCost = session.bestCost;
+	progress.nodesTransferred = session.statistics.nodesTransferred;
+	progress.balanceMessages = session.statistics.balanceMessages;
+	progress.reinjectedNodes = session.statistics.reinjectedNodes;
+	progress.masterBytes = session.statistics.masterBytes;
+	for (SharesMap::const_iterator it = session.shares.begin(); it != session.shares.end(); ++it) {
+		const Client client(clients.value(it.key()));
+		const Share& share(it.value());
+		SearchProgress::Slave slave;
+		slave.address = QString("%0:%1").arg(client.peerHostName).arg(client.peerPort);
+		slave.bestsMinCost = share.bestsMinCost;
+		slave.frontierSize = share.histogram.getTotalCount();
+		slave.throughput = share.throughput;
+		slave.masterBytes = getBytes(it.key()) - share.startBytes;
+		progress.bestsMinCost = std::min(progress.bestsMinCost, slave.bestsMinCost);
+		progress.masterBytes += slave.masterBytes;
+		progress.slaves.append(slave);
+	}
+	return progress;
 }
 
 
@@ -393,221 +1031,290 @@ void MasterPlanner9::clientConnected() {
 	connect(device, SIGNAL(readyRead()), SLOT(messageAvailable()));
 
 	clients[socket] = Client(device);
+	clients[socket].peerHostName = socket->peerAddress().toString();
 
 	if (debugStream) *debugStream << "New client" << device;
 
-	if (initialNode) {
-		sendScope(device);
-		// TODO: send user cost function... describe which to use in a user-friendly way, enum?
-	
-		if (clients.size() == 1) {
-			if (debugStream) *debugStream << "Sending:\n" << *initialNode << "\ndone" << std::endl;
-			sendInitialNode(device);
-		}
-	}
+	// the slave may serve other masters
+	stream.setDevice(device);
+	stream.write(CMD_MASTER_ID);
+	stream.write<quint64>(id);
+	device->flush();
+
+	// join the running sessions
+	for (SessionsMap::const_iterator it = sessions.begin(); it != sessions.end(); ++it)
+		if (!it.value()->stopped)
+			joinSession(*it.value(), socket);
 }
 
 void MasterPlanner9::clientDisconnected() {
 	QTcpSocket* client(boost::polymorphic_downcast<QTcpSocket*>(sender()));
-	clients.remove(client);
-
-	// TODO: manage disconnection, resend node of this one
-	if (stoppingCount > 0)
-		--stoppingCount;
+	removeClient(client);
 }
 
 void MasterPlanner9::clientConnectionError(QAbstractSocket::SocketError socketError) {
 	QTcpSocket* client(boost::polymorphic_downcast<QTcpSocket*>(sender()));
-	clients.remove(client);
+	removeClient(client);
 
 	// TODO: report the error
 }
 
-void MasterPlanner9::clientDiscovered(int interface, int protocol, const QString &name, const QString &type, const QString &domain, uint flags) {
-
-	int outProtocol;
-	QString outName;
-	QString outType;
-	QString outDomain;
-	QString outHost;
-	int outAProtocol;
-	QString outAddress;
-	ushort outPort;
-	QList<QByteArray> outTxt;
-	uint outFlags;
-
-	avahiServer->ResolveService(interface, protocol, name, type, domain, AVAHI_PROTO_UNSPEC, 0, outProtocol, outName, outType, outDomain, outHost, outAProtocol, outAddress, outPort, outTxt, outFlags);
+void MasterPlanner9::slaveFound(const QString& hostName, quint16 port) {
+	if (debugStream) *debugStream << "Found slave " << hostName.toStdString() << ":" << port << std::endl;
+	if (!connectToSlave(hostName, port) && debugStream)
+		*debugStream << "Cannot connect to slave " << hostName.toStdString() << ":" << port << std::endl;
+}
 
-	connectToSlave(outHost, outPort);
+void MasterPlanner9::timerEvent(QTimerEvent *event) {
+	if (event->timerId() != progressTimerId)
+		return;
+	// receivers may start or stop sessions
+	const QList<quint32> ids(sessions.keys());
+	for (QList<quint32>::const_iterator it = ids.begin(); it != ids.end(); ++it)
+		if (getRunningSession(*it))
+			emit planningProgressed(*it);
 }
 
 void MasterPlanner9::messageAvailable() {
 	ChunkedDevice* device(boost::polymorphic_downcast<ChunkedDevice*>(sender()));
 	QTcpSocket* socket = boost::polymorphic_downcast<QTcpSocket*>(device->parentDevice());
-	Client& client(clients[socket]);
+	ClientsMap::iterator it(clients.find(socket));
+	if (it == clients.end())
+		return;
 
 	while (device->isMessage()) {
-		processMessage(client);
+		processMessage(it.value(), socket);
 	}
 }
 
-void MasterPlanner9::processMessage(Client& client) {
-	// fetch command from client
+void MasterPlanner9::processMessage(Client& client, QTcpSocket* socket) {
+	// fetch command from client, all but the description of the client are about a session
 	//qDebug() << "Cmd pre";
 	stream.setDevice(client.device);
 	Command cmd(stream.read<Command>());
-	qDebug() << "\n*" << QTime::currentTime().toString("hh:mm:ss:zzz") << commandsNames[cmd] << (void*)(client.device);
+	const quint32 sessionId(cmd == CMD_PEER_PORT || cmd == CMD_SLAVE_CAPACITY ? 0 : stream.read<quint32>());
+	qDebug() << "\n*" << QTime::currentTime().toString("hh:mm:ss:zzz") << commandsNames[cmd] << sessionId << (void*)(client.device);
+
+	// messages about sessions that are stopped are read but ignored, except stop acknowledgements
+	Session* session(getRunningSession(sessionId));
+	Share* share(0);
+	if (session) {
+		SharesMap::iterator shareIt(session->shares.find(socket));
+		if (shareIt != session->shares.end())
+			share = &shareIt.value();
+	}
 
 	switch (cmd) {
 		// cost
 		case CMD_CURRENT_COST: {
 			const Planner9::Cost bestsMinCost(stream.read<Planner9::Cost>());
-			const Planner9::Cost bestsMaxCost(stream.read<Planner9::Cost>());
+			const CostHistogram histogram(stream.read<CostHistogram>());
+			const float throughput(stream.read<float>());
+			const float spareThreads(stream.read<float>());
 
 			// ignore if stopping
-			if (stoppingCount > 0)
+			if (!share)
 				return;
 			
-			client.bestsMinCost = bestsMinCost;
-			client.bestsMaxCost = bestsMaxCost;
+			share->bestsMinCost = bestsMinCost;
+			share->histogram = histogram;
+			share->throughput = throughput;
+			share->spareThreads = spareThreads;
+			share->exhausted = false;
 			
 			// do not take action if get node is sent
-			if (client.nodeRequested)
+			if (share->nodeRequested)
 				return;
 			
-			std::cerr << "Cost map: ";
-			for (ClientsMap::const_iterator it = clients.begin(); it != clients.end(); ++it) {
-				std::cerr << it.value().device << ": " << it.value().bestsMinCost << " " << it.value().bestsMaxCost << "\t";
+			std::cerr << "Cost map of session " << sessionId << ": ";
+			for (SharesMap::const_iterator it = session->shares.begin(); it != session->shares.end(); ++it) {
+				std::cerr << it.key() << ": " << it.value().bestsMinCost << " " << it.value().histogram.getTotalCount() << " " << it.value().throughput << "\t";
 			}
 			std::cerr << std::endl;
 
 			// only one client, return
-			if (clients.size() <= 1)
+			if (session->shares.size() <= 1)
 				return;
 
-			// read the clients map to see whether anyone has lower or higher cost
-			bool hasHigher(false);
-			for (ClientsMap::const_iterator it = clients.begin(); it != clients.end(); ++it) {
-				const Planner9::Cost thatBestsMinCost(it.value().bestsMinCost);
-				//const Planner9::Cost thatBestsMaxCost(it.value().bestsMaxCost);
-				if (thatBestsMinCost < bestsMinCost)
-					return; // another has lower cost, we are not optimal, return
-				if (it.value().bestsMinCost > bestsMaxCost)
-					hasHigher = true; // another has higher cost, request some of our bests
-			}
+			balance(*session, socket);
+		} break;
 
-			if (hasHigher) {
-				std::cerr  << "Requesting nodes from " << client.device << std::endl;
-				// we have lowest cost and someone has higher, get some of our best nodes
-				sendGetNode(client.device);
-				client.nodeRequested = true;
-			}
+		// port for peer connections
+		case CMD_PEER_PORT: {
+			client.peerPort = stream.read<quint16>();
 		} break;
 
-		// node
-		case CMD_PUSH_NODE: {
+		// what the client can take, for its share of the work
+		case CMD_SLAVE_CAPACITY: {
+			client.threadsCount = stream.read<quint32>();
+			client.coresCount = stream.read<quint32>();
+			if (debugStream) *debugStream << "Client " << client.device << " has " << client.threadsCount << " threads, " << client.coresCount << " cores" << std::endl;
+		} break;
+
+		// nodes were sent to another client
+		case CMD_NODES_SENT: {
+			const quint32 transferId(stream.read<quint32>());
 			const size_t nodesCount(stream.read<quint32>());
-			std::cerr  << "Receiving " << nodesCount << " nodes" << std::endl;
+			const Planner9::Cost minCost(stream.read<Planner9::Cost>());
+			const CostHistogram sentHistogram(stream.read<CostHistogram>());
+			const size_t remainingCount(stream.read<quint32>());
+			if (debugStream) *debugStream << nodesCount << " nodes sent by " << client.device << ", " << remainingCount << " remaining" << std::endl;
 			
-			// clear get node lock
-			client.nodeRequested = false;
+			// ignore if stopping
+			if (!share)
+				return;
+			session->statistics.nodesTransferred += nodesCount;
 			
-			ClientsMap::iterator highestCostIt(clients.end());
-			ChunkedDevice* destDevice(0);
+			// clear get node lock once the transfer is complete
+			TransfersMap::iterator transferIt(session->transfers.find(transferId));
+			QTcpSocket* target(transferIt != session->transfers.end() ? transferIt.value().target : 0);
+			if (remainingCount == 0)
+				share->nodeRequested = false;
 			
-			// read nodes
-			for (size_t i = 0; i < nodesCount; ++i) {
-				stream.setDevice(client.device);
-				SimplePlanner9::SearchNode node(stream.read<SimplePlanner9::SearchNode>());
-
-				// ignore if stopping
-				if (stoppingCount > 0)
-					continue;
-	
-				// ignore only one client
-				if (clients.size() <= 1)
-					continue;
-
-				// find the client with the worst cost that will receive our nodes
-				if (highestCostIt == clients.end()) {
-					Planner9::Cost highestMinCost(0);
-					Planner9::Cost highestMaxCost(0);
+			// move the nodes in the cost map, as the receiver may not have reported them yet;
+			// the sender leases them to the receiver and searches them again if it leaves
+			share->histogram -= sentHistogram;
+			SharesMap::iterator targetIt(session->shares.find(target));
+			if (targetIt != session->shares.end() && nodesCount > 0) {
+				targetIt.value().bestsMinCost = std::min(minCost, targetIt.value().bestsMinCost);
+				targetIt.value().histogram += sentHistogram;
+			}
 			
-					for (ClientsMap::iterator it = clients.begin(); it != clients.end(); ++it) {
-						const Planner9::Cost minCost(it.value().bestsMinCost);
-						const Planner9::Cost maxCost(it.value().bestsMaxCost);
-						if (minCost > highestMinCost) {
-							highestMinCost = minCost;
-							highestMaxCost = maxCost;
-							highestCostIt = it;
-						}
-						else if (minCost == highestMinCost && maxCost > highestMaxCost) {
-							highestMaxCost = maxCost;
-							highestCostIt = it;
-						}
-					}
-					destDevice = highestCostIt.value().device;
-					std::cerr  << "Load balancing " << client.device << " to " << destDevice <<  std::endl;
-					
-					stream.setDevice(destDevice);
-					stream.write(CMD_PUSH_NODE);
-					stream.write<quint32>(nodesCount);
-				}
-				
-				// send the node to it and update cost
-				if (debugStream) *debugStream  << "sending:\n" << node << "\ndone" << std::endl;
-				
-				stream.setDevice(destDevice);
-				stream.write(node);
-				highestCostIt.value().bestsMinCost = std::min(node.getTotalCost(), highestCostIt.value().bestsMinCost);
+			if (transferIt != session->transfers.end()) {
+				Transfer& transfer(transferIt.value());
+				transfer.sentCount += nodesCount;
+				transfer.sending = remainingCount > 0;
+				if (transfer.isComplete())
+					session->transfers.erase(transferIt);
+			}
+			stopIfExhausted(*session);
+		} break;
+
+		// nodes of a transfer were inserted in the frontier of the client
+		case CMD_NODES_RECEIVED: {
+			const quint32 transferId(stream.read<quint32>());
+			const size_t nodesCount(stream.read<quint32>());
+			const Planner9::Cost minCost(stream.read<Planner9::Cost>());
+			
+			// ignore if stopping
+			if (!share)
+				return;
+			
+			// the client searches again, whatever it reported before receiving the nodes
+			if (minCost != Planner9::InfiniteCost) {
+				share->bestsMinCost = std::min(minCost, share->bestsMinCost);
+				share->exhausted = false;
+			}
+			
+			TransfersMap::iterator transferIt(session->transfers.find(transferId));
+			if (transferIt != session->transfers.end()) {
+				transferIt.value().receivedCount += nodesCount;
+				if (transferIt.value().isComplete())
+					session->transfers.erase(transferIt);
 			}
+			stopIfExhausted(*session);
+		} break;
+
+		// the subtrees of the nodes of a lease are searched, or leased to other clients by this one
+		case CMD_LEASE_RETIRED: {
+			const quint32 leaseId(stream.read<quint32>());
 			
-			if (destDevice)
-				destDevice->flush();
+			// ignore if stopping
+			if (!share)
+				return;
+			
+			share->leases.remove(leaseId);
+		} break;
+
+		// the client cannot reach the target of a transfer anymore
+		case CMD_TRANSFER_FAILED: {
+			const quint32 transferId(stream.read<quint32>());
+			
+			// ignore if stopping
+			if (!share)
+				return;
+			
+			TransfersMap::iterator transferIt(session->transfers.find(transferId));
+			if (transferIt == session->transfers.end())
+				return;
+			if (transferIt.value().sending)
+				share->nodeRequested = false;
+			
+			// the receipts of earlier transfers to the same target may be lost as well
+			QTcpSocket* target(transferIt.value().target);
+			for (TransfersMap::iterator it = session->transfers.begin(); it != session->transfers.end();) {
+				if (it.value().source == socket && it.value().target == target)
+					it = session->transfers.erase(it);
+				else
+					++it;
+			}
+			stopIfExhausted(*session);
 		} break;
 
 		// plan
 		case CMD_PLAN_FOUND: {
 			const Plan plan(stream.read<Plan>());
+			const Planner9::Cost cost(stream.read<Planner9::Cost>());
 
 			// ignore if stopping
-			if (stoppingCount > 0)
+			if (!share)
 				return;
 			
-			stopClients();
-
-			// print the plan
-			emit planningSucceded(plan);
+			if (session->anytime) {
+				if (cost >= session->bestCost)
+					return;
+				
+				// make the new bound known to every client, for them to prune worse nodes
+				session->bestPlan = plan;
+				session->bestCost = cost;
+				for (SharesMap::const_iterator it = session->shares.begin(); it != session->shares.end(); ++it)
+					sendCostBound(*session, clients[it.key()].device);
+				emit planningImproved(sessionId, plan, cost);
+			} else {
+				stopSession(*session);
+
+				// print the plan
+				emit planningSucceded(sessionId, plan);
+			}
 		} break;
 
 		// no plan for this client
 		case CMD_NOPLAN_FOUND: {
 
 			// ignore if stopping
-			if (stoppingCount > 0)
+			if (!share)
 				return;
 
-			client.bestsMinCost = Planner9::InfiniteCost;
-			client.bestsMaxCost = Planner9::InfiniteCost;
+			share->bestsMinCost = Planner9::InfiniteCost;
+			share->histogram.clear();
+			share->exhausted = true;
+			// the subtrees of its leases are fully searched
+			share->leases.clear();
 
-			if (isAnyClientSearching() == false) {
-				// notify failure
-				emit planningFailed();
-				stopClients();
-			}
+			stopIfExhausted(*session);
 		} break;
 
 		// stop acknowledge
 		case CMD_STOP: {
-			client.bestsMinCost = Planner9::InfiniteCost;
-			client.bestsMaxCost = Planner9::InfiniteCost;
+			SearchStatistics::Slave slave;
+			slave.address = QString("%0:%1").arg(client.peerHostName).arg(client.peerPort);
+			slave.iterationCount = stream.read<quint32>();
+			slave.idleTime = stream.read<quint32>();
+			slave.peerBytes = stream.read<quint64>();
+			slave.counters = stream.read<SearchCounters>();
 			
-			totalIterationCount += stream.read<quint32>();
-			stoppingCount--;
-			if (stoppingCount == 0) {
-				emit planningFinished(totalIterationCount);
-			}
-			startSearchIfReady();
+			Session* stoppedSession(sessions.value(sessionId, 0));
+			if (!stoppedSession || !stoppedSession->stopping.remove(socket))
+				return;
+			SearchStatistics& statistics(stoppedSession->statistics);
+			statistics.slaves.append(slave);
+			statistics.counters += slave.counters;
+			statistics.masterBytes += getBytes(socket) - stoppedSession->shares.value(socket).startBytes;
+			stoppedSession->shares.remove(socket);
+			
+			stoppedSession->totalIterationCount += slave.iterationCount;
+			if (stoppedSession->stopping.empty())
+				finishSession(*stoppedSession);
 		} break;
 
 		default:
@@ -616,82 +1323,326 @@ void MasterPlanner9::processMessage(Client& client) {
 	}
 }
 
-void MasterPlanner9::startSearchIfReady() {
-	// ignore if stopping
-	if (stoppingCount > 0)
-		return;
+MasterPlanner9::Session* MasterPlanner9::getRunningSession(quint32 session) {
+	Session* runningSession(sessions.value(session, 0));
+	return runningSession && !runningSession->stopped ? runningSession : 0;
+}
 
-	// do not redo the same search twice
-	if (!newSearch)
+void MasterPlanner9::joinSession(Session& session, QTcpSocket* socket) {
+	const Client& client(clients[socket]);
+	const bool first(session.shares.empty());
+	session.shares[socket] = Share(getBytes(socket));
+	
+	sendScope(session, client.device);
+	if (session.bestCost != Planner9::InfiniteCost)
+		sendCostBound(session, client.device);
+
+	if (!session.orphanLeases.empty()) {
+		// join the running search with the nodes of clients that left it
+		if (debugStream) *debugStream << "Resuming " << session.orphanLeases.size() << " orphan nodes" << std::endl;
+		const Leases leases(session.orphanLeases);
+		session.orphanLeases.clear();
+		sendLeases(session, socket, leases);
+	} else if (first) {
+		if (debugStream) *debugStream << "Sending:\n" << session.initialNode << "\ndone" << std::endl;
+		sendInitialNode(session, socket);
+	}
+}
+
+void MasterPlanner9::stopSession(Session& session) {
+	if (session.stopped)
 		return;
-	newSearch = false;
+	session.stopped = true;
+	session.orphanLeases.clear();
+	session.transfers.clear();
+	
+	// tell all clients to stop searching, and wait until they have acknowledged it
+	for (SharesMap::iterator it = session.shares.begin(); it != session.shares.end(); ++it) {
+		Share& share = it.value();
+		share.bestsMinCost = Planner9::InfiniteCost;
+		share.histogram.clear();
+		share.nodeRequested = false;
+		share.leases.clear();
+		sendStop(session, clients[it.key()].device);
+		session.stopping.insert(it.key());
+	}
+	updateProgressTimer();
 	
-	emit planningStarted();
+	if (session.stopping.empty())
+		finishSession(session);
+}
 
-	// send scope to every client for new planning
-	for (ClientsMap::iterator it = clients.begin(); it != clients.end(); ++it) {
-		Client& client = it.value();
-		sendScope(client.device);
+void MasterPlanner9::finishSession(Session& session) {
+	// the state caches are shared by all sessions, their hits are counted in the first to finish
+	session.statistics.counters += stream.takeSentStatesCounters();
+	session.shares.clear();
+	finishedSessions.append(session.id);
+	emit planningFinished(session.id, session.totalIterationCount);
+}
+
+bool MasterPlanner9::isAnyClientSearching(const Session& session) const {
+	// nodes on their way may make an exhausted client search again, leases wait for a client
+	if (!session.transfers.empty() || !session.orphanLeases.empty())
+		return true;
+	for (SharesMap::const_iterator it = session.shares.begin(); it != session.shares.end(); ++it) {
+		if (!it.value().exhausted) {
+			return true;
+		}
 	}
+	return false;
+}
+
+void MasterPlanner9::stopIfExhausted(Session& session) {
+	if (session.stopped || isAnyClientSearching(session))
+		return;
+	// in anytime mode, the best plan found is now proven optimal
+	if (session.bestCost != Planner9::InfiniteCost)
+		emit planningSucceded(session.id, session.bestPlan);
+	else
+		emit planningFailed(session.id);
+	stopSession(session);
+}
 
-	// if one client is present
-	if (!clients.empty()) {
-		sendInitialNode(clients.begin().value().device);
+void MasterPlanner9::updateProgressTimer() {
+	bool running(false);
+	for (SessionsMap::const_iterator it = sessions.begin(); it != sessions.end(); ++it)
+		running = running || !it.value()->stopped;
+	
+	if (running && progressPeriod > 0) {
+		if (!progressTimerId)
+			progressTimerId = startTimer(progressPeriod);
+	} else if (progressTimerId) {
+		killTimer(progressTimerId);
+		progressTimerId = 0;
 	}
 }
 
-void MasterPlanner9::stopClients() {
-	// tell all clients to stop searching
-	for (ClientsMap::iterator it = clients.begin(); it != clients.end(); ++it) {
-		Client& client = it.value();
-		client.bestsMinCost = Planner9::InfiniteCost;
-		client.bestsMaxCost = Planner9::InfiniteCost;
-		client.nodeRequested = false;
-		sendStop(client.device);
+void MasterPlanner9::balance(Session& session, QTcpSocket* sourceSocket) {
+	Share& source(session.shares[sourceSocket]);
+	
+	// the work that matters is the best nodes of all clients, find the bound of the window containing them
+	CostHistogram merged;
+	double totalThroughput(0);
+	double reportedWeight(0);
+	double unreportedWeight(0);
+	for (SharesMap::const_iterator it = session.shares.begin(); it != session.shares.end(); ++it) {
+		merged += it.value().histogram;
+		if (it.value().throughput > 0) {
+			totalThroughput += it.value().throughput;
+			reportedWeight += getWeight(it.value(), clients.value(it.key()));
+		} else {
+			unreportedWeight += getWeight(it.value(), clients.value(it.key()));
+		}
 	}
+	const size_t windowCount(balanceWindow * session.shares.size());
+	size_t boundBucket(0);
+	size_t totalWork(merged.counts[0]);
+	// nodes not below the cost of the best plan are pruned by slaves
+	const size_t maxBoundBucket(CostHistogram::getBucket(session.bestCost));
+	while (totalWork < windowCount && boundBucket < maxBoundBucket)
+		totalWork += merged.counts[++boundBucket];
+	if (totalWork == 0)
+		return;
+	
+	// the fair share of every client is proportional to its speed, clients that have not reported any
+	// are assumed to be as fast per thread as the average one
+	const double throughputPerWeight(reportedWeight ? totalThroughput / reportedWeight : 1);
+	totalThroughput += throughputPerWeight * unreportedWeight;
+	const double workPerThroughput(totalWork / totalThroughput);
+	
+	const double sourceShare(workPerThroughput * getThroughput(source, clients.value(sourceSocket), throughputPerWeight));
+	const double surplus(double(source.histogram.countUpTo(boundBucket)) - sourceShare);
+	if (surplus < 1)
+		return;
+	
+	// send to the client lacking the most work, which has inserted all the nodes it was sent, like peers wait for credits
+	SharesMap::iterator targetIt(session.shares.end());
+	double targetDeficit(0);
+	for (SharesMap::iterator it = session.shares.begin(); it != session.shares.end(); ++it) {
+		const Share& share(it.value());
+		if (it.key() == sourceSocket || clients.value(it.key()).peerPort == 0 || hasPendingTransfers(session, it.key()))
+			continue;
+		const double fairShare(workPerThroughput * getThroughput(share, clients.value(it.key()), throughputPerWeight));
+		const double deficit(fairShare - double(share.histogram.countUpTo(boundBucket)));
+		if (deficit > targetDeficit && deficit >= balanceHysteresis * fairShare) {
+			targetDeficit = deficit;
+			targetIt = it;
+		}
+	}
+	if (targetIt == session.shares.end())
+		return;
+	
+	const size_t count(std::min(size_t(std::min(surplus, targetDeficit)), maxTransferCount));
+	if (count == 0)
+		return;
+	
+	if (debugStream) *debugStream << "Load balancing " << count << " nodes from " << sourceSocket << " to " << targetIt.key() << " in session " << session.id << std::endl;
+	const quint32 transferId(++session.lastTransferId);
+	session.transfers[transferId] = Transfer(sourceSocket, targetIt.key());
+	sendSendNodes(session, clients[sourceSocket].device, clients[targetIt.key()], transferId, count);
+	source.nodeRequested = true;
+}
+
+double MasterPlanner9::getThroughput(const Share& share, const Client& client, double throughputPerWeight) {
+	return share.throughput > 0 ? share.throughput : throughputPerWeight * getWeight(share, client);
+}
 
-	// wait until all clients have acknowledged the stop
-	stoppingCount = clients.size();
-	totalIterationCount = 0;
+double MasterPlanner9::getWeight(const Share& share, const Client& client) {
+	return share.spareThreads > 0 ? share.spareThreads : client.getWeight();
 }
 
-bool MasterPlanner9::isAnyClientSearching() const {
-	for (ClientsMap::const_iterator it = clients.begin(); it != clients.end(); ++it) {
-		if (it.value().bestsMinCost != Planner9::InfiniteCost) {
+bool MasterPlanner9::hasPendingTransfers(const Session& session, QTcpSocket* socket) const {
+	for (TransfersMap::const_iterator it = session.transfers.begin(); it != session.transfers.end(); ++it)
+		if (it.value().target == socket)
 			return true;
+	return false;
+}
+
+void MasterPlanner9::removeClient(QTcpSocket* socket) {
+	ClientsMap::iterator it(clients.find(socket));
+	if (it == clients.end())
+		return;
+	
+	stream.forgetDevice(it.value().device);
+	clients.erase(it);
+	
+	// receivers of the signals of finished sessions may start or stop sessions
+	const QList<quint32> ids(sessions.keys());
+	for (QList<quint32>::const_iterator idIt = ids.begin(); idIt != ids.end(); ++idIt) {
+		Session* session(sessions.value(*idIt, 0));
+		if (!session)
+			continue;
+		SharesMap::iterator shareIt(session->shares.find(socket));
+		if (shareIt == session->shares.end())
+			continue;
+		Leases leases;
+		for (LeasesMap::const_iterator leaseIt = shareIt.value().leases.begin(); leaseIt != shareIt.value().leases.end(); ++leaseIt)
+			leases += leaseIt.value();
+		session->shares.erase(shareIt);
+		
+		// the transfers to this client are now reported with an unknown target, none will come from it
+		for (TransfersMap::iterator transferIt = session->transfers.begin(); transferIt != session->transfers.end();) {
+			const Transfer& transfer(transferIt.value());
+			if (transfer.source == socket || transfer.target == socket) {
+				// the failure of a transfer still being sent would be ignored, let its source balance again
+				SharesMap::iterator sourceIt(session->shares.find(transfer.source));
+				if (transfer.sending && sourceIt != session->shares.end())
+					sourceIt.value().nodeRequested = false;
+				transferIt = session->transfers.erase(transferIt);
+			} else
+				++transferIt;
 		}
+		
+		if (!session->stopped) {
+			reinjectLeases(*session, leases);
+			stopIfExhausted(*session);
+		} else if (session->stopping.remove(socket) && session->stopping.empty())
+			finishSession(*session);
 	}
-	return false;
 }
 
-void MasterPlanner9::sendGetNode(ChunkedDevice* device) {
+void MasterPlanner9::reinjectLeases(Session& session, const Leases& leases) {
+	if (leases.empty())
+		return;
+	
+	SharesMap::iterator targetIt(getLeastLoadedShare(session));
+	if (targetIt == session.shares.end()) {
+		// wait for a client to join the search
+		session.orphanLeases += leases;
+		return;
+	}
+	
+	session.statistics.reinjectedNodes += leases.size();
+	if (debugStream) *debugStream << "Reinjecting " << leases.size() << " leased nodes into " << targetIt.key() << " in session " << session.id << std::endl;
+	sendLeases(session, targetIt.key(), leases);
+}
+
+MasterPlanner9::SharesMap::iterator MasterPlanner9::getLeastLoadedShare(Session& session) {
+	// the load of a client is relative to the threads it gives to the session
+	SharesMap::iterator bestIt(session.shares.end());
+	double bestLoad(0);
+	for (SharesMap::iterator it = session.shares.begin(); it != session.shares.end(); ++it) {
+		const double load(double(it.value().histogram.getTotalCount()) / getWeight(it.value(), clients.value(it.key())));
+		if (bestIt == session.shares.end() || load < bestLoad) {
+			bestIt = it;
+			bestLoad = load;
+		}
+	}
+	return bestIt;
+}
+
+bool MasterPlanner9::isLoopback(const QHostAddress& address) {
+	return address == QHostAddress::LocalHost || address == QHostAddress::LocalHostIPv6;
+}
+
+quint64 MasterPlanner9::getBytes(QTcpSocket* socket) const {
+	const ChunkedDevice* device(clients.value(socket).device);
+	return device ? device->getBytesReceived() + device->getBytesSent() : 0;
+}
+
+void MasterPlanner9::sendSendNodes(Session& session, ChunkedDevice* device, const Client& target, quint32 transferId, size_t count) {
+	// a remote slave reaches one on the machine of the master, such as the local slave, at the address of the master
+	QString targetHostName(target.peerHostName);
+	const QTcpSocket* socket(boost::polymorphic_downcast<QTcpSocket*>(device->parentDevice()));
+	if (isLoopback(QHostAddress(target.peerHostName)) && !isLoopback(socket->peerAddress()))
+		targetHostName = socket->localAddress().toString();
+	
 	stream.setDevice(device);
-	stream.write(CMD_GET_NODE);
+	stream.write(CMD_SEND_NODES);
+	stream.write<quint32>(session.id);
+	stream.write<quint32>(transferId);
+	stream.write(targetHostName);
+	stream.write<quint16>(target.peerPort);
+	stream.write<quint32>(count);
 	device->flush();
+	++session.statistics.balanceMessages;
 }
 
-void MasterPlanner9::sendScope(ChunkedDevice* device) {
+void MasterPlanner9::sendScope(const Session& session, ChunkedDevice* device) {
 	stream.setDevice(device);
 	stream.write(CMD_PROBLEM_SCOPE);
-	stream.write(problem.scope);
+	stream.write<quint32>(session.id);
+	stream.write(session.problem.scope);
+	stream.write(session.anytime);
+	stream.write<const Planner9::CostFunction*>(session.costFunction);
 	device->flush();
 }
 
-void MasterPlanner9::sendInitialNode(ChunkedDevice* device) {
-	sendNode(device, *initialNode);
+void MasterPlanner9::sendInitialNode(Session& session, QTcpSocket* socket) {
+	sendLeases(session, socket, Leases() << encodeLease(getDomain(), session.initialNode));
 }
 
-void MasterPlanner9::sendNode(ChunkedDevice* device, const SimplePlanner9::SearchNode& node) {
+void MasterPlanner9::sendLeases(Session& session, QTcpSocket* socket, const Leases& leases) {
+	ChunkedDevice* device(clients[socket].device);
+	Share& share(session.shares[socket]);
+	const quint32 leaseId(++session.lastLeaseId);
 	stream.setDevice(device);
 	stream.write(CMD_PUSH_NODE);
-	stream.write<quint32>(1);
-	stream.write(node);
+	stream.write<quint32>(session.id);
+	stream.write<quint32>(leaseId);
+	stream.write<quint32>(leases.size());
+	for (Leases::const_iterator it = leases.begin(); it != leases.end(); ++it) {
+		const Planner9::SearchNode node(decodeLease(getDomain(), *it));
+		stream.write(node);
+		share.bestsMinCost = std::min(share.bestsMinCost, node.getTotalCost());
+		share.histogram.add(node.getTotalCost());
+	}
 	device->flush();
+	share.exhausted = false;
+	share.leases[leaseId] = leases;
 }
 
-void MasterPlanner9::sendStop(ChunkedDevice* device) {
+void MasterPlanner9::sendStop(const Session& session, ChunkedDevice* device) {
 	stream.setDevice(device);
 	stream.write(CMD_STOP);
+	stream.write<quint32>(session.id);
 	device->flush();
 }
 
+void MasterPlanner9::sendCostBound(const Session& session, ChunkedDevice* device) {
+	stream.setDevice(device);
+	stream.write(CMD_COST_BOUND);
+	stream.write<quint32>(session.id);
+	stream.write(session.bestCost);
+	device->flush();
+}
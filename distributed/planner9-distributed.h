@@ -2,129 +2,423 @@
 #define PLANNER9DISTRIBUTED_HPP_
 
 #include <QTcpServer>
+#include <QHostAddress>
 #include <QSet>
+#include <QMap>
+#include <QList>
+#include <QPair>
 #include <QTime>
 #include <fstream>
+#include <boost/scoped_ptr.hpp>
 #include "serializer.hpp"
 #include "chunked.h"
 #include "../core/problem.hpp"
 
 struct Domain;
-class SimplePlanner9;
+class ThreadedPlanner9;
+class ThreadPool;
 class ChunkedDevice;
-class AvahiServer;
-class AvahiEntryGroup;
-class AvahiServiceBrowser;
+class SlaveAnnouncer;
+class SlaveFinder;
+
+//! measures of a session of distributed search, complete when MasterPlanner9::planningFinished is emitted for it
+struct SearchStatistics {
+	struct Slave {
+		Slave();
+		
+		QString address;
+		unsigned iterationCount;
+		unsigned idleTime; //!< ms of the search during which the slave had no node to expand
+		quint64 peerBytes; //!< bytes sent to other slaves
+		SearchCounters counters; //!< of the planner of the slave, with the hits of the states it sent
+	};
+	typedef QList<Slave> Slaves;
+	
+	SearchStatistics();
+	void clear();
+	
+	size_t nodesTransferred; //!< nodes moved from slave to slave
+	size_t balanceMessages; //!< transfers requested by the master
+	size_t reinjectedNodes; //!< nodes leased by the master searched again after their slave left
+	quint64 masterBytes; //!< bytes exchanged between the master and the slaves
+	Slaves slaves; //!< slaves that acknowledged the end of the search
+	SearchCounters counters; //!< sum of the counters of the slaves and of the states sent by the master
+};
+
+//! state of a session of distributed search while it runs, see MasterPlanner9::getProgress()
+struct SearchProgress {
+	struct Slave {
+		Slave();
+		
+		QString address;
+		Planner9::Cost bestsMinCost; //!< lowest cost in the frontier of the slave
+		size_t frontierSize;
+		double throughput; //!< nodes expanded per second, as last reported by the slave
+		quint64 masterBytes; //!< bytes exchanged with the master during this search
+	};
+	typedef QList<Slave> Slaves;
+	
+	SearchProgress();
+	
+	bool searching;
+	int elapsedTime; //!< ms since the search started
+	Planner9::Cost bestsMinCost; //!< lowest cost in all frontiers, the best f of the search
+	Planner9::Cost bestCost; //!< of the best plan found in anytime mode, InfiniteCost if none
+	size_t nodesTransferred; //!< nodes moved from slave to slave
+	size_t balanceMessages; //!< transfers requested by the master
+	size_t reinjectedNodes; //!< nodes leased by the master searched again after their slave left
+	quint64 masterBytes; //!< bytes exchanged between the master and the slaves
+	Slaves slaves;
+};
 
 struct SlavePlanner9: QObject {
 
 	Q_OBJECT
 
+	//! id chosen by a master, as session ids are only unique per master, and session
+	typedef QPair<quint64, quint32> SearchKey;
+
+	//! lease under which nodes were received, retired once the subtrees of all its nodes are searched here or sent elsewhere
+	struct Origin {
+		Origin(ChunkedDevice* device = 0, bool peer = false, quint32 leaseId = 0, size_t remainingCount = 0);
+		
+		ChunkedDevice* device; //!< connection to the master or to the peer that holds the lease
+		bool peer;
+		quint32 leaseId;
+		size_t remainingCount; //!< nodes whose lineage is not retired yet
+	};
+	//! by id, the lineage of a node being the id of its origin followed by its index in the lease
+	typedef QMap<quint32, Origin> Origins;
+
+	//! search of a session of a master, all of them sharing the threads of the slave
+	struct Search {
+		Search();
+		
+		ThreadedPlanner9* planner;
+		const Planner9::CostFunction* costFunction; //!< sent by the master with the scope, owned
+		ChunkedDevice* master; //!< connection to the master of the session
+		size_t reportedPlansCount; //!< plans of the planner already sent to the master
+		bool anytime;
+		bool running; //!< whether the timer checks the progress of the planner
+		QTime startTime;
+		QTime busyStartTime; //!< when the search last started running
+		int busyTime; //!< ms of the search during which the planner had work, before busyStartTime
+		QTime lastSentCostTime;
+		Planner9::Cost lastSentMinCost;
+		CostHistogram lastSentHistogram;
+		size_t lastSentIterationCount; //!< to compute the throughput between reports
+		quint64 peerBytes; //!< bytes of the nodes of this search sent to other slaves
+		Origins origins;
+		quint32 lastOriginId;
+		bool noPlanPending; //!< exhausted, failure being reported once the peers retire the nodes sent to them
+	};
+	typedef QMap<SearchKey, Search> Searches;
+	//! id of every connected master, 0 until it has told it
+	typedef QMap<ChunkedDevice*, quint64> MastersMap;
+
+	//! nodes the master of a search asked to send that are not sent yet
+	struct Owed {
+		Owed();
+		
+		quint32 transferId;
+		size_t count;
+	};
+	typedef QMap<SearchKey, Owed> OwedMap;
+	//! id of the last transfer of every search to a peer
+	typedef QMap<SearchKey, quint32> TransfersMap;
+
+	//! encoded nodes sent to a peer, searched again here if it leaves before retiring them
+	struct HeldLease {
+		HeldLease(const SearchKey& key = SearchKey());
+		
+		SearchKey key;
+		QList<QByteArray> nodes;
+	};
+	typedef QMap<quint32, HeldLease> HeldLeasesMap;
+
+	//! connection to another slave to which nodes are sent
+	struct Peer {
+		Peer(ChunkedDevice* device = 0, bool connected = true);
+		
+		ChunkedDevice* device;
+		bool connected; //!< false while the connection is being established, batches wait meanwhile
+		QTime connectionStartTime;
+		size_t credits; //!< batches that can be sent before the peer acknowledges some
+		OwedMap owed;
+		TransfersMap transfers; //!< reported as failed to their masters if the connection breaks
+		HeldLeasesMap leases; //!< by id, unique on this connection
+		quint32 lastLeaseId;
+	};
+	typedef QMap<QString, Peer> PeersMap;
+
 public:
-	SlavePlanner9(const Domain& domain, std::ostream* debugStream = 0);
+	//! search on threadsCount worker threads, 0 meaning one per core
+	/*!
+		Any number of masters are accepted on address and port, any port if 0,
+		their searches sharing the threads. The slave is made known to them by
+		announcer if given, which it then owns.
+	*/
+	SlavePlanner9(const Domain& domain, std::ostream* debugStream = 0, size_t threadsCount = 0, SlaveAnnouncer* announcer = 0, const QHostAddress& address = QHostAddress::Any, quint16 port = 0);
 	~SlavePlanner9();
+	
+	//! port on which masters are accepted
+	quint16 getPort() const { return tcpServer.serverPort(); }
 
 protected slots:
 	void newConnection();
 	void disconnected();
 	void messageAvailable();
+	void newPeerConnection();
+	void peerConnected();
+	void peerConnectionError(QAbstractSocket::SocketError socketError);
+	//! give up the connections to peers that take longer than peerConnectionTimeout
+	void checkPeerConnections();
+	void peerDisconnected();
+	void peerMessageAvailable();
 
 protected:
-	size_t getBestsCount() const;
-	Planner9::Cost getBestsMinCost() const;
-	Planner9::Cost getBestsMaxCost() const;
 	virtual void timerEvent(QTimerEvent *event);
-	void runPlanner(const Scope& scope);
-	void killPlanner();
-	void runTimer();
-	void stopTimer();
+	//! check the planner of a running search, report its progress and whether it is over
+	void checkSearch(const SearchKey& key, Search& search);
+	Search* getSearch(const SearchKey& key);
+	//! connection to the master of the given id, 0 if it is gone
+	ChunkedDevice* getMasterDevice(quint64 masterId) const;
+	//! threads of the pool each running search gets, reported to the masters for them to weight their balancing
+	float getSpareThreads() const;
+	void runPlanner(const SearchKey& key, ChunkedDevice* master, const Scope& scope, bool anytime, const Planner9::CostFunction* costFunction);
+	void killPlanner(const SearchKey& key);
+	void killPlanners();
+	void runTimer(Search& search);
+	void stopTimer(Search& search);
+	unsigned getIdleTime(const Search& search) const;
+	void sendNodesToPeer(const SearchKey& key, quint32 transferId, const QString& hostName, quint16 port, size_t count);
+	//! connection to the given peer, which may not be established yet
+	Peer& getPeer(const QString& hostName, quint16 port);
+	//! the peer to which nodes are sent through device, 0 if it is a connection from a peer
+	Peer* findPeer(ChunkedDevice* device);
+	void removePeer(ChunkedDevice* device);
+	void sendPeerBatches(Peer& peer);
+	void reportSentNodes(const SearchKey& key, quint32 transferId, size_t nodesCount, Planner9::Cost minCost, const CostHistogram& histogram, size_t remainingCount);
+	void reportFailedTransfer(const SearchKey& key, quint32 transferId);
+	//! report failure once the nodes of key sent to peers are searched too
+	void reportNoPlan(const SearchKey& key, Search& search);
+	void cancelPeerTransfers(const SearchKey& key);
+	//! insert nodesCount nodes read from source in the search of key if any, leased by the holder of origin, and return their lowest cost
+	Planner9::Cost receiveNodes(const SearchKey& key, Serializer& source, size_t nodesCount, const Origin& origin);
+	//! retire the leases whose nodes have all left the planner of search
+	void retireLineages(const SearchKey& key, Search& search);
+	void retireOrigins(const SearchKey& key, Search& search);
+	void retireLease(const SearchKey& key, const Origin& origin);
+	//! search again the nodes of a lease that a peer did not retire
+	void reinjectHeldLease(const HeldLease& lease);
+	bool isHoldingLeases(const SearchKey& key) const;
 
 private:
 	void registerService();
 	void unregisterService();
 
 private:
-	int timerId;
-	SimplePlanner9* planner;
-	Planner9::CostFunction* costFunction;
-	ChunkedDevice* device;
+	int timerId; //!< -1 when no search is running
+	boost::scoped_ptr<ThreadPool> threadPool; //!< threads running the searches, while this thread only handles networking
+	Searches searches;
+	MastersMap masters;
 	QTcpServer tcpServer;
 	Serializer stream;
-	QTime lastSentCostTime;
-	Planner9::Cost lastSentMinCost;
-	Planner9::Cost lastSentMaxCost;
+	QTcpServer peerServer; //!< receives nodes directly from other slaves
+	PeersMap peers; //!< connections to other slaves, by "host:port"
+	Serializer peerStream;
 	std::ostream* debugStream;
-	AvahiServer* avahiServer;
-	AvahiEntryGroup* avahiEntryGroup;
+	SlaveAnnouncer* announcer;
 };
 
 struct MasterPlanner9: QObject {
 
 	Q_OBJECT
 
+	//! encoded nodes whose subtrees a client is responsible for searching
+	typedef QList<QByteArray> Leases;
+	//! by lease id, unique in a session
+	typedef QMap<quint32, Leases> LeasesMap;
+
+	//! connection to a slave, shared by all sessions
 	struct Client {
 		Client();
 		Client(ChunkedDevice* device);
+		
+		//! relative amount of work the slave can take before any search reports its spare threads, its threads that run in parallel
+		double getWeight() const;
 
 		ChunkedDevice* device;
+		QString peerHostName;
+		quint16 peerPort; //!< 0 until the slave has told it
+		unsigned threadsCount; //!< worker threads, shared with other masters, 0 until the slave has told it
+		unsigned coresCount; //!< cores of the machine of the slave, 0 if unknown
+	};
+	typedef QMap<QTcpSocket*, Client> ClientsMap;
+
+	//! part of a session searched by a client
+	struct Share {
+		Share(quint64 startBytes = 0);
+
 		Planner9::Cost bestsMinCost;
-		Planner9::Cost bestsMaxCost;
+		CostHistogram histogram; //!< costs of the frontier of the client
+		double throughput; //!< nodes expanded per second
+		double spareThreads; //!< threads of the pool of the client given to this session, shared with its other searches, 0 until reported
+		bool exhausted; //!< whether the client reported that it has no node left to search
 		bool nodeRequested;
+		LeasesMap leases; //!< nodes given by the master to the client, searched again elsewhere if it disconnects before retiring them
+		quint64 startBytes; //!< bytes exchanged with the client when it joined the session
 	};
+	typedef QMap<QTcpSocket*, Share> SharesMap;
+
+	//! nodes a client was asked to send to another one
+	struct Transfer {
+		Transfer(QTcpSocket* source = 0, QTcpSocket* target = 0);
+		
+		//! whether all nodes are sent and the target has inserted them
+		bool isComplete() const { return !sending && receivedCount >= sentCount; }
+		
+		QTcpSocket* source;
+		QTcpSocket* target;
+		size_t sentCount;
+		size_t receivedCount; //!< as acknowledged by the target, which may be before the source reports them sent
+		bool sending; //!< false once the source has sent all nodes
+	};
+	typedef QMap<quint32, Transfer> TransfersMap;
+
+	//! search for the plan of a problem, which runs concurrently with those of other sessions
+	struct Session {
+		Session(quint32 id, const Problem& problem, Planner9::CostFunction* costFunction, bool anytime);
+
+		const quint32 id;
+		const Problem problem;
+		Planner9::CostFunction* const costFunction;
+		const Planner9::SearchNode initialNode;
+		const bool anytime;
+		SharesMap shares; //!< by client
+		Leases orphanLeases; //!< leases of disconnected clients, given to the next client that connects
+		TransfersMap transfers; //!< the search is not over while nodes may be on their way
+		quint32 lastTransferId;
+		quint32 lastLeaseId;
+		bool stopped; //!< whether the search is over, finished once no client is in stopping anymore
+		QSet<QTcpSocket*> stopping; //!< clients that have not acknowledged the stop yet
+		Plan bestPlan;
+		Planner9::Cost bestCost; //!< cost of bestPlan, bound of the search in anytime mode
+		unsigned totalIterationCount;
+		QTime startTime;
+		SearchStatistics statistics;
+	};
+	typedef QMap<quint32, Session*> SessionsMap;
 
 public:
-	MasterPlanner9(const Domain& domain, std::ostream* debugStream = 0);
+	//! connects to the slaves found by finder if given, which it then owns
+	MasterPlanner9(const Domain& domain, std::ostream* debugStream = 0, SlaveFinder* finder = 0);
 	~MasterPlanner9();
 
-	const Scope& getProblemScope() const { return problem.scope; }
 	const Domain& getDomain() const { return stream.domain; }
+	size_t getSlavesCount() const { return clients.size(); }
+	//! whether the session is running or among the last finished ones, whose statistics are kept
+	bool hasSession(quint32 session) const { return sessions.contains(session); }
+	//! the following calls require hasSession(session)
+	const Scope& getProblemScope(quint32 session) const { return sessions[session]->problem.scope; }
+	const SearchStatistics& getStatistics(quint32 session) const { return sessions[session]->statistics; }
+	SearchProgress getProgress(quint32 session) const;
 	
+	//! start connecting to the slave at hostName:port, return false if it failed at once
 	bool connectToSlave(const QString& hostName, quint16 port);
+	//! search on threadsCount threads of this machine too, 0 meaning one per core
+	/*!
+		The search runs in a slave embedded in this process, with which this
+		master balances work like with any other. Other slaves send it nodes
+		at the address they reach this master at, other masters may use it too.
+		Throw std::runtime_error if it cannot listen or this master cannot
+		connect to it.
+	*/
+	void startLocalSearch(size_t threadsCount = 0);
 
-	void plan(const Problem& problem, Planner9::CostFunction* costFunction = 0);
+	//! start searching a plan for problem in a new session, without waiting for other sessions, and return its id
+	/*!
+		The slaves order nodes with a copy of costFunction, AlternativesCost
+		if 0, which must thus be one of those of costs.hpp. It must outlive the session.
+	*/
+	quint32 plan(const Problem& problem, Planner9::CostFunction* costFunction = 0);
+	//! stop searching in session, planningFinished is emitted once all slaves have stopped
+	void cancel(quint32 session);
+	//! if anytime, search goes on after a plan is found, with its cost as a bound for all slaves, until the best plan is proven; applies to the next sessions
+	void setAnytime(bool anytime) { this->anytime = anytime; }
+	//! emit planningProgressed every period ms for every running session, 0 meaning never
+	void setProgressPeriod(int period);
 
 public slots:
 	// TODO: debug/bench only
+	//! stop the last session started and search its problem again in a new one
 	void replan();
 
 signals:
-	void planningStarted();
-	void planningSucceded(const Plan& plan);
-	void planningFailed();
-	void planningFinished(const unsigned& totalIterationsCount);
+	void planningStarted(const quint32& session);
+	void planningSucceded(const quint32& session, const Plan& plan);
+	void planningImproved(const quint32& session, const Plan& plan, const double& cost);
+	void planningFailed(const quint32& session);
+	void planningFinished(const quint32& session, const unsigned& totalIterationsCount);
+	//! the search of session goes on, getProgress() tells how
+	void planningProgressed(const quint32& session);
 
 protected slots:
 	void clientConnected();
 	void clientDisconnected();
 	void clientConnectionError(QAbstractSocket::SocketError socketError);
-	void clientDiscovered(int interface, int protocol, const QString &name, const QString &type, const QString &domain, uint flags);
+	void slaveFound(const QString& hostName, quint16 port);
     void messageAvailable();
 
 protected:
-	void processMessage(Client& client);
-	void startSearchIfReady();
-	void stopClients();
-	bool isAnyClientSearching() const;
+	virtual void timerEvent(QTimerEvent *event);
+	void processMessage(Client& client, QTcpSocket* socket);
+	//! the running session of the given id, 0 if it is stopped or unknown, in which case its messages are ignored
+	Session* getRunningSession(quint32 session);
+	void joinSession(Session& session, QTcpSocket* socket);
+	void stopSession(Session& session);
+	//! once all clients have acknowledged the stop, collect the statistics of session
+	void finishSession(Session& session);
+	bool isAnyClientSearching(const Session& session) const;
+	//! if no client searches session anymore, report its result and stop it
+	void stopIfExhausted(Session& session);
+	void updateProgressTimer();
+
+	void balance(Session& session, QTcpSocket* source);
+	//! whether nodes sent to the client of socket are not all acknowledged yet, in which case it gets no more
+	bool hasPendingTransfers(const Session& session, QTcpSocket* socket) const;
+	//! nodes expanded per second by client in share, as reported or guessed from its weight
+	static double getThroughput(const Share& share, const Client& client, double throughputPerWeight);
+	//! relative amount of work a client can take in a session, its spare threads if it has reported them
+	static double getWeight(const Share& share, const Client& client);
 
-	void sendGetNode(ChunkedDevice* device);
-	void sendScope(ChunkedDevice* client);
-	void sendInitialNode(ChunkedDevice* client);
-	void sendNode(ChunkedDevice* client, const SimplePlanner9::SearchNode& node);
-	void sendStop(ChunkedDevice* client);
+	static quint64 newId();
+	void removeClient(QTcpSocket* socket);
+	void reinjectLeases(Session& session, const Leases& leases);
+	SharesMap::iterator getLeastLoadedShare(Session& session);
+	quint64 getBytes(QTcpSocket* socket) const;
+	static bool isLoopback(const QHostAddress& address);
+
+	void sendSendNodes(Session& session, ChunkedDevice* device, const Client& target, quint32 transferId, size_t count);
+	void sendScope(const Session& session, ChunkedDevice* device);
+	void sendInitialNode(Session& session, QTcpSocket* socket);
+	void sendLeases(Session& session, QTcpSocket* socket, const Leases& leases);
+	void sendStop(const Session& session, ChunkedDevice* device);
+	void sendCostBound(const Session& session, ChunkedDevice* device);
 
 private:
-	Problem problem;
-	Planner9::CostFunction* costFunction;
-	Planner9::SearchNode *initialNode;
-	typedef QMap<QTcpSocket*, Client> ClientsMap;
+	const quint64 id; //!< identifies this master on the slaves, which other masters may share
 	ClientsMap clients;
+	SessionsMap sessions; //!< running sessions and the last finished ones
+	QList<quint32> finishedSessions; //!< in the order they finished
+	quint32 lastSessionId;
 	Serializer stream;
-	int stoppingCount;
-	bool newSearch;
-	unsigned totalIterationCount;
+	bool anytime;
+	int progressPeriod;
+	int progressTimerId; //!< 0 when no session is running or progress is not reported
 	std::ostream* debugStream;
-	AvahiServer* avahiServer;
-	AvahiServiceBrowser* avahiServiceBrowser;
+	SlaveFinder* finder;
+	SlavePlanner9* localSlave; //!< 0 unless startLocalSearch() was called
 };
 
 
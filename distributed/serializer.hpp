@@ -2,26 +2,51 @@
 #define SERIALIZER_HPP_
 
 #include <QDataStream>
+#include <QMap>
 #include <QtDebug>
 #include "../core/planner9.hpp"
+#include "../core/histogram.hpp"
 
+//! messages between master and slaves are followed by the quint32 id of the session they are about, except CMD_PEER_PORT, CMD_SLAVE_CAPACITY and CMD_MASTER_ID
 enum Command {
-	CMD_PROBLEM_SCOPE,
-	CMD_PUSH_NODE,
-	CMD_GET_NODE,
+	CMD_PROBLEM_SCOPE, //!< master to slave: scope, anytime mode and cost function of a new search
+	CMD_PUSH_NODE, //!< master to slave: nodes of a lease of the given id, the master searching them again elsewhere until the lease is retired
+	CMD_SEND_NODES, //!< master to slave: ship some of your best nodes to the given peer, as the transfer of the given id
 	CMD_PLAN_FOUND,
 	CMD_NOPLAN_FOUND,
-	CMD_CURRENT_COST,
-	CMD_STOP
+	CMD_CURRENT_COST, //!< slave to master: lowest cost, cost histogram, throughput and spare threads of a search
+	CMD_STOP,
+	CMD_PEER_PORT, //!< slave to master: port on which the slave accepts nodes from peers
+	CMD_NODES_SENT, //!< slave to master: result of a CMD_SEND_NODES, with the count and costs of the nodes sent
+	CMD_PEER_NODES, //!< slave to slave: nodes of a transfer in the search of a given master id and session, leased by the sender
+	CMD_COST_BOUND, //!< master to slave: cost of the best plan found, in anytime mode
+	CMD_PEER_CREDIT, //!< slave to slave: number of further node batches the receiver accepts
+	CMD_SLAVE_CAPACITY, //!< slave to master: worker threads and cores of the slave
+	CMD_MASTER_ID, //!< master to slave: id of the master, unique among those sharing the slave
+	CMD_NODES_RECEIVED, //!< slave to master: nodes of a transfer were inserted in the frontier of the receiver
+	CMD_TRANSFER_FAILED, //!< slave to master: the connection to the receiver of a transfer broke, its nodes may not arrive
+	CMD_LEASE_RETIRED, //!< slave to master: the subtrees of the nodes of a lease are searched or sent to peers
+	CMD_PEER_RETIRE, //!< slave to slave: the subtrees of the nodes of a lease are searched or sent further, the sender forgets them
+	CMD_PEER_RETURN //!< slave to slave: the nodes of a lease belong to no search here, the sender searches them again
 };
 
 extern const char* commandsNames[];
 
 struct Domain;
+struct StateDictionary;
 
 struct Serializer: public QDataStream {
 	Serializer(const Domain& domain);
 	Serializer(QIODevice * d, const Domain& domain);
+	~Serializer();
+	
+	//! caches of the states sent and received through the current device, 0 if there is no device
+	StateDictionary* getSentStates();
+	StateDictionary* getReceivedStates();
+	//! drop the caches of a device that is closed
+	void forgetDevice(QIODevice* device);
+	//! hits and misses of the caches of states sent through all devices since the last call
+	SearchCounters takeSentStatesCounters();
 	
 	template<typename T>
 	void write(const T& t) { *this << t; }
@@ -30,6 +55,32 @@ struct Serializer: public QDataStream {
 	T read() { T t; *this >> t; return t; }
 	
 	const Domain& domain;
+
+private:
+	typedef QMap<QIODevice*, StateDictionary*> StateDictionaries;
+	StateDictionary* getStates(StateDictionaries& dictionaries);
+	
+	StateDictionaries sentStates;
+	StateDictionaries receivedStates;
 };
 
+// force the use of specialized versions
+
+template<> void Serializer::write(const Command& cmd);
+template<> void Serializer::write(const Scope& scope);
+template<> void Serializer::write(const Plan& plan);
+template<> void Serializer::write(const Planner9::SearchNode& node);
+template<> void Serializer::write(const CostHistogram& histogram);
+template<> void Serializer::write(const SearchCounters& counters);
+template<> void Serializer::write(const Planner9::CostFunction* const& costFunction);
+
+template<> Command Serializer::read();
+template<> Scope Serializer::read();
+template<> Plan Serializer::read();
+template<> Planner9::SearchNode Serializer::read();
+template<> CostHistogram Serializer::read();
+template<> SearchCounters Serializer::read();
+//! return a new cost function, which the caller owns
+template<> const Planner9::CostFunction* Serializer::read();
+
 #endif // SERIALIZER_HPP_
@@ -8,7 +8,7 @@
 #include "../core/relations.hpp"
 
 
-struct MyDomain {
+struct MyDomain: Domain {
 
 	Relation robots, object, resource, area;
 	EquivalentRelation isConnectable, isConnected;
@@ -29,12 +29,12 @@ MyDomain::MyDomain():
 	isConnectable("isConnectable"),
 	isConnected("isConnected"),
 	isIn("isIn", 2),
-	moveObject("moveObject"),
-	setConnected("setConnected"),
-	makeRamp("makeRamp"),
-	connectArea("connectArea"),
-	moveWithRobots("moveWithRobots"),
-	move("move") {
+	moveObject(this, "moveObject"),
+	setConnected(this, "setConnected"),
+	makeRamp(this, "makeRamp"),
+	connectArea(this, "connectArea"),
+	moveWithRobots(this, "moveWithRobots"),
+	move(this, "move") {
 
 	moveObject.param("o");
 	moveObject.param("d");
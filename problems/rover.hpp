@@ -6,7 +6,7 @@
 #include "../core/relations.hpp"
 
 
-struct MyDomain {
+struct MyDomain: Domain {
 
 	// typing
 	Relation lander;
@@ -109,28 +109,28 @@ MyDomain::MyDomain() :
 	supports("supports", 2),
 	visible_from("visible_from", 2),
 	
-	do_navigate("do_navigate"),
-	do_sample_soil("do_sample_soil"),
-	do_sample_rock("do_sample_rock"),
-	do_drop("do_drop"),
-	do_calibrate("do_calibrate"),
-	do_take_image("do_take_image"),
-	do_communicate_soil_data("do_communicate_soil_data"),
-	do_communicate_rock_data("do_communicate_rock_data"),
-	do_communicate_image_data("do_communicate_image_data"),
-	do_visit("do_visit"),
-	do_unvisit("do_unvisit"),
+	do_navigate(this, "do_navigate"),
+	do_sample_soil(this, "do_sample_soil"),
+	do_sample_rock(this, "do_sample_rock"),
+	do_drop(this, "do_drop"),
+	do_calibrate(this, "do_calibrate"),
+	do_take_image(this, "do_take_image"),
+	do_communicate_soil_data(this, "do_communicate_soil_data"),
+	do_communicate_rock_data(this, "do_communicate_rock_data"),
+	do_communicate_image_data(this, "do_communicate_image_data"),
+	do_visit(this, "do_visit"),
+	do_unvisit(this, "do_unvisit"),
 	
-	empty_store("empty_store"),
-	navigate2("navigate2"),
-	navigate3("navigate3"),
-	send_soil_data("send_soil_data"),
-	get_soil_data("get_soil_data"),
-	send_rock_data("send_rock_data"),
-	get_rock_data("get_rock_data"),
-	send_image_data("send_image_data"),
-	get_image_data("get_image_data"),
-	calibrate("calibrate")
+	empty_store(this, "empty_store"),
+	navigate2(this, "navigate2"),
+	navigate3(this, "navigate3"),
+	send_soil_data(this, "send_soil_data"),
+	get_soil_data(this, "get_soil_data"),
+	send_rock_data(this, "send_rock_data"),
+	get_rock_data(this, "get_rock_data"),
+	send_image_data(this, "send_image_data"),
+	get_image_data(this, "get_image_data"),
+	calibrate(this, "calibrate")
 {
 	do_navigate.param("x");
 	do_navigate.param("y");
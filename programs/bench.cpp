@@ -0,0 +1,255 @@
+#include "bundled-problems.hpp"
+#include "../core/planner9.hpp"
+#include "../core/problem.hpp"
+#include "../core/costs.hpp"
+#include "../threaded/planner9-threaded.hpp"
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+using namespace std;
+
+//! result of a run, sent by the process that planned to the one that reports
+struct RunResult {
+	bool solved;
+	double cost;
+	size_t iterations;
+	double firstPlanTime; //!< seconds until the first plan, or until the search gave up
+	SearchCounters counters;
+};
+
+struct BenchOptions {
+	BenchOptions();
+	
+	size_t runsCount;
+	size_t threadsCount;
+	bool csv;
+	bool simple;
+	bool threaded;
+	string tracePrefix; //!< if not empty, every run writes its search trace to a file of this prefix
+	vector<string> problems;
+};
+
+BenchOptions::BenchOptions():
+	runsCount(1),
+	threadsCount(2),
+	csv(false),
+	simple(true),
+	threaded(true) {
+}
+
+//! if tracePath is not empty, write the search trace there
+RunResult runPlanner(const Problem& problem, const string& plannerName, size_t threadsCount, const string& tracePath) {
+	AlternativesCost alternativesCost;
+	RunResult result;
+	ofstream traceFile;
+	boost::scoped_ptr<SearchTracer> tracer;
+	if (!tracePath.empty()) {
+		traceFile.open(tracePath.c_str(), ios::binary);
+		if (!traceFile)
+			throw runtime_error(string("Cannot write trace ") + tracePath);
+		tracer.reset(new SearchTracer(traceFile));
+	}
+	const boost::posix_time::ptime startTime(boost::posix_time::microsec_clock::universal_time());
+	if (plannerName == "simple") {
+		SimplePlanner9 planner(problem, &alternativesCost);
+		planner.setTracer(tracer.get());
+		result.solved = bool(planner.plan());
+		result.cost = result.solved ? planner.plansCosts[0] : Planner9::InfiniteCost;
+		result.iterations = planner.iterationCount;
+		result.counters = planner.getCounters();
+	} else {
+		ThreadedPlanner9 planner(problem, threadsCount, &alternativesCost);
+		planner.setTracer(tracer.get());
+		Plan plan;
+		result.solved = bool(planner.plan());
+		if (!result.solved || !planner.getPlan(0, plan, result.cost))
+			result.cost = Planner9::InfiniteCost;
+		result.iterations = planner.getIterationCount();
+		result.counters = planner.getCounters();
+	}
+	result.firstPlanTime = (boost::posix_time::microsec_clock::universal_time() - startTime).total_microseconds() / 1e6;
+	return result;
+}
+
+//! plan in a child process, so that its peak memory is that of this run only; return false on failure
+bool forkRun(const string& problemName, const string& plannerName, size_t threadsCount, const string& tracePath, RunResult& result, long& peakMemory) {
+	int fds[2];
+	if (pipe(fds) != 0)
+		return false;
+	
+	const pid_t pid(fork());
+	if (pid < 0)
+		return false;
+	if (pid == 0) {
+		close(fds[0]);
+		// planners report on the standard output, which is kept for results
+		const int devNull(open("/dev/null", O_WRONLY));
+		if (devNull >= 0)
+			dup2(devNull, STDOUT_FILENO);
+		boost::scoped_ptr<BundledProblem> problem(createBundledProblem(problemName));
+		RunResult childResult;
+		try {
+			childResult = runPlanner(problem->getProblem(), plannerName, threadsCount, tracePath);
+		} catch (const std::runtime_error& e) {
+			cerr << e.what() << endl;
+			_exit(1);
+		}
+		const bool written(write(fds[1], &childResult, sizeof(RunResult)) == sizeof(RunResult));
+		_exit(written ? 0 : 1);
+	}
+	
+	close(fds[1]);
+	const bool received(read(fds[0], &result, sizeof(RunResult)) == sizeof(RunResult));
+	close(fds[0]);
+	int status;
+	struct rusage usage;
+	if (wait4(pid, &status, 0, &usage) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		return false;
+	peakMemory = usage.ru_maxrss;
+	return received;
+}
+
+void printHeader(const BenchOptions& options) {
+	if (options.csv) {
+		cout << "problem,planner,threads,run,solved,cost,iterations,firstPlanTime,expansionsPerSecond,peakMemoryKB,nodesGenerated,nodesPruned";
+		for (size_t i = 0; i < SearchCounters::PHASES_COUNT; ++i)
+			cout << "," << SearchCounters::phasesNames[i] << "Time";
+		cout << endl;
+	}
+}
+
+void printResult(const BenchOptions& options, const string& problemName, const string& plannerName, size_t threadsCount, size_t run, const RunResult& result, long peakMemory) {
+	const double expansionsPerSecond(result.firstPlanTime > 0 ? result.iterations / result.firstPlanTime : 0);
+	if (options.csv) {
+		cout << problemName << "," << plannerName << "," << threadsCount << "," << run << ",";
+		cout << (result.solved ? 1 : 0) << ",";
+		if (result.solved)
+			cout << result.cost;
+		cout << "," << result.iterations << "," << result.firstPlanTime << "," << expansionsPerSecond << "," << peakMemory;
+		cout << "," << result.counters.nodesGenerated << "," << result.counters.nodesPruned;
+		for (size_t i = 0; i < SearchCounters::PHASES_COUNT; ++i)
+			cout << "," << result.counters.phasesTimes[i] / 1e6;
+		cout << endl;
+	} else {
+		cout << "{\"problem\": \"" << problemName << "\"";
+		cout << ", \"planner\": \"" << plannerName << "\"";
+		cout << ", \"threads\": " << threadsCount;
+		cout << ", \"run\": " << run;
+		cout << ", \"solved\": " << (result.solved ? "true" : "false");
+		cout << ", \"cost\": ";
+		if (result.solved)
+			cout << result.cost;
+		else
+			cout << "null";
+		cout << ", \"iterations\": " << result.iterations;
+		cout << ", \"firstPlanTime\": " << result.firstPlanTime;
+		cout << ", \"expansionsPerSecond\": " << expansionsPerSecond;
+		cout << ", \"peakMemoryKB\": " << peakMemory;
+		cout << ", \"nodesGenerated\": " << result.counters.nodesGenerated;
+		cout << ", \"nodesPruned\": " << result.counters.nodesPruned;
+		for (size_t i = 0; i < SearchCounters::PHASES_COUNT; ++i)
+			cout << ", \"" << SearchCounters::phasesNames[i] << "Time\": " << result.counters.phasesTimes[i] / 1e6;
+		cout << "}" << endl;
+	}
+}
+
+int dumpError(char *exeName) {
+	cerr << "Error, usage " << exeName << " [-r RUNS] [-t THREADS] [-p simple|threaded|all] [-f json|csv] [-T TRACE_PREFIX] [PROBLEM...]" << endl;
+	cerr << "Plans every given problem, by default all of them, RUNS times with each planner. Problems are:";
+	for (size_t i = 0; i < bundledProblemsCount; ++i)
+		cerr << " " << bundledProblems[i].name;
+	cerr << endl;
+	cerr << "Generated problems are given as GENERATOR:PARAM=VALUE:..., generators and their default parameters are:" << endl;
+	for (size_t i = 0; i < bundledGeneratorsCount; ++i)
+		cerr << "  " << bundledGenerators[i].name << " " << bundledGenerators[i].parameters << endl;
+	cerr << "With -T, every run writes its search trace to TRACE_PREFIXPROBLEM-PLANNER-RUN.trace, for p9trace." << endl;
+	return 1;
+}
+
+int main(int argc, char* argv[]) {
+	BenchOptions options;
+	for (int i = 1; i < argc; ++i) {
+		const string arg(argv[i]);
+		if (arg[0] != '-') {
+			options.problems.push_back(arg);
+			continue;
+		}
+		if (i + 1 >= argc)
+			return dumpError(argv[0]);
+		const string value(argv[++i]);
+		if (arg == "-r")
+			options.runsCount = atoi(value.c_str());
+		else if (arg == "-t")
+			options.threadsCount = atoi(value.c_str());
+		else if (arg == "-p" && (value == "simple" || value == "threaded" || value == "all")) {
+			options.simple = value != "threaded";
+			options.threaded = value != "simple";
+		} else if (arg == "-f" && (value == "json" || value == "csv"))
+			options.csv = value == "csv";
+		else if (arg == "-T")
+			options.tracePrefix = value;
+		else
+			return dumpError(argv[0]);
+	}
+	if (options.runsCount == 0 || options.threadsCount == 0)
+		return dumpError(argv[0]);
+	
+	if (options.problems.empty())
+		for (size_t i = 0; i < bundledProblemsCount; ++i)
+			options.problems.push_back(bundledProblems[i].name);
+	
+	// check names before running anything
+	for (vector<string>::const_iterator it = options.problems.begin(); it != options.problems.end(); ++it) {
+		try {
+			delete createBundledProblem(*it);
+		} catch (const std::runtime_error& e) {
+			cerr << e.what() << endl;
+			return dumpError(argv[0]);
+		}
+	}
+	
+	vector<string> planners;
+	if (options.simple)
+		planners.push_back("simple");
+	if (options.threaded)
+		planners.push_back("threaded");
+	
+	printHeader(options);
+	bool success(true);
+	for (vector<string>::const_iterator problemIt = options.problems.begin(); problemIt != options.problems.end(); ++problemIt) {
+		for (vector<string>::const_iterator plannerIt = planners.begin(); plannerIt != planners.end(); ++plannerIt) {
+			const size_t threadsCount(*plannerIt == "simple" ? 1 : options.threadsCount);
+			for (size_t run = 0; run < options.runsCount; ++run) {
+				RunResult result;
+				long peakMemory;
+				string tracePath;
+				if (!options.tracePrefix.empty()) {
+					ostringstream oss;
+					oss << options.tracePrefix << *problemIt << "-" << *plannerIt << "-" << run << ".trace";
+					tracePath = oss.str();
+				}
+				if (forkRun(*problemIt, *plannerIt, threadsCount, tracePath, result, peakMemory)) {
+					printResult(options, *problemIt, *plannerIt, threadsCount, run, result, peakMemory);
+				} else {
+					cerr << "Run " << run << " of " << *problemIt << " with the " << *plannerIt << " planner failed" << endl;
+					success = false;
+				}
+			}
+		}
+	}
+	
+	return success ? 0 : 1;
+}
@@ -0,0 +1,384 @@
+#include "bundled-problems.hpp"
+#include "../core/domain.hpp"
+#include "../core/problem.hpp"
+#include "../core/relations.hpp"
+#include <boost/lambda/lambda.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <stdexcept>
+#include <cstdlib>
+#include <sstream>
+#include <vector>
+
+// Every problem defines its own MyDomain and MyProblem, so each is included
+// in a namespace of its own, after the headers it shares with the others.
+
+namespace basic {
+#include "../problems/basic.hpp"
+}
+
+namespace jug_pouring {
+#include "../problems/jug-pouring.hpp"
+}
+
+namespace tower_of_hanoi {
+#include "../problems/tower-of-hanoi.hpp"
+}
+
+namespace robots {
+#include "../problems/robots.hpp"
+}
+
+namespace mini_robots {
+#include "../problems/mini-robots.hpp"
+}
+
+namespace rover {
+#include "../problems/rover.hpp"
+}
+
+namespace rescue {
+#include "../problems/rescue.hpp"
+}
+
+// rescue-numeric uses the same include guard as rescue
+#undef PROBLEMS_RESCUE_HPP_
+namespace rescue_numeric {
+#include "../problems/rescue-numeric.hpp"
+}
+
+namespace robot_proba {
+#include "../problems/robot-proba.hpp"
+}
+
+// Generators of instances of parametric size, for scaling studies
+
+namespace {
+	struct GeneratorRandom {
+		GeneratorRandom(unsigned seed): generator(seed) {}
+		
+		//! a number in [0, n)
+		unsigned operator()(unsigned n) { return generator() % n; }
+		
+		boost::mt19937 generator;
+	};
+	
+	std::string constantName(const char* prefix, unsigned index) {
+		std::ostringstream oss;
+		oss << prefix << index;
+		return oss.str();
+	}
+	
+	void checkParameter(const GeneratorParameters& parameters, const std::string& name, unsigned minValue) {
+		if (parameters.get(name) < minValue) {
+			std::ostringstream oss;
+			oss << "Parameter " << name << " must be at least " << minValue;
+			throw std::runtime_error(oss.str());
+		}
+	}
+}
+
+namespace tower_of_hanoi {
+	struct GeneratedProblem: HanoiDomain, Problem {
+		GeneratedProblem(const GeneratorParameters& parameters) {
+			checkParameter(parameters, "disks", 1);
+			add(peg("A"));
+			add(peg("B"));
+			add(peg("C"));
+			add(nTh(), int(parameters.get("disks")));
+			
+			goal(hanoi("A", "B", "C"));
+		}
+	};
+}
+
+// robots and mini-robots share the names of their relations and of their goal method
+template<typename RobotsDomain>
+struct GeneratedRobotsProblem: RobotsDomain, Problem {
+	GeneratedRobotsProblem(const GeneratorParameters& parameters) {
+		checkParameter(parameters, "robots", 1);
+		checkParameter(parameters, "areas", 2);
+		checkParameter(parameters, "objects", 1);
+		const unsigned robotsCount(parameters.get("robots"));
+		const unsigned areasCount(parameters.get("areas"));
+		const unsigned objectsCount(parameters.get("objects"));
+		GeneratorRandom random(parameters.get("seed"));
+		
+		// areas form a random tree of possible connections
+		for (unsigned i = 0; i < areasCount; ++i) {
+			add(this->area(constantName("a", i).c_str()));
+			if (i > 0)
+				add(this->isConnectable(constantName("a", random(i)).c_str(), constantName("a", i).c_str()));
+		}
+		// every robot starts with a resource
+		for (unsigned i = 0; i < robotsCount; ++i) {
+			const std::string area(constantName("a", random(areasCount)));
+			add(this->robots(constantName("r", i).c_str()));
+			add(this->isIn(constantName("r", i).c_str(), area.c_str()));
+			add(this->resource(constantName("nut", i).c_str()));
+			add(this->isIn(constantName("nut", i).c_str(), area.c_str()));
+		}
+		unsigned source(0);
+		for (unsigned i = 0; i < objectsCount; ++i) {
+			const unsigned area(random(areasCount));
+			if (i == 0)
+				source = area;
+			add(this->object(constantName("o", i).c_str()));
+			add(this->isIn(constantName("o", i).c_str(), constantName("a", area).c_str()));
+		}
+		
+		const unsigned destination((source + 1 + random(areasCount - 1)) % areasCount);
+		goal(this->move("o0", constantName("a", destination).c_str()));
+	}
+};
+
+namespace rover {
+	struct GeneratedProblem: MyDomain, Problem {
+		GeneratedProblem(const GeneratorParameters& parameters) {
+			checkParameter(parameters, "rovers", 1);
+			checkParameter(parameters, "waypoints", 2);
+			checkParameter(parameters, "objectives", 1);
+			checkParameter(parameters, "cameras", 1);
+			checkParameter(parameters, "goals", 1);
+			const unsigned roversCount(parameters.get("rovers"));
+			const unsigned waypointsCount(parameters.get("waypoints"));
+			const unsigned objectivesCount(parameters.get("objectives"));
+			const unsigned camerasCount(parameters.get("cameras"));
+			GeneratorRandom random(parameters.get("seed"));
+			
+			const char* modes[] = { "colour", "high_res", "low_res" };
+			const unsigned modesCount(sizeof(modes) / sizeof(const char*));
+			for (unsigned i = 0; i < modesCount; ++i)
+				add(mode(modes[i]));
+			
+			for (unsigned i = 0; i < waypointsCount; ++i)
+				add(waypoint(constantName("waypoint", i).c_str()));
+			for (unsigned i = 0; i < roversCount; ++i)
+				add(rover(constantName("rover", i).c_str()));
+			
+			// waypoints form a random tree that every rover can traverse, plus shortcuts that only some can
+			for (unsigned i = 1; i < waypointsCount + waypointsCount / 2; ++i) {
+				const bool shortcut(i >= waypointsCount);
+				const unsigned to(shortcut ? random(waypointsCount) : i);
+				const unsigned from(shortcut ? random(waypointsCount) : random(i));
+				if (from == to)
+					continue;
+				const std::string fromName(constantName("waypoint", from)), toName(constantName("waypoint", to));
+				add(visible(fromName.c_str(), toName.c_str()));
+				add(visible(toName.c_str(), fromName.c_str()));
+				for (unsigned j = 0; j < roversCount; ++j) {
+					if (shortcut && random(2))
+						continue;
+					const std::string roverName(constantName("rover", j));
+					add(can_traverse(roverName.c_str(), fromName.c_str(), toName.c_str()));
+					add(can_traverse(roverName.c_str(), toName.c_str(), fromName.c_str()));
+				}
+			}
+			
+			add(lander("general"));
+			add(channel_free("general"));
+			add(at_lander("general", constantName("waypoint", random(waypointsCount)).c_str()));
+			
+			// every kind of equipment is on at least one rover
+			std::vector<unsigned> imagingRovers;
+			for (unsigned i = 0; i < roversCount; ++i) {
+				const std::string roverName(constantName("rover", i));
+				const std::string storeName(roverName + "store");
+				add(store(storeName.c_str()));
+				add(store_of(storeName.c_str(), roverName.c_str()));
+				add(empty(storeName.c_str()));
+				add(available(roverName.c_str()));
+				add(at(roverName.c_str(), constantName("waypoint", random(waypointsCount)).c_str()));
+				if (i == 0 || random(2))
+					add(equipped_for_soil_analysis(roverName.c_str()));
+				if (i == 1 % roversCount || random(2))
+					add(equipped_for_rock_analysis(roverName.c_str()));
+				if (i == 2 % roversCount || random(2)) {
+					add(equipped_for_imaging(roverName.c_str()));
+					imagingRovers.push_back(i);
+				}
+			}
+			
+			for (unsigned i = 0; i < objectivesCount; ++i) {
+				const std::string objectiveName(constantName("objective", i));
+				add(objective(objectiveName.c_str()));
+				const unsigned visibleCount(1 + random((waypointsCount + 1) / 2));
+				for (unsigned j = 0; j < visibleCount; ++j)
+					add(visible_from(objectiveName.c_str(), constantName("waypoint", random(waypointsCount)).c_str()));
+			}
+			
+			std::vector<bool> supportedModes(modesCount, false);
+			for (unsigned i = 0; i < camerasCount; ++i) {
+				const std::string cameraName(constantName("camera", i));
+				add(camera(cameraName.c_str()));
+				add(on_board(cameraName.c_str(), constantName("rover", imagingRovers[random(imagingRovers.size())]).c_str()));
+				add(calibration_target(cameraName.c_str(), constantName("objective", random(objectivesCount)).c_str()));
+				const unsigned supportedMode(random(modesCount));
+				add(supports(cameraName.c_str(), modes[supportedMode]));
+				supportedModes[supportedMode] = true;
+			}
+			
+			// goals are drawn from the samples and images that can be obtained
+			typedef std::pair<Method*, std::pair<std::string, std::string> > Goal;
+			std::vector<Goal> goals;
+			for (unsigned i = 0; i < waypointsCount; ++i) {
+				const std::string waypointName(constantName("waypoint", i));
+				if (random(2)) {
+					add(at_soil_sample(waypointName.c_str()));
+					goals.push_back(Goal(&get_soil_data, std::make_pair(waypointName, std::string())));
+				}
+				if (random(2)) {
+					add(at_rock_sample(waypointName.c_str()));
+					goals.push_back(Goal(&get_rock_data, std::make_pair(waypointName, std::string())));
+				}
+			}
+			for (unsigned i = 0; i < objectivesCount; ++i)
+				for (unsigned j = 0; j < modesCount; ++j)
+					if (supportedModes[j])
+						goals.push_back(Goal(&get_image_data, std::make_pair(constantName("objective", i), std::string(modes[j]))));
+			
+			// if fewer goals are possible than requested, all of them are used
+			ScopedTaskNetwork network;
+			for (unsigned i = 0; i < parameters.get("goals") && !goals.empty(); ++i) {
+				const size_t index(random(goals.size()));
+				const Goal& selected(goals[index]);
+				const ScopedTaskNetwork task(selected.second.second.empty() ?
+					(*selected.first)(selected.second.first.c_str()) :
+					(*selected.first)(selected.second.first.c_str(), selected.second.second.c_str()));
+				network = (i == 0) ? task : network >> task;
+				goals.erase(goals.begin() + index);
+			}
+			goal(network);
+		}
+	};
+}
+
+namespace rescue {
+	struct GeneratedProblem: MyDomain, Problem {
+		GeneratedProblem(const GeneratorParameters& parameters) {
+			checkParameter(parameters, "areas", 2);
+			checkParameter(parameters, "robots", 1);
+			const unsigned areasCount(parameters.get("areas"));
+			const unsigned firesCount(parameters.get("fires"));
+			const unsigned robotsCount(parameters.get("robots"));
+			const unsigned extinguishersCount(parameters.get("extinguishers"));
+			if (firesCount >= areasCount)
+				throw std::runtime_error("Parameter fires must be less than areas");
+			GeneratorRandom random(parameters.get("seed"));
+			
+			// areas form a random tree of adjacencies, fires burn between some adjacent areas
+			std::vector<bool> burning(areasCount, false);
+			for (unsigned i = 0; i < firesCount; ++i) {
+				unsigned area(1 + random(areasCount - 1));
+				while (burning[area])
+					area = 1 + area % (areasCount - 1);
+				burning[area] = true;
+			}
+			for (unsigned i = 0; i < areasCount; ++i) {
+				const std::string areaName(constantName("a", i));
+				add(area(areaName.c_str()));
+				if (i > 0) {
+					const std::string adjacentName(constantName("a", random(i)));
+					add(isAdjacent(adjacentName.c_str(), areaName.c_str()));
+					if (!burning[i])
+						add(isConnected(adjacentName.c_str(), areaName.c_str()));
+				}
+			}
+			for (unsigned i = 0; i < robotsCount; ++i) {
+				add(robots(constantName("r", i).c_str()));
+				add(isIn(constantName("r", i).c_str(), constantName("a", random(areasCount)).c_str()));
+			}
+			for (unsigned i = 0; i < extinguishersCount; ++i) {
+				add(extinguisher(constantName("ext", i).c_str()));
+				add(isIn(constantName("ext", i).c_str(), constantName("a", random(areasCount)).c_str()));
+			}
+			
+			const unsigned source(random(areasCount));
+			add(object("o0"));
+			add(isIn("o0", constantName("a", source).c_str()));
+			const unsigned destination((source + 1 + random(areasCount - 1)) % areasCount);
+			goal(rescue(constantName("a", destination).c_str()));
+		}
+	};
+}
+
+template<typename T>
+struct BundledProblemInstance: BundledProblem {
+	BundledProblemInstance() {}
+	BundledProblemInstance(const GeneratorParameters& parameters): problem(parameters) {}
+	
+	const Domain& getDomain() const { return problem; }
+	const Problem& getProblem() const { return problem; }
+	
+	static BundledProblem* create() { return new BundledProblemInstance<T>; }
+	static BundledProblem* generate(const GeneratorParameters& parameters) { return new BundledProblemInstance<T>(parameters); }
+	
+	T problem;
+};
+
+const BundledProblemEntry bundledProblems[] = {
+	{ "basic", BundledProblemInstance<basic::MyProblem>::create },
+	{ "jug-pouring", BundledProblemInstance<jug_pouring::MyProblem>::create },
+	{ "tower-of-hanoi", BundledProblemInstance<tower_of_hanoi::MyProblem>::create },
+	{ "robots", BundledProblemInstance<robots::MyProblem>::create },
+	{ "mini-robots", BundledProblemInstance<mini_robots::MyProblem>::create },
+	{ "rover", BundledProblemInstance<rover::MyProblem>::create },
+	{ "rescue", BundledProblemInstance<rescue::MyProblem>::create },
+	{ "rescue-numeric", BundledProblemInstance<rescue_numeric::MyProblem>::create },
+	{ "robot-proba", BundledProblemInstance<robot_proba::MyProblem>::create },
+};
+
+const size_t bundledProblemsCount = sizeof(bundledProblems) / sizeof(BundledProblemEntry);
+
+const BundledGeneratorEntry bundledGenerators[] = {
+	{ "tower-of-hanoi", "disks=5", BundledProblemInstance<tower_of_hanoi::GeneratedProblem>::generate },
+	{ "robots", "robots=2 areas=7 objects=2 seed=0", BundledProblemInstance<GeneratedRobotsProblem<robots::MyDomain> >::generate },
+	{ "mini-robots", "robots=2 areas=3 objects=2 seed=0", BundledProblemInstance<GeneratedRobotsProblem<mini_robots::MyDomain> >::generate },
+	{ "rover", "rovers=4 waypoints=10 objectives=3 cameras=3 goals=2 seed=0", BundledProblemInstance<rover::GeneratedProblem>::generate },
+	{ "rescue", "areas=6 fires=3 robots=2 extinguishers=3 seed=0", BundledProblemInstance<rescue::GeneratedProblem>::generate },
+};
+
+const size_t bundledGeneratorsCount = sizeof(bundledGenerators) / sizeof(BundledGeneratorEntry);
+
+GeneratorParameters::GeneratorParameters(const std::string& defaults, const std::string& overrides) {
+	std::istringstream defaultsStream(defaults);
+	std::string assignment;
+	while (defaultsStream >> assignment) {
+		const size_t equal(assignment.find('='));
+		values[assignment.substr(0, equal)] = std::atoi(assignment.substr(equal + 1).c_str());
+	}
+	
+	std::istringstream overridesStream(overrides);
+	while (std::getline(overridesStream, assignment, ':')) {
+		const size_t equal(assignment.find('='));
+		const std::string name(assignment.substr(0, equal));
+		if (values.find(name) == values.end())
+			throw std::runtime_error("Unknown parameter " + name);
+		std::istringstream valueStream(equal == std::string::npos ? std::string() : assignment.substr(equal + 1));
+		unsigned value;
+		if (!(valueStream >> value) || !valueStream.eof())
+			throw std::runtime_error("Invalid value for parameter " + name);
+		values[name] = value;
+	}
+}
+
+unsigned GeneratorParameters::get(const std::string& name) const {
+	const Values::const_iterator it(values.find(name));
+	if (it == values.end())
+		throw std::runtime_error("Unknown parameter " + name);
+	return it->second;
+}
+
+BundledProblem* createBundledProblem(const std::string& name) {
+	const size_t separator(name.find(':'));
+	if (separator != std::string::npos) {
+		const std::string generatorName(name.substr(0, separator));
+		for (size_t i = 0; i < bundledGeneratorsCount; ++i)
+			if (generatorName == bundledGenerators[i].name)
+				return bundledGenerators[i].create(GeneratorParameters(bundledGenerators[i].parameters, name.substr(separator + 1)));
+		throw std::runtime_error("Unknown problem generator " + generatorName);
+	}
+	for (size_t i = 0; i < bundledProblemsCount; ++i)
+		if (name == bundledProblems[i].name)
+			return bundledProblems[i].create();
+	throw std::runtime_error("Unknown problem " + name);
+}
@@ -0,0 +1,54 @@
+#ifndef BUNDLED_PROBLEMS_HPP_
+#define BUNDLED_PROBLEMS_HPP_
+
+#include <string>
+#include <map>
+#include <cstddef>
+
+struct Domain;
+struct Problem;
+
+//! a problem of the problems directory, along with its domain
+struct BundledProblem {
+	virtual ~BundledProblem() {}
+	virtual const Domain& getDomain() const = 0;
+	virtual const Problem& getProblem() const = 0;
+};
+
+struct BundledProblemEntry {
+	const char* name;
+	BundledProblem* (*create)();
+};
+
+//! all bundled problems, by name
+extern const BundledProblemEntry bundledProblems[];
+extern const size_t bundledProblemsCount;
+
+//! unsigned integer parameters of a generated problem, by name
+struct GeneratorParameters {
+	//! defaults are given as "disks=5 seed=0", overrides as "disks=8:seed=1"; throw std::runtime_error on unknown or malformed parameters
+	GeneratorParameters(const std::string& defaults, const std::string& overrides);
+	
+	unsigned get(const std::string& name) const;
+	
+private:
+	typedef std::map<std::string, unsigned> Values;
+	Values values;
+};
+
+//! a generator of instances of a bundled domain, parameterized by size and random seed
+struct BundledGeneratorEntry {
+	const char* name;
+	const char* parameters; //!< names and default values of the parameters, as "disks=5 seed=0"
+	BundledProblem* (*create)(const GeneratorParameters& parameters);
+};
+
+//! all problem generators, by name
+extern const BundledGeneratorEntry bundledGenerators[];
+extern const size_t bundledGeneratorsCount;
+
+//! return a new instance of the problem called name, throw std::runtime_error if there is none
+//! a name of the form GENERATOR:PARAM=VALUE:... returns an instance built by that generator
+BundledProblem* createBundledProblem(const std::string& name);
+
+#endif // BUNDLED_PROBLEMS_HPP_
@@ -0,0 +1,190 @@
+#include "distributed-bench.h"
+#include "distributed-bench.moc"
+#include "bundled-problems.hpp"
+#include "../core/planner9.hpp"
+#include "../distributed/planner9-distributed.h"
+#include "../distributed/discovery.h"
+#include <QCoreApplication>
+#include <QEventLoop>
+#include <QProcess>
+#include <QTimer>
+#include <QStringList>
+#include <boost/scoped_ptr.hpp>
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+
+//! slaves listen on consecutive ports from this one
+const quint16 basePort = 47000;
+//! time in ms to wait for a slave process to listen, and for the master to connect to all
+const int startTimeout = 10000;
+
+BenchRun::BenchRun(MasterPlanner9& masterPlanner, const QString& problemName, int runsCount) :
+	masterPlanner(masterPlanner),
+	problemName(problemName),
+	runsCount(runsCount),
+	runCounter(0),
+	planningDuration(0),
+	solved(false)
+{
+	connect(&masterPlanner, SIGNAL(planningStarted(const quint32&)), SLOT(planningStarted(const quint32&)));
+	connect(&masterPlanner, SIGNAL(planningSucceded(const quint32&, const Plan&)), SLOT(planningSucceded(const quint32&, const Plan&)));
+	connect(&masterPlanner, SIGNAL(planningFailed(const quint32&)), SLOT(planningFailed(const quint32&)));
+	connect(&masterPlanner, SIGNAL(planningFinished(const quint32&, const unsigned&)), SLOT(planningFinished(const quint32&, const unsigned&)));
+}
+
+void BenchRun::planningStarted(const quint32& session) {
+	planStartTime = QTime::currentTime();
+	planningDuration = 0;
+	solved = false;
+}
+
+void BenchRun::planningSucceded(const quint32& session, const Plan& plan) {
+	planningDuration = planStartTime.msecsTo(QTime::currentTime());
+	solved = true;
+}
+
+void BenchRun::planningFailed(const quint32& session) {
+	planningDuration = planStartTime.msecsTo(QTime::currentTime());
+}
+
+void BenchRun::planningFinished(const quint32& session, const unsigned& totalIterationsCount) {
+	const SearchStatistics& statistics(masterPlanner.getStatistics(session));
+	
+	quint64 peerBytes(0);
+	for (SearchStatistics::Slaves::const_iterator it = statistics.slaves.begin(); it != statistics.slaves.end(); ++it)
+		peerBytes += it->peerBytes;
+	
+	std::cout << "{\"problem\": \"" << problemName.toStdString() << "\"";
+	std::cout << ", \"slaves\": " << masterPlanner.getSlavesCount();
+	std::cout << ", \"run\": " << runCounter;
+	std::cout << ", \"solved\": " << (solved ? "true" : "false");
+	std::cout << ", \"wallTime\": " << planningDuration;
+	std::cout << ", \"iterations\": " << totalIterationsCount;
+	std::cout << ", \"nodesTransferred\": " << statistics.nodesTransferred;
+	std::cout << ", \"balanceMessages\": " << statistics.balanceMessages;
+	std::cout << ", \"reinjectedNodes\": " << statistics.reinjectedNodes;
+	std::cout << ", \"masterBytes\": " << statistics.masterBytes;
+	std::cout << ", \"peerBytes\": " << peerBytes;
+	std::cout << ", \"nodesGenerated\": " << statistics.counters.nodesGenerated;
+	std::cout << ", \"nodesPruned\": " << statistics.counters.nodesPruned;
+	std::cout << ", \"stateCacheHits\": " << statistics.counters.cacheHits;
+	std::cout << ", \"stateCacheMisses\": " << statistics.counters.cacheMisses;
+	for (size_t i = 0; i < SearchCounters::PHASES_COUNT; ++i)
+		std::cout << ", \"" << SearchCounters::phasesNames[i] << "Time\": " << statistics.counters.phasesTimes[i] / 1e6;
+	std::cout << ", \"perSlave\": [";
+	for (SearchStatistics::Slaves::const_iterator it = statistics.slaves.begin(); it != statistics.slaves.end(); ++it) {
+		if (it != statistics.slaves.begin())
+			std::cout << ", ";
+		std::cout << "{\"address\": \"" << it->address.toStdString() << "\"";
+		std::cout << ", \"iterations\": " << it->iterationCount;
+		std::cout << ", \"idleTime\": " << it->idleTime;
+		std::cout << ", \"peerBytes\": " << it->peerBytes << "}";
+	}
+	std::cout << "]}" << std::endl;
+	
+	++runCounter;
+	if (runCounter < runsCount)
+		QTimer::singleShot(0, &masterPlanner, SLOT(replan()));
+	else
+		emit finished();
+}
+
+int dumpError(char *exeName) {
+	std::cerr << "Error, usage " << exeName << " SLAVES RUNS [PROBLEM...]" << std::endl;
+	std::cerr << "Plans every given problem, by default all bundled ones, RUNS times with SLAVES local slave" << std::endl;
+	std::cerr << "processes, and prints the measures of every run as a JSON line. Problems are:";
+	for (size_t i = 0; i < bundledProblemsCount; ++i)
+		std::cerr << " " << bundledProblems[i].name;
+	std::cerr << std::endl;
+	return 1;
+}
+
+//! slave process started by the benchmark, arguments are "slave PROBLEM PORT"
+int runSlave(int argc, char* argv[]) {
+	QCoreApplication app(argc, argv);
+	
+	boost::scoped_ptr<BundledProblem> problem(createBundledProblem(argv[2]));
+	SlavePlanner9 slavePlanner(problem->getDomain(), 0, 0, 0, QHostAddress::LocalHost, atoi(argv[3]));
+	
+	// tell the benchmark that the master can connect
+	std::cout << "ready" << std::endl;
+	
+	return app.exec();
+}
+
+bool benchProblem(const QString& problemName, int slavesCount, int runsCount) {
+	boost::scoped_ptr<BundledProblem> problem(createBundledProblem(problemName.toStdString()));
+	
+	// one process per slave, for them to run concurrently as on a cluster
+	QList<QProcess*> slaves;
+	QStringList addresses;
+	bool started(true);
+	for (int i = 0; i < slavesCount && started; ++i) {
+		const quint16 port(basePort + i);
+		QProcess* slave(new QProcess);
+		slave->setStandardErrorFile("/dev/null");
+		slave->start(QCoreApplication::applicationFilePath(), QStringList() << "slave" << problemName << QString::number(port));
+		slaves.append(slave);
+		addresses.append(QString("127.0.0.1:%0").arg(port));
+		started = slave->waitForReadyRead(startTimeout);
+	}
+	
+	if (started) {
+		MasterPlanner9 masterPlanner(problem->getDomain(), 0, new StaticSlaveFinder(addresses));
+		
+		// measure the search only, not the connection of slaves
+		QTime startTime(QTime::currentTime());
+		while (int(masterPlanner.getSlavesCount()) < slavesCount && startTime.msecsTo(QTime::currentTime()) < startTimeout)
+			QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents, 100);
+		started = int(masterPlanner.getSlavesCount()) == slavesCount;
+		
+		if (started) {
+			BenchRun run(masterPlanner, problemName, runsCount);
+			QEventLoop loop;
+			QObject::connect(&run, SIGNAL(finished()), &loop, SLOT(quit()));
+			masterPlanner.plan(problem->getProblem());
+			loop.exec();
+		}
+	}
+	if (!started)
+		std::cerr << "Cannot start " << slavesCount << " slaves for " << problemName.toStdString() << std::endl;
+	
+	for (QList<QProcess*>::const_iterator it = slaves.begin(); it != slaves.end(); ++it) {
+		(*it)->kill();
+		(*it)->waitForFinished();
+		delete *it;
+	}
+	return started;
+}
+
+int runBench(int argc, char* argv[]) {
+	QCoreApplication app(argc, argv);
+	
+	const int slavesCount(atoi(argv[1]));
+	const int runsCount(atoi(argv[2]));
+	if (slavesCount <= 0 || runsCount <= 0)
+		return dumpError(argv[0]);
+	
+	QStringList problemNames;
+	for (int i = 3; i < argc; ++i)
+		problemNames.append(argv[i]);
+	if (problemNames.empty())
+		for (size_t i = 0; i < bundledProblemsCount; ++i)
+			problemNames.append(bundledProblems[i].name);
+	
+	bool success(true);
+	for (QStringList::const_iterator it = problemNames.begin(); it != problemNames.end(); ++it)
+		success = benchProblem(*it, slavesCount, runsCount) && success;
+	
+	return success ? 0 : 1;
+}
+
+int main(int argc, char* argv[]) {
+	if (argc == 4 && strcmp(argv[1], "slave") == 0)
+		return runSlave(argc, argv);
+	else if (argc >= 3)
+		return runBench(argc, argv);
+	else
+		return dumpError(argv[0]);
+}
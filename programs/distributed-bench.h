@@ -0,0 +1,37 @@
+#ifndef DISTRIBUTED_BENCH_H_
+#define DISTRIBUTED_BENCH_H_
+
+#include <QObject>
+#include <QTime>
+#include <QString>
+
+class Plan;
+class MasterPlanner9;
+
+//! repeats the planning of a problem and prints the measures of every run as a JSON line
+class BenchRun: public QObject {
+	Q_OBJECT
+
+public:
+	BenchRun(MasterPlanner9& masterPlanner, const QString& problemName, int runsCount);
+
+public slots:
+	void planningStarted(const quint32& session);
+	void planningSucceded(const quint32& session, const Plan& plan);
+	void planningFailed(const quint32& session);
+	void planningFinished(const quint32& session, const unsigned& totalIterationsCount);
+
+signals:
+	void finished();
+
+protected:
+	MasterPlanner9& masterPlanner;
+	const QString problemName;
+	const int runsCount;
+	int runCounter;
+	QTime planStartTime;
+	int planningDuration;
+	bool solved;
+};
+
+#endif // DISTRIBUTED_BENCH_H_
@@ -1,6 +1,7 @@
 //#include "distributed-client.h"
 #include <QCoreApplication>
 #include <QDBusInterface>
+#include <QDBusReply>
 #include <QStringList>
 #include <QMap>
 #include <QDBusArgument>
@@ -184,7 +185,12 @@ int main(int argc, char* argv[]) {
 	
 	// call D-Bus
 	QDBusInterface planner("ch.epfl.mobots.Planner9", "/", "ch.epfl.mobots.HTNPlanner");
-	planner.call("StartPlanning", qVariantFromValue(constantsNames), qVariantFromValue(state), qVariantFromValue(task));
+	const QDBusReply<uint> session(planner.call("StartPlanning", qVariantFromValue(constantsNames), qVariantFromValue(state), qVariantFromValue(task)));
+	if (!session.isValid()) {
+		std::cerr << "Cannot start planning: " << session.error().message().toStdString() << std::endl;
+		return 1;
+	}
+	std::cout << "Planning in session " << session.value() << std::endl;
 	
 	return 0;
 }
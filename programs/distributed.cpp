@@ -3,11 +3,13 @@
 #include "../core/planner9.hpp"
 #include "../distributed/planner9-distributed.h"
 #include "../distributed/planner9-dbus.h"
+#include "../distributed/discovery.h"
 //#include "../problems/robots.hpp"
 //#include "problems/rover.hpp"
 #include "../problems/rescue.hpp"
 #include <QApplication>
 #include <QTimer>
+#include <QFile>
 #include <QDBusMetaType>
 
 using namespace std;
@@ -18,31 +20,37 @@ Dumper::Dumper(MasterPlanner9& masterPlanner, int maxRunCount) :
 	runCounter(0),
 	maxRunCount(maxRunCount)
 {
-	connect(&masterPlanner, SIGNAL(planningStarted()), SLOT(planningStarted()));
-	connect(&masterPlanner, SIGNAL(planningSucceded(const Plan&)), SLOT(planningSucceded(const Plan&)));
-	connect(&masterPlanner, SIGNAL(planningFailed()), SLOT(planningFailed()));
-	connect(&masterPlanner, SIGNAL(planningFinished(const unsigned&)), SLOT(planningFinished(const unsigned&)));
+	connect(&masterPlanner, SIGNAL(planningStarted(const quint32&)), SLOT(planningStarted(const quint32&)));
+	connect(&masterPlanner, SIGNAL(planningSucceded(const quint32&, const Plan&)), SLOT(planningSucceded(const quint32&, const Plan&)));
+	connect(&masterPlanner, SIGNAL(planningImproved(const quint32&, const Plan&, const double&)), SLOT(planningImproved(const quint32&, const Plan&, const double&)));
+	connect(&masterPlanner, SIGNAL(planningFailed(const quint32&)), SLOT(planningFailed(const quint32&)));
+	connect(&masterPlanner, SIGNAL(planningFinished(const quint32&, const unsigned&)), SLOT(planningFinished(const quint32&, const unsigned&)));
 }
 
-void Dumper::planningStarted() {
+void Dumper::planningStarted(const quint32& session) {
 	planStartTime = QTime::currentTime();
-	std::cerr << "Starting planning" << std::endl;
+	std::cerr << "Starting planning session " << session << std::endl;
 }
 
-void Dumper::planningSucceded(const Plan& plan) {
+void Dumper::planningSucceded(const quint32& session, const Plan& plan) {
 	const int planningDuration(planStartTime.msecsTo(QTime::currentTime()));
-	std::cerr << Scope::setScope(masterPlanner.getProblemScope());
+	std::cerr << Scope::setScope(masterPlanner.getProblemScope(session));
 	std::cerr << "After " << planningDuration << " ms, plan:\n" << plan << std::endl;
 	statsFile << planningDuration;
 }
 
-void Dumper::planningFailed() {
+void Dumper::planningImproved(const quint32& session, const Plan& plan, const double& cost) {
+	const int planningDuration(planStartTime.msecsTo(QTime::currentTime()));
+	std::cerr << "After " << planningDuration << " ms, plan of cost " << cost << " found, searching for better ones" << std::endl;
+}
+
+void Dumper::planningFailed(const quint32& session) {
 	const int planningDuration(planStartTime.msecsTo(QTime::currentTime()));
 	std::cerr << "After " << planningDuration << " ms, no plan." << std::endl;
 	statsFile << planningDuration;
 }
 
-void Dumper::planningFinished(const unsigned& totalIterationsCount) {
+void Dumper::planningFinished(const quint32& session, const unsigned& totalIterationsCount) {
 	std::cerr << "Planning finished, total Iterations " << totalIterationsCount << std::endl;
 	statsFile << " " << totalIterationsCount << std::endl;
 	if (maxRunCount) {
@@ -58,7 +66,12 @@ void Dumper::planningFinished(const unsigned& totalIterationsCount) {
 }
 
 int dumpError(char *exeName) {
-	std::cerr << "Error, usage " << exeName << " slave/master SLAVE0HOST SLAVE0PORT ... SLAVE1HOST SLAVE1PORT" << std::endl;
+	std::cerr << "Error, usage " << exeName << " slave [PORT [ADDRESS [THREADS]]] | master [RUNCOUNT [first|anytime [SLAVES [LOCALTHREADS]]]]" << std::endl;
+	std::cerr << "Without PORT, or without SLAVES or with SLAVES being avahi, slaves are found through Avahi and planning" << std::endl;
+	std::cerr << "is started through D-Bus. Otherwise, slaves listen on ADDRESS (default 127.0.0.1) and PORT, and the master" << std::endl;
+	std::cerr << "connects to SLAVES, a file or a comma-separated list of host:port, and plans the built-in problem." << std::endl;
+	std::cerr << "A slave serves any number of masters with THREADS worker threads, by default one per core." << std::endl;
+	std::cerr << "With LOCALTHREADS, the master searches too on that many threads, 0 meaning one per core." << std::endl;
 	return 1;
 }
 
@@ -67,8 +80,16 @@ int runSlave(int argc, char* argv[]) {
 	
 	MyProblem problem;
 	
+	// with a fixed port, the master is given the address of the slave
+	if (argc >= 3) {
+		const QHostAddress address(QString(argc >= 4 ? argv[3] : "127.0.0.1"));
+		const size_t threadsCount(argc >= 5 ? atoi(argv[4]) : 0);
+		SlavePlanner9 slavePlanner(problem, 0, threadsCount, 0, address, atoi(argv[2]));
+		return app.exec();
+	}
+	
 	//SlavePlanner9 slavePlanner(problem, &std::cerr);
-	SlavePlanner9 slavePlanner(problem);
+	SlavePlanner9 slavePlanner(problem, 0, 0, new AvahiSlaveAnnouncer);
 	
 	return app.exec();
 }
@@ -76,24 +97,42 @@ int runSlave(int argc, char* argv[]) {
 int runMaster(int argc, char* argv[]) {
 	QCoreApplication app(argc, argv);
 	
-	MyDomain domain;
+	MyProblem problem;
 	
-	//MasterPlanner9 masterPlanner(problem, &std::cerr);
-	MasterPlanner9 masterPlanner(domain);
+	SlaveFinder* finder;
+	const bool staticSlaves(argc >= 5 && strcmp(argv[4], "avahi") != 0);
+	if (staticSlaves) {
+		const QString slaves(argv[4]);
+		if (QFile::exists(slaves))
+			finder = StaticSlaveFinder::fromFile(slaves);
+		else
+			finder = new StaticSlaveFinder(slaves.split(',', QString::SkipEmptyParts));
+	} else {
+		finder = new AvahiSlaveFinder;
+	}
+	
+	//MasterPlanner9 masterPlanner(problem, &std::cerr, finder);
+	MasterPlanner9 masterPlanner(problem, 0, finder);
 	int maxRunCount(0);
 	if (argc >= 3)
 		maxRunCount = atoi(argv[2]);
+	if (argc >= 4)
+		masterPlanner.setAnytime(strcmp(argv[3], "anytime") == 0);
+	// the master can plan without any slave
+	if (argc >= 6)
+		masterPlanner.startLocalSearch(atoi(argv[5]));
 	Dumper dumper(masterPlanner, maxRunCount);
 	
+	if (staticSlaves) {
+		// no bus to receive problems from, plan the built-in one
+		masterPlanner.plan(problem);
+		return app.exec();
+	}
+	
 	MasterAdaptor::registerDBusTypes();
 	
 	new MasterAdaptor(&masterPlanner);
 	
-	/*
-	start plan only using dbus now  
-	masterPlanner.plan(problem);
-	*/
-	
 	/*
 	Use purely avahi now
 	for (int i = 2; i < argc; i+=2) {
@@ -15,10 +15,11 @@ public:
 	Dumper(MasterPlanner9& masterPlanner, int maxRunCount);
 	
 public slots:
-	void planningStarted();
-	void planningSucceded(const Plan& plan);
-	void planningFailed();
-	void planningFinished(const unsigned& totalIterationsCount);
+	void planningStarted(const quint32& session);
+	void planningSucceded(const quint32& session, const Plan& plan);
+	void planningImproved(const quint32& session, const Plan& plan, const double& cost);
+	void planningFailed(const quint32& session);
+	void planningFinished(const quint32& session, const unsigned& totalIterationsCount);
 
 protected:
 	QTime planStartTime;
@@ -0,0 +1,348 @@
+#include "bundled-problems.hpp"
+#include "../core/planner9.hpp"
+#include "../core/problem.hpp"
+#include "../core/domain.hpp"
+#include "../core/costs.hpp"
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <iostream>
+#include <cstdlib>
+#include <cmath>
+#include <sstream>
+
+using namespace std;
+
+//! results of the kernels are stored there, so that they are not optimized out
+volatile size_t kernelsResult;
+
+//! nodes kept from a search, as inputs for the kernels
+typedef vector<const Planner9::SearchNode*> Samples;
+
+//! simple planner that keeps a regularly spaced subset of the nodes it generates, and gives access to ground()
+struct SamplingPlanner9: SimplePlanner9 {
+	SamplingPlanner9(const Problem& problem, const CostFunction* costFunction, size_t maxSamplesCount);
+	~SamplingPlanner9();
+
+	virtual void pushNode(SearchNode* node);
+
+	size_t groundAll(const SearchNode* node);
+	size_t getConstantsCount() const { return problemScope.getSize(); }
+
+	const size_t maxSamplesCount;
+	size_t stride; //!< keep one node out of stride
+	size_t pushedCount;
+	Samples samples;
+};
+
+SamplingPlanner9::SamplingPlanner9(const Problem& problem, const CostFunction* costFunction, size_t maxSamplesCount):
+	SimplePlanner9(problem.scope, costFunction),
+	maxSamplesCount(maxSamplesCount),
+	stride(1),
+	pushedCount(0) {
+
+	Planner9::pushNode(Plan(), problem.network, problemScope.getSize(), CNF(), problem.state, 0);
+}
+
+SamplingPlanner9::~SamplingPlanner9() {
+	for (Samples::const_iterator it = samples.begin(); it != samples.end(); ++it)
+		delete *it;
+}
+
+void SamplingPlanner9::pushNode(SearchNode* node) {
+	if (pushedCount++ % stride == 0) {
+		samples.push_back(new SearchNode(*node));
+		// keep the samples spread over the whole search by halving them when full
+		if (samples.size() >= 2 * maxSamplesCount) {
+			Samples kept;
+			for (size_t i = 0; i < samples.size(); ++i) {
+				if (i % 2 == 0)
+					kept.push_back(samples[i]);
+				else
+					delete samples[i];
+			}
+			samples.swap(kept);
+			stride *= 2;
+		}
+	}
+	SimplePlanner9::pushNode(node);
+}
+
+size_t SamplingPlanner9::groundAll(const SearchNode* node) {
+	VariablesSet variables;
+	for (Variables::const_iterator it = node->preconditions.variables.begin(); it != node->preconditions.variables.end(); ++it)
+		if (it->index >= problemScope.getSize())
+			variables.insert(*it);
+	return ground(variables, node->preconditions, node->state, node->allocatedVariablesCount).size();
+}
+
+//! a kernel processes all samples and returns a value depending on its results
+struct Kernel {
+	virtual ~Kernel() {}
+	virtual const char* getName() const = 0;
+	virtual size_t run(SamplingPlanner9& planner) = 0;
+	//! number of calls to the measured function per run
+	virtual size_t getCallsCount(SamplingPlanner9& planner) = 0;
+};
+
+//! kernel applied to every sample
+struct SampleKernel: Kernel {
+	virtual size_t run(SamplingPlanner9& planner) {
+		size_t result(0);
+		for (Samples::const_iterator it = planner.samples.begin(); it != planner.samples.end(); ++it)
+			result += run(planner, **it);
+		return result;
+	}
+	virtual size_t getCallsCount(SamplingPlanner9& planner) {
+		return planner.samples.size();
+	}
+	virtual size_t run(SamplingPlanner9& planner, const Planner9::SearchNode& node) = 0;
+};
+
+struct GroundKernel: SampleKernel {
+	const char* getName() const { return "ground"; }
+	size_t run(SamplingPlanner9& planner, const Planner9::SearchNode& node) {
+		return planner.groundAll(&node);
+	}
+};
+
+//! includes the copy of the preconditions, measured by cnf-copy
+struct SimplifyKernel: SampleKernel {
+	const char* getName() const { return "simplify"; }
+	size_t run(SamplingPlanner9& planner, const Planner9::SearchNode& node) {
+		CNF preconditions(node.preconditions);
+		return preconditions.simplify(node.state, planner.getConstantsCount(), node.allocatedVariablesCount) ? 1 : 0;
+	}
+};
+
+struct CNFCopyKernel: SampleKernel {
+	const char* getName() const { return "cnf-copy"; }
+	size_t run(SamplingPlanner9&, const Planner9::SearchNode& node) {
+		CNF preconditions(node.preconditions);
+		return preconditions.literals.size();
+	}
+};
+
+//! applies the effects of the last action of the plan of every sample, when it is ground
+struct ApplyKernel: Kernel {
+	const char* getName() const { return "apply"; }
+	size_t run(SamplingPlanner9& planner) {
+		size_t result(0);
+		for (Samples::const_iterator it = planner.samples.begin(); it != planner.samples.end(); ++it) {
+			const Action* action(getGroundAction(planner, **it));
+			if (action) {
+				const Task& task((*it)->plan.back());
+				const State newState(action->getEffects().apply((*it)->state, task.getSubstitution(action->getScope().getSize(), (*it)->allocatedVariablesCount)));
+				result += newState.functions.size();
+			}
+		}
+		return result;
+	}
+	size_t getCallsCount(SamplingPlanner9& planner) {
+		size_t count(0);
+		for (Samples::const_iterator it = planner.samples.begin(); it != planner.samples.end(); ++it)
+			if (getGroundAction(planner, **it))
+				++count;
+		return count;
+	}
+	static const Action* getGroundAction(SamplingPlanner9& planner, const Planner9::SearchNode& node) {
+		if (node.plan.empty())
+			return 0;
+		const Task& task(node.plan.back());
+		const Action* action(dynamic_cast<const Action*>(task.head));
+		if (!action || action->getScope().getSize() != task.params.size() || !task.params.allLessThan(planner.getConstantsCount()))
+			return 0;
+		return action;
+	}
+};
+
+struct NetworkCopyKernel: SampleKernel {
+	const char* getName() const { return "network-copy"; }
+	size_t run(SamplingPlanner9&, const Planner9::SearchNode& node) {
+		TaskNetwork network(node.network);
+		return network.first.size();
+	}
+};
+
+//! includes the copy of the network, measured by network-copy
+struct NetworkEraseKernel: SampleKernel {
+	const char* getName() const { return "network-erase"; }
+	size_t run(SamplingPlanner9&, const Planner9::SearchNode& node) {
+		TaskNetwork network(node.network);
+		if (!network.first.empty())
+			network.erase(0);
+		return network.first.size();
+	}
+};
+
+//! replaces the first task by the decomposition of the first alternative of its method, includes the copy of the network
+struct NetworkReplaceKernel: SampleKernel {
+	const char* getName() const { return "network-replace"; }
+	size_t run(SamplingPlanner9&, const Planner9::SearchNode& node) {
+		TaskNetwork network(node.network);
+		if (!network.first.empty()) {
+			const Method* method(dynamic_cast<const Method*>(network.first[0]->task.head));
+			if (method && !method->alternatives.empty())
+				network.replace(0, method->alternatives[0].tasks);
+		}
+		return network.first.size();
+	}
+};
+
+struct StateCopyKernel: SampleKernel {
+	const char* getName() const { return "state-copy"; }
+	size_t run(SamplingPlanner9&, const Planner9::SearchNode& node) {
+		const State state(node.state);
+		return state.functions.size();
+	}
+};
+
+//! range of the parameters of every relation literal of the preconditions
+struct GetRangeKernel: Kernel {
+	const char* getName() const { return "get-range"; }
+	size_t run(SamplingPlanner9& planner) {
+		size_t result(0);
+		for (Samples::const_iterator it = planner.samples.begin(); it != planner.samples.end(); ++it) {
+			const CNF& preconditions((*it)->preconditions);
+			for (NormalForm::Literals::const_iterator jt = preconditions.literals.begin(); jt != preconditions.literals.end(); ++jt) {
+				const Relation* relation(dynamic_cast<const Relation*>(jt->function));
+				if (relation)
+					result += relation->getRange(preconditions.getParams(*jt), (*it)->state, planner.getConstantsCount()).size();
+			}
+		}
+		return result;
+	}
+	size_t getCallsCount(SamplingPlanner9& planner) {
+		size_t count(0);
+		for (Samples::const_iterator it = planner.samples.begin(); it != planner.samples.end(); ++it) {
+			const CNF& preconditions((*it)->preconditions);
+			for (NormalForm::Literals::const_iterator jt = preconditions.literals.begin(); jt != preconditions.literals.end(); ++jt)
+				if (dynamic_cast<const Relation*>(jt->function))
+					++count;
+		}
+		return count;
+	}
+};
+
+//! median, minimum and median absolute deviation of the time per call, in ns
+struct Measure {
+	double median;
+	double minimum;
+	double deviation;
+};
+
+static double getMedian(vector<double> values) {
+	sort(values.begin(), values.end());
+	const size_t middle(values.size() / 2);
+	return values.size() % 2 ? values[middle] : (values[middle - 1] + values[middle]) / 2;
+}
+
+//! run the kernel once to warm caches up, then repetitionsCount times
+Measure measure(Kernel& kernel, SamplingPlanner9& planner, size_t repetitionsCount, size_t callsCount, size_t& sink) {
+	sink += kernel.run(planner);
+	vector<double> times;
+	for (size_t i = 0; i < repetitionsCount; ++i) {
+		const boost::posix_time::ptime startTime(boost::posix_time::microsec_clock::universal_time());
+		sink += kernel.run(planner);
+		const boost::posix_time::time_duration duration(boost::posix_time::microsec_clock::universal_time() - startTime);
+		times.push_back(duration.total_microseconds() * 1000. / callsCount);
+	}
+
+	Measure result;
+	result.median = getMedian(times);
+	result.minimum = *min_element(times.begin(), times.end());
+	vector<double> deviations;
+	for (vector<double>::const_iterator it = times.begin(); it != times.end(); ++it)
+		deviations.push_back(fabs(*it - result.median));
+	result.deviation = getMedian(deviations);
+	return result;
+}
+
+int dumpError(char *exeName) {
+	cerr << "Error, usage " << exeName << " [-r REPETITIONS] [-s SAMPLES] [PROBLEM...]" << endl;
+	cerr << "Times core kernels on up to SAMPLES nodes taken from the search of every given problem, by default" << endl;
+	cerr << "all of them, and prints the time per call in ns as JSON lines. Problems are:";
+	for (size_t i = 0; i < bundledProblemsCount; ++i)
+		cerr << " " << bundledProblems[i].name;
+	cerr << endl;
+	return 1;
+}
+
+int main(int argc, char* argv[]) {
+	size_t repetitionsCount(15);
+	size_t maxSamplesCount(1000);
+	vector<string> problems;
+	for (int i = 1; i < argc; ++i) {
+		const string arg(argv[i]);
+		if (arg[0] != '-') {
+			problems.push_back(arg);
+			continue;
+		}
+		if (i + 1 >= argc)
+			return dumpError(argv[0]);
+		const int value(atoi(argv[++i]));
+		if (arg == "-r" && value > 0)
+			repetitionsCount = value;
+		else if (arg == "-s" && value > 0)
+			maxSamplesCount = value;
+		else
+			return dumpError(argv[0]);
+	}
+	if (problems.empty())
+		for (size_t i = 0; i < bundledProblemsCount; ++i)
+			problems.push_back(bundledProblems[i].name);
+
+	GroundKernel groundKernel;
+	SimplifyKernel simplifyKernel;
+	CNFCopyKernel cnfCopyKernel;
+	ApplyKernel applyKernel;
+	NetworkCopyKernel networkCopyKernel;
+	NetworkEraseKernel networkEraseKernel;
+	NetworkReplaceKernel networkReplaceKernel;
+	StateCopyKernel stateCopyKernel;
+	GetRangeKernel getRangeKernel;
+	Kernel* kernels[] = {
+		&groundKernel, &simplifyKernel, &cnfCopyKernel, &applyKernel, &networkCopyKernel,
+		&networkEraseKernel, &networkReplaceKernel, &stateCopyKernel, &getRangeKernel
+	};
+	const size_t kernelsCount(sizeof(kernels) / sizeof(Kernel*));
+
+	size_t sink(0);
+	for (vector<string>::const_iterator it = problems.begin(); it != problems.end(); ++it) {
+		boost::scoped_ptr<BundledProblem> problem;
+		try {
+			problem.reset(createBundledProblem(*it));
+		} catch (const std::runtime_error& e) {
+			cerr << e.what() << endl;
+			return dumpError(argv[0]);
+		}
+
+		// capture the inputs of the kernels from a real search
+		AlternativesCost alternativesCost;
+		SamplingPlanner9 planner(problem->getProblem(), &alternativesCost, maxSamplesCount);
+		// the planner reports on the standard output, which is kept for results
+		ostringstream plannerOutput;
+		streambuf* resultsBuffer(cout.rdbuf(plannerOutput.rdbuf()));
+		planner.plan();
+		cout.rdbuf(resultsBuffer);
+
+		for (size_t i = 0; i < kernelsCount; ++i) {
+			const size_t callsCount(kernels[i]->getCallsCount(planner));
+			if (callsCount == 0)
+				continue;
+			const Measure result(measure(*kernels[i], planner, repetitionsCount, callsCount, sink));
+			cout << "{\"problem\": \"" << *it << "\"";
+			cout << ", \"kernel\": \"" << kernels[i]->getName() << "\"";
+			cout << ", \"calls\": " << callsCount;
+			cout << ", \"repetitions\": " << repetitionsCount;
+			cout << ", \"medianNs\": " << result.median;
+			cout << ", \"minNs\": " << result.minimum;
+			cout << ", \"madNs\": " << result.deviation << "}" << endl;
+		}
+	}
+
+	kernelsResult = sink;
+	return 0;
+}
@@ -48,5 +48,6 @@ int main(int argc, char* argv[]) {
 	} else {
 		std::cout << "no plan." << std::endl;
 	}
+	std::cout << planner.getCounters();
 	return 0;
 }
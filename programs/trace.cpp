@@ -0,0 +1,238 @@
+#include "../core/trace.hpp"
+#include <boost/cstdint.hpp>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+#include <string>
+#include <map>
+
+using namespace std;
+
+//! what the trace tells about a node
+struct TracedNode {
+	TracedNode(): parentId(0), depth(0), expansionsCount(0), useful(false) {}
+
+	boost::uint64_t parentId;
+	size_t depth;
+	size_t expansionsCount;
+	bool useful; //!< whether a plan was found from the node or one of its descendants
+};
+
+//! what the trace tells about a task head
+struct TracedHead {
+	TracedHead(): isAction(false), generatedCount(0), failuresCount(0) {}
+
+	bool isAction;
+	string name;
+	size_t generatedCount; //!< children produced by decomposing or applying it
+	size_t failuresCount; //!< decompositions or applications whose preconditions cannot hold
+};
+
+//! counts of nodes at a given depth of the search tree
+struct DepthCounts {
+	DepthCounts(): generated(0), expanded(0), pruned(0) {}
+
+	size_t generated;
+	size_t expanded;
+	size_t pruned;
+};
+
+typedef map<boost::uint64_t, TracedNode> TracedNodes;
+typedef map<boost::uint64_t, TracedHead> TracedHeads;
+typedef map<boost::uint64_t, size_t> SignaturesCounts;
+typedef vector<DepthCounts> DepthsCounts;
+
+struct TraceAnalysis {
+	TraceAnalysis();
+
+	void add(const SearchTraceReader::Event& event);
+	void markUseful(boost::uint64_t id);
+	void print(ostream& os) const;
+
+	TracedNodes nodes;
+	TracedHeads heads;
+	SignaturesCounts signatures;
+	DepthsCounts depths;
+	size_t eventsCount;
+	size_t generatedCount;
+	size_t expansionsCount;
+	size_t goalsCount;
+	size_t prunedCount;
+	size_t failuresCount;
+	boost::uint64_t duration;
+	boost::uint64_t firstGoalTime;
+	double bestCost;
+};
+
+TraceAnalysis::TraceAnalysis():
+	eventsCount(0),
+	generatedCount(0),
+	expansionsCount(0),
+	goalsCount(0),
+	prunedCount(0),
+	failuresCount(0),
+	duration(0),
+	firstGoalTime(0),
+	bestCost(0) {
+}
+
+void TraceAnalysis::add(const SearchTraceReader::Event& event) {
+	++eventsCount;
+	if (event.type != TRACE_HEAD)
+		duration = max(duration, event.time);
+
+	switch (event.type) {
+		case TRACE_HEAD: {
+			TracedHead& head(heads[event.headId]);
+			head.isAction = event.isAction;
+			head.name = event.name;
+		} break;
+
+		case TRACE_GENERATE: {
+			++generatedCount;
+			TracedNode& node(nodes[event.id]);
+			node.parentId = event.parentId;
+			// parents are always traced before their children, but may come from elsewhere
+			TracedNodes::const_iterator parentIt(nodes.find(event.parentId));
+			node.depth = parentIt == nodes.end() ? 0 : parentIt->second.depth + 1;
+			if (depths.size() <= node.depth)
+				depths.resize(node.depth + 1);
+			++depths[node.depth].generated;
+			if (event.headId)
+				++heads[event.headId].generatedCount;
+		} break;
+
+		case TRACE_EXPAND: {
+			++expansionsCount;
+			TracedNode& node(nodes[event.id]);
+			++node.expansionsCount;
+			if (depths.size() <= node.depth)
+				depths.resize(node.depth + 1);
+			++depths[node.depth].expanded;
+			++signatures[event.signature];
+		} break;
+
+		case TRACE_GOAL: {
+			if (goalsCount == 0 || event.cost < bestCost)
+				bestCost = event.cost;
+			if (goalsCount == 0)
+				firstGoalTime = event.time;
+			++goalsCount;
+			markUseful(event.id);
+		} break;
+
+		case TRACE_PRUNE: {
+			++prunedCount;
+			TracedNodes::const_iterator it(nodes.find(event.id));
+			if (it != nodes.end())
+				++depths[it->second.depth].pruned;
+		} break;
+
+		case TRACE_FAIL: {
+			++failuresCount;
+			++heads[event.headId].failuresCount;
+		} break;
+
+		default: break;
+	}
+}
+
+void TraceAnalysis::markUseful(boost::uint64_t id) {
+	// stop at ancestors already marked by a previous goal
+	while (id) {
+		TracedNodes::iterator it(nodes.find(id));
+		if (it == nodes.end() || it->second.useful)
+			return;
+		it->second.useful = true;
+		id = it->second.parentId;
+	}
+}
+
+//! ratio as a percentage, 0 if there is nothing to compare to
+static double percent(size_t part, size_t total) {
+	return total ? 100. * part / total : 0;
+}
+
+static bool isHeadMoreGenerative(const TracedHeads::value_type* a, const TracedHeads::value_type* b) {
+	return a->second.generatedCount > b->second.generatedCount;
+}
+
+void TraceAnalysis::print(ostream& os) const {
+	os << "events: " << eventsCount << " over " << duration / 1e6 << " s" << endl;
+	os << "nodes: " << generatedCount << " generated, " << expansionsCount << " expansions, ";
+	os << prunedCount << " pruned, " << failuresCount << " preconditions failures" << endl;
+	if (goalsCount)
+		os << "plans: " << goalsCount << ", first after " << firstGoalTime / 1e6 << " s, best cost " << bestCost << endl;
+	else
+		os << "plans: none" << endl;
+
+	// wasted work: expansions of nodes from which no plan was found
+	size_t usefulExpansionsCount(0);
+	size_t reexpandedNodesCount(0);
+	for (TracedNodes::const_iterator it = nodes.begin(); it != nodes.end(); ++it) {
+		if (it->second.useful)
+			usefulExpansionsCount += it->second.expansionsCount;
+		if (it->second.expansionsCount > 1)
+			++reexpandedNodesCount;
+	}
+	const size_t wastedCount(expansionsCount - usefulExpansionsCount);
+	os << "wasted expansions: " << wastedCount << " (" << percent(wastedCount, expansionsCount) << "%) not leading to a plan" << endl;
+
+	// re-expansions: nodes of identical content expanded several times
+	size_t duplicatesCount(0);
+	size_t maxDuplicates(0);
+	for (SignaturesCounts::const_iterator it = signatures.begin(); it != signatures.end(); ++it) {
+		duplicatesCount += it->second - 1;
+		maxDuplicates = max(maxDuplicates, it->second);
+	}
+	os << "re-expansions: " << duplicatesCount << " (" << percent(duplicatesCount, expansionsCount) << "%) of " << signatures.size() << " distinct nodes, ";
+	os << "at most " << maxDuplicates << " times the same, " << reexpandedNodesCount << " nodes expanded more than once" << endl;
+
+	os << endl << "depth\tgenerated\texpanded\tpruned" << endl;
+	for (size_t i = 0; i < depths.size(); ++i)
+		os << i << "\t" << depths[i].generated << "\t" << depths[i].expanded << "\t" << depths[i].pruned << endl;
+
+	vector<const TracedHeads::value_type*> sortedHeads;
+	for (TracedHeads::const_iterator it = heads.begin(); it != heads.end(); ++it)
+		sortedHeads.push_back(&*it);
+	stable_sort(sortedHeads.begin(), sortedHeads.end(), isHeadMoreGenerative);
+	os << endl << "head\tkind\tgenerated\tfailures" << endl;
+	for (size_t i = 0; i < sortedHeads.size(); ++i) {
+		const TracedHead& head(sortedHeads[i]->second);
+		os << head.name << "\t" << (head.isAction ? "action" : "method") << "\t" << head.generatedCount << "\t" << head.failuresCount << endl;
+	}
+}
+
+int dumpError(char *exeName) {
+	cerr << "Error, usage " << exeName << " TRACE" << endl;
+	cerr << "Summarizes a search trace written by p9bench -T: totals, depth profile, wasted work, re-expansions and activity of task heads." << endl;
+	return 1;
+}
+
+int main(int argc, char* argv[]) {
+	if (argc != 2)
+		return dumpError(argv[0]);
+
+	ifstream file(argv[1], ios::binary);
+	if (!file) {
+		cerr << "Cannot open " << argv[1] << endl;
+		return 1;
+	}
+
+	TraceAnalysis analysis;
+	try {
+		SearchTraceReader reader(file);
+		SearchTraceReader::Event event;
+		while (reader.read(event))
+			analysis.add(event);
+	} catch (const std::runtime_error& e) {
+		// still report what could be read
+		cerr << argv[1] << ": " << e.what() << endl;
+		analysis.print(cout);
+		return 1;
+	}
+	analysis.print(cout);
+	return 0;
+}
@@ -0,0 +1,138 @@
+#include "../programs/bundled-problems.hpp"
+#include "../core/planner9.hpp"
+#include "../core/problem.hpp"
+#include "../core/codec.hpp"
+#include "../core/domain.hpp"
+#include "../core/costs.hpp"
+#include <boost/scoped_ptr.hpp>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <iostream>
+#include <cstdlib>
+#include <stdexcept>
+
+using namespace std;
+
+typedef BinaryEncoder::Buffer Buffer;
+typedef vector<Buffer> Buffers;
+
+static int failures(0);
+
+static void check(bool condition, const string& what) {
+	if (!condition) {
+		cerr << "FAILED: " << what << endl;
+		++failures;
+	}
+}
+
+//! simple planner that checks that the first nodes it generates decode back, and keeps their encoding
+struct EncodingPlanner9: SimplePlanner9 {
+	EncodingPlanner9(const Problem& problem, const Domain& domain, const CostFunction* costFunction, bool withStates, size_t maxNodesCount):
+		SimplePlanner9(problem, costFunction),
+		domain(domain),
+		withStates(withStates),
+		maxNodesCount(maxNodesCount) {
+	}
+	
+	virtual void pushNode(SearchNode* node) {
+		if (encoded.size() < maxNodesCount) {
+			// a dictionary per node, for every node to be decodable on its own
+			StateDictionary states;
+			BinaryEncoder encoder(domain, withStates ? &states : 0);
+			encoder.write(*node);
+			encoded.push_back(encoder.buffer);
+			checkDecoding(*node, encoder.buffer);
+		}
+		SimplePlanner9::pushNode(node);
+	}
+	
+	void checkDecoding(const SearchNode& node, const BinaryEncoder::Buffer& buffer) {
+		// networks are ordered by the addresses of their nodes, so compare their contents and not their encodings
+		StateDictionary states;
+		BinaryDecoder decoder(domain, &buffer[0], buffer.size(), withStates ? &states : 0);
+		const SearchNode decoded(decoder.read<SearchNode>());
+		check(decoder.atEnd(), "node is decoded entirely");
+		check(decoded.plan.size() == node.plan.size(), "decoded node has the same plan");
+		check(decoded.network.first.size() == node.network.first.size() && decoded.network.predecessors.size() == node.network.predecessors.size(), "decoded node has the same network");
+		check(decoded.allocatedVariablesCount == node.allocatedVariablesCount, "decoded node has the same variables");
+		check(decoded.preconditions.literals.size() == node.preconditions.literals.size(), "decoded node has the same preconditions");
+		check(decoded.state.functions.size() == node.state.functions.size(), "decoded node has the same state");
+		check(decoded.pathCost == node.pathCost && decoded.heuristicCost == node.heuristicCost, "decoded node has the same costs");
+	}
+	
+	const Domain& domain;
+	const bool withStates;
+	const size_t maxNodesCount;
+	Buffers encoded;
+};
+
+//! decode size bytes of node, return false if the decoder rejected them
+static bool decode(const Domain& domain, const Buffer& node, size_t size, bool withStates) {
+	StateDictionary states;
+	BinaryDecoder decoder(domain, size ? &node[0] : 0, size, withStates ? &states : 0);
+	try {
+		decoder.read<Planner9::SearchNode>();
+		return decoder.atEnd();
+	} catch (const std::runtime_error&) {
+		return false;
+	}
+}
+
+static void testNodes(const string& problemName, const Domain& domain, const Buffers& nodes, bool withStates) {
+	const string what(problemName + (withStates ? " with states dictionary" : ""));
+	for (Buffers::const_iterator it = nodes.begin(); it != nodes.end(); ++it) {
+		const Buffer& node(*it);
+		// large nodes are only cut and corrupted at some positions, to bound the time of the test
+		const size_t step(std::max<size_t>(node.size() / 64, 1));
+		
+		// every strict prefix lacks at least the costs
+		for (size_t size = 0; size < node.size(); size += step)
+			check(!decode(domain, node, size, withStates), what + ": truncated node is rejected");
+		
+		// corrupt bytes may decode to another valid node, but must never crash, leak or allocate unbounded memory
+		const unsigned char corruptions[] = { 0x00, 0x01, 0x7f, 0x80, 0xff };
+		const size_t corruptionsCount(sizeof(corruptions) / sizeof(unsigned char));
+		for (size_t i = 0; i < node.size(); i += step) {
+			for (size_t j = 0; j < corruptionsCount; ++j) {
+				Buffer corrupt(node);
+				corrupt[i] = corruptions[j];
+				try {
+					decode(domain, corrupt, corrupt.size(), withStates);
+				} catch (const std::exception& e) {
+					check(false, what + ": corrupt node throws " + e.what());
+				}
+			}
+		}
+	}
+}
+
+//! functions only used in expressions are not registered in domains, so states using them cannot be encoded
+static bool isEncodable(const BundledProblem& problem) {
+	const State::Functions& functions(problem.getProblem().state.functions);
+	for (State::Functions::const_iterator it = functions.begin(); it != functions.end(); ++it)
+		if (problem.getDomain().getRelationIndex(it->first) == (size_t)-1)
+			return false;
+	return true;
+}
+
+int main() {
+	AlternativesCost alternativesCost;
+	for (size_t i = 0; i < bundledProblemsCount; ++i) {
+		const string problemName(bundledProblems[i].name);
+		boost::scoped_ptr<BundledProblem> problem(bundledProblems[i].create());
+		if (!isEncodable(*problem))
+			continue;
+		for (int withStates = 0; withStates < 2; ++withStates) {
+			EncodingPlanner9 planner(problem->getProblem(), problem->getDomain(), &alternativesCost, withStates, 4);
+			planner.plan(100);
+			check(!planner.encoded.empty(), problemName + ": planner generates nodes");
+			testNodes(problemName, problem->getDomain(), planner.encoded, withStates);
+		}
+	}
+	
+	if (failures)
+		return EXIT_FAILURE;
+	cout << "All tests passed" << endl;
+	return EXIT_SUCCESS;
+}
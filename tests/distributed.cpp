@@ -0,0 +1,95 @@
+#include "../problems/basic.hpp"
+#include "../programs/bundled-problems.hpp"
+#include "../distributed/planner9-distributed.h"
+#include <QCoreApplication>
+#include <QSignalSpy>
+#include <QTime>
+#include <boost/scoped_ptr.hpp>
+#include <iostream>
+#include <cstdlib>
+
+using namespace std;
+
+//! the swap of the basic domain drops kiwi, which cannot be dropped again; built on the domain of another problem for a master to plan both
+struct UnsolvableProblem: Problem {
+	UnsolvableProblem(MyDomain& domain) {
+		add(domain.have("kiwi"));
+		add(domain.provide("toto", "banjo"));
+		goal(domain.swap("kiwi", "banjo") >> domain.drop("kiwi"));
+	}
+};
+
+//! time in ms after which the sessions are considered stuck
+static const int timeout = 30000;
+
+static int failures(0);
+
+static void check(bool condition, const char* what) {
+	if (!condition) {
+		cerr << "FAILED: " << what << endl;
+		++failures;
+	}
+}
+
+//! process events until count signals are recorded by spy or until timeout
+static void waitFor(const QSignalSpy& spy, int count) {
+	const QTime startTime(QTime::currentTime());
+	while (spy.count() < count && startTime.msecsTo(QTime::currentTime()) < timeout)
+		QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents, 100);
+}
+
+//! the sessions of a master share the pool of its slaves, so one that runs out of nodes must fail while another searches
+static void testConcurrentSessionsEnd() {
+	MyProblem problem;
+	UnsolvableProblem unsolvableProblem(problem);
+	MasterPlanner9 master(problem);
+	QSignalSpy failed(&master, SIGNAL(planningFailed(const quint32&)));
+	QSignalSpy finished(&master, SIGNAL(planningFinished(const quint32&, const unsigned&)));
+	
+	// every session gets a slot per thread of the local slave
+	master.startLocalSearch(2);
+	master.plan(problem);
+	const quint32 unsolvableSession(master.plan(unsolvableProblem));
+	
+	waitFor(finished, 2);
+	check(finished.count() == 2, "both sessions finish");
+	check(failed.count() == 1, "one session fails");
+	check(!failed.empty() && failed.first().first().toUInt() == unsolvableSession, "the session without plan fails");
+}
+
+//! a slave leaving while the master moves nodes from or to it must neither stop balancing nor the session
+static void testPeerLeavingDuringTransfer() {
+	boost::scoped_ptr<BundledProblem> bundled(createBundledProblem("tower-of-hanoi:disks=6"));
+	const Domain& domain(bundled->getDomain());
+	MasterPlanner9 master(domain);
+	QSignalSpy failed(&master, SIGNAL(planningFailed(const quint32&)));
+	QSignalSpy finished(&master, SIGNAL(planningFinished(const quint32&, const unsigned&)));
+	
+	master.startLocalSearch(1);
+	SlavePlanner9 staying(domain, 0, 1, 0, QHostAddress::LocalHost, 0);
+	boost::scoped_ptr<SlavePlanner9> leaving(new SlavePlanner9(domain, 0, 1, 0, QHostAddress::LocalHost, 0));
+	check(master.connectToSlave(QHostAddress(QHostAddress::LocalHost).toString(), staying.getPort()), "master connects to a slave");
+	check(master.connectToSlave(QHostAddress(QHostAddress::LocalHost).toString(), leaving->getPort()), "master connects to a slave");
+	const quint32 session(master.plan(bundled->getProblem()));
+	
+	// drop a slave as soon as the master has asked for a transfer
+	const QTime startTime(QTime::currentTime());
+	while (finished.empty() && master.getProgress(session).balanceMessages == 0 && startTime.msecsTo(QTime::currentTime()) < timeout)
+		QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents, 100);
+	leaving.reset();
+	
+	// the nodes of the slave that left are searched again by the others
+	waitFor(finished, 1);
+	check(finished.count() == 1, "session finishes after a slave left during a transfer");
+	check(failed.empty(), "session finds its plan after a slave left during a transfer");
+}
+
+int main(int argc, char* argv[]) {
+	QCoreApplication app(argc, argv);
+	testConcurrentSessionsEnd();
+	testPeerLeavingDuringTransfer();
+	if (failures)
+		return EXIT_FAILURE;
+	cout << "All tests passed" << endl;
+	return EXIT_SUCCESS;
+}
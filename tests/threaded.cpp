@@ -0,0 +1,120 @@
+#include "../problems/basic.hpp"
+#include "../core/costs.hpp"
+#include "../threaded/planner9-threaded.hpp"
+#include <iostream>
+#include <algorithm>
+#include <cstdlib>
+
+using namespace std;
+
+//! the swap of the basic domain drops kiwi, which cannot be dropped again
+struct UnsolvableProblem: MyDomain, Problem {
+	UnsolvableProblem() {
+		add(have("kiwi"));
+		add(provide("toto", "banjo"));
+		goal(swap("kiwi", "banjo") >> drop("kiwi"));
+	}
+};
+
+static int failures(0);
+
+static void check(bool condition, const char* what) {
+	if (!condition) {
+		cerr << "FAILED: " << what << endl;
+		++failures;
+	}
+}
+
+//! more slots than pool threads must not keep each other alive once the frontier is exhausted
+static void testExhaustedSearchEnds() {
+	UnsolvableProblem problem;
+	AlternativesCost alternativesCost;
+	for (size_t poolThreadsCount = 1; poolThreadsCount <= 2; ++poolThreadsCount) {
+		ThreadPool pool(poolThreadsCount);
+		ThreadedPlanner9 planner(problem, pool, 4 * poolThreadsCount, &alternativesCost);
+		check(!planner.plan(), "unsolvable problem has no plan");
+		check(planner.isFinished(), "exhausted search is finished");
+		check(planner.isExhausted(), "exhausted search has no work left");
+	}
+}
+
+//! an anytime search goes on after its plans, so it must end by itself once nothing can improve them
+static void testAnytimeSearchEnds() {
+	MyProblem problem;
+	AlternativesCost alternativesCost;
+	for (size_t poolThreadsCount = 1; poolThreadsCount <= 2; ++poolThreadsCount) {
+		ThreadPool pool(poolThreadsCount);
+		ThreadedPlanner9 planner(problem, pool, 4 * poolThreadsCount, &alternativesCost);
+		planner.setAnytime(true);
+		check(bool(planner.plan()), "anytime search returns its best plan");
+		check(planner.isFinished(), "anytime search is finished");
+		check(planner.isExhausted(), "anytime search has no node below its best plan left");
+	}
+	
+	ThreadedPlanner9 planner(problem, 4, &alternativesCost);
+	planner.setAnytime(true);
+	check(bool(planner.plan()), "anytime search on its own threads returns its best plan");
+	check(planner.isExhausted(), "anytime search on its own threads has no node below its best plan left");
+}
+
+//! the sessions of a slave share its pool, each with a slot per pool thread, so one that runs out of nodes must end while another searches
+static void testSessionsSharingPoolEnd() {
+	UnsolvableProblem unsolvableProblem;
+	MyProblem problem;
+	AlternativesCost alternativesCost;
+	for (size_t poolThreadsCount = 1; poolThreadsCount <= 2; ++poolThreadsCount) {
+		ThreadPool pool(poolThreadsCount);
+		ThreadedPlanner9 unsolvablePlanner(unsolvableProblem, pool, poolThreadsCount, &alternativesCost);
+		ThreadedPlanner9 planner(problem, pool, poolThreadsCount, &alternativesCost);
+		planner.setAnytime(true);
+		unsolvablePlanner.start();
+		planner.start();
+		check(!unsolvablePlanner.plan(), "session without plan ends while another one shares the pool");
+		check(unsolvablePlanner.isExhausted(), "session without plan has no work left");
+		check(bool(planner.plan()), "session sharing the pool with one without plan finds its plan");
+	}
+}
+
+//! pushed nodes are tracked through their descendants until these are all expanded, pruned or popped
+static void testLineagesRetired() {
+	UnsolvableProblem problem;
+	AlternativesCost alternativesCost;
+	for (int splitExpansions = 0; splitExpansions < 2; ++splitExpansions) {
+		ThreadPool pool(2);
+		ThreadedPlanner9 planner(problem.scope, pool, 2, &alternativesCost, 0, 16, splitExpansions);
+		for (boost::uint64_t lineage = 1; lineage <= 3; ++lineage) {
+			Planner9::SearchNode* node(new Planner9::SearchNode(Plan(), problem.network, problem.scope.getSize(), CNF(), problem.state, 0, &alternativesCost));
+			node->lineage = lineage;
+			planner.pushNode(node);
+		}
+		
+		std::vector<Planner9::SearchNode*> popped(planner.popNodes(1));
+		check(popped.size() == 1, "a pushed node can be popped");
+		if (popped.empty())
+			continue;
+		const boost::uint64_t poppedLineage(popped.front()->lineage);
+		delete popped.front();
+		std::vector<boost::uint64_t> retired(planner.takeRetiredLineages());
+		check(retired.size() == 1 && retired.front() == poppedLineage, "the lineage of a popped node is retired at once");
+		
+		check(!planner.plan(), "unsolvable pushed nodes have no plan");
+		retired = planner.takeRetiredLineages();
+		std::sort(retired.begin(), retired.end());
+		std::vector<boost::uint64_t> expected;
+		for (boost::uint64_t lineage = 1; lineage <= 3; ++lineage)
+			if (lineage != poppedLineage)
+				expected.push_back(lineage);
+		check(retired == expected, "the lineages of searched nodes are retired once, when their subtrees are exhausted");
+	}
+}
+
+int main() {
+	testExhaustedSearchEnds();
+	testAnytimeSearchEnds();
+	testSessionsSharingPoolEnd();
+	testLineagesRetired();
+	if (failures)
+		return EXIT_FAILURE;
+	cout << "All tests passed" << endl;
+	return EXIT_SUCCESS;
+}
@@ -1,80 +1,486 @@
 #include "planner9-threaded.hpp"
 #include "../core/plan.hpp"
 #include "../core/problem.hpp"
+#include <boost/bind.hpp>
 
-ThreadedPlanner9::ThreadedPlanner9(const Problem& problem, size_t threadsCount, const CostFunction* costFunction, std::ostream* debugStream):
+ThreadedPlanner9::Expansion::Expansion(const boost::shared_ptr<SearchNode>& node, size_t taskIndex, const Method* method, size_t alternativeIndex):
+	node(node),
+	taskIndex(taskIndex),
+	method(method),
+	alternativeIndex(alternativeIndex) {
+}
+
+ThreadedPlanner9::ThreadedPlanner9(const Problem& problem, size_t threadsCount, const CostFunction* costFunction, std::ostream* debugStream, size_t maxBatchSize, bool splitExpansions):
 	SimplePlanner9(problem, costFunction, debugStream),
+	pool(0),
+	started(false),
+	stopped(false),
 	threadsCount(threadsCount),
-	workingThreadCount(0) {
+	finishedThreadCount(0),
+	iterationLimit(0),
+	anytime(false),
+	costBound(InfiniteCost),
+	maxBatchSize(std::max<size_t>(maxBatchSize, 1)),
+	splitExpansions(splitExpansions),
+	workingThreadCount(0),
+	idleSlotsCount(0),
+	workersCount(0),
+	localWorker(&ThreadedPlanner9::keepWorker) {
+	// account for the initial node
+	for (SearchNodes::const_iterator it = nodes.begin(); it != nodes.end(); ++it)
+		costHistogram.add(it->first);
 }
 
-// HTN: procedure SHOP2(s, T, D)
-boost::optional<Plan> ThreadedPlanner9::plan() {
-	boost::mutex::scoped_lock lock(mutex);
+ThreadedPlanner9::ThreadedPlanner9(const Problem& problem, ThreadPool& pool, size_t threadsCount, const CostFunction* costFunction, std::ostream* debugStream, size_t maxBatchSize, bool splitExpansions):
+	SimplePlanner9(problem, costFunction, debugStream),
+	pool(&pool),
+	started(false),
+	stopped(false),
+	threadsCount(std::max<size_t>(1, std::min(threadsCount, pool.getThreadsCount()))),
+	finishedThreadCount(0),
+	iterationLimit(0),
+	anytime(false),
+	costBound(InfiniteCost),
+	maxBatchSize(std::max<size_t>(maxBatchSize, 1)),
+	splitExpansions(splitExpansions),
+	workingThreadCount(0),
+	idleSlotsCount(0),
+	workersCount(0),
+	localWorker(&ThreadedPlanner9::keepWorker) {
+	// account for the initial node
+	for (SearchNodes::const_iterator it = nodes.begin(); it != nodes.end(); ++it)
+		costHistogram.add(it->first);
+}
+
+ThreadedPlanner9::ThreadedPlanner9(const Scope& problemScope, ThreadPool& pool, size_t threadsCount, const CostFunction* costFunction, std::ostream* debugStream, size_t maxBatchSize, bool splitExpansions):
+	SimplePlanner9(problemScope, costFunction, debugStream),
+	pool(&pool),
+	started(false),
+	stopped(false),
+	threadsCount(std::max<size_t>(1, std::min(threadsCount, pool.getThreadsCount()))),
+	finishedThreadCount(0),
+	iterationLimit(0),
+	anytime(false),
+	costBound(InfiniteCost),
+	maxBatchSize(std::max<size_t>(maxBatchSize, 1)),
+	splitExpansions(splitExpansions),
+	workingThreadCount(0),
+	idleSlotsCount(0),
+	workersCount(0),
+	localWorker(&ThreadedPlanner9::keepWorker) {
+}
+
+ThreadedPlanner9::~ThreadedPlanner9() {
+	// slots still queued on the pool refer to this
+	if (pool)
+		stop();
+}
 
-	boost::thread_group threads;
+void ThreadedPlanner9::start(int priority) {
+	assert(pool);
+	boost::mutex::scoped_lock lock(mutex);
+	if (started && finishedThreadCount < threadsCount)
+		return;
+	started = true;
+	
+	// each slot runs slices of search on the pool until the search ends
+	finishedThreadCount = 0;
 	for (size_t i = 0; i < threadsCount; ++i) {
-		threads.create_thread(boost::ref(*this));
+		pool->submit(boost::bind(&ThreadedPlanner9::runSlice, this, boost::shared_ptr<Worker>(new Worker(newTraceIdsBase())), _1), priority);
 		workingThreadCount++;
 	}
+}
+
+void ThreadedPlanner9::stop() {
+	boost::mutex::scoped_lock lock(mutex);
+	stopped = true;
+	condition.notify_all();
+	if (started)
+		while (finishedThreadCount < threadsCount)
+			condition.wait(lock);
+}
+
+bool ThreadedPlanner9::isFinished() {
+	boost::mutex::scoped_lock lock(mutex);
+	return started && finishedThreadCount == threadsCount;
+}
+
+// HTN: procedure SHOP2(s, T, D)
+boost::optional<Plan> ThreadedPlanner9::plan() {
+	if (pool) {
+		start();
+		boost::mutex::scoped_lock lock(mutex);
+		while (finishedThreadCount < threadsCount)
+			condition.wait(lock);
+	} else {
+		boost::mutex::scoped_lock lock(mutex);
+		boost::thread_group threads;
+		for (size_t i = 0; i < threadsCount; ++i) {
+			threads.create_thread(boost::ref(*this));
+			workingThreadCount++;
+		}
+		
+		lock.unlock();
+		threads.join_all();
+	}
 	
-	lock.unlock();
-	threads.join_all();
+	if (tracer) {
+		boost::mutex::scoped_lock lock(mutex);
+		tracer->write(traceBuffer);
+	}
 	
 	std::cout << "Terminated after " << iterationCount << " iterations" << std::endl;
 
 	if(plans.empty())
 		return boost::none;
+	else if (anytime)
+		return plans.back();
 	else
 		return plans.front();
 }
 
-bool ThreadedPlanner9::step() {
+size_t ThreadedPlanner9::getNodesCount() {
+	boost::mutex::scoped_lock lock(mutex);
+	return nodes.size();
+}
+
+Planner9::Cost ThreadedPlanner9::getNodeCost(size_t rank) {
+	boost::mutex::scoped_lock lock(mutex);
+	if (rank >= nodes.size())
+		return InfiniteCost;
+	SearchNodes::const_iterator it(nodes.begin());
+	std::advance(it, rank);
+	return it->first;
+}
+
+std::vector<Planner9::SearchNode*> ThreadedPlanner9::popNodes(size_t count) {
+	boost::mutex::scoped_lock lock(mutex);
+	std::vector<SearchNode*> popped;
+	while (popped.size() < count && !nodes.empty()) {
+		popped.push_back(takeNode());
+		releaseLineage(popped.back()->lineage);
+	}
+	return popped;
+}
+
+size_t ThreadedPlanner9::getIterationCount() {
+	boost::mutex::scoped_lock lock(mutex);
+	return iterationCount;
+}
+
+SearchCounters ThreadedPlanner9::getCounters() {
+	boost::mutex::scoped_lock lock(mutex);
+	return counters;
+}
+
+CostHistogram ThreadedPlanner9::getCostHistogram() {
+	boost::mutex::scoped_lock lock(mutex);
+	return costHistogram;
+}
+
+void ThreadedPlanner9::setCostBound(Cost bound) {
+	boost::mutex::scoped_lock lock(mutex);
+	if (bound < costBound) {
+		costBound = bound;
+		condition.notify_all();
+	}
+}
+
+Planner9::Cost ThreadedPlanner9::getCostBound() {
+	boost::mutex::scoped_lock lock(mutex);
+	return costBound;
+}
+
+void ThreadedPlanner9::insertNode(SearchNode* node) {
+	const Cost cost(node->getTotalCost());
+	if (cost >= costBound) {
+		counters.nodePruned();
+		if (tracer)
+			traceBuffer.prune(tracer->getTime(), node->traceId);
+		// children are merged before their parent is released, so only a pushed node can retire its lineage here
+		holdLineage(node->lineage);
+		releaseLineage(node->lineage);
+		delete node;
+		return;
+	}
+	nodes.insert(SearchNodes::value_type(cost, node));
+	costHistogram.add(cost);
+	holdLineage(node->lineage);
+}
+
+void ThreadedPlanner9::holdLineage(boost::uint64_t lineage, size_t count) {
+	if (lineage)
+		lineageCounts[lineage] += count;
+}
+
+void ThreadedPlanner9::releaseLineage(boost::uint64_t lineage) {
+	if (!lineage)
+		return;
+	LineageCounts::iterator it(lineageCounts.find(lineage));
+	assert(it != lineageCounts.end());
+	if (--it->second == 0) {
+		retiredLineages.push_back(lineage);
+		lineageCounts.erase(it);
+	}
+}
+
+std::vector<boost::uint64_t> ThreadedPlanner9::takeRetiredLineages() {
+	boost::mutex::scoped_lock lock(mutex);
+	std::vector<boost::uint64_t> retired;
+	retired.swap(retiredLineages);
+	return retired;
+}
+
+Planner9::SearchNode* ThreadedPlanner9::takeNode() {
+	costHistogram.remove(nodes.begin()->first);
+	return popNode();
+}
+
+bool ThreadedPlanner9::getPlan(size_t index, Plan& plan, Cost& cost) {
+	boost::mutex::scoped_lock lock(mutex);
+	if (index >= plans.size())
+		return false;
+	plan = plans[index];
+	cost = plansCosts[index];
+	return true;
+}
+
+bool ThreadedPlanner9::isExhausted() {
 	boost::mutex::scoped_lock lock(mutex);
-	workingThreadCount--;
+	return !hasWork();
+}
+
+bool ThreadedPlanner9::isSearchOver() const {
+	return stopped || (!anytime && !plans.empty()) || (iterationLimit != 0 && iterationCount >= iterationLimit);
+}
+
+bool ThreadedPlanner9::hasWork() const {
+	// the frontier is sorted, so if its best node is pruned all are
+	return !expansions.empty() || (!nodes.empty() && nodes.begin()->first < costBound);
+}
+
+bool ThreadedPlanner9::step(Worker& worker, bool pooled) {
+	// adapt the batch size to contention: grow it when the lock is busy, shrink it otherwise
+	boost::mutex::scoped_lock lock(mutex, boost::try_to_lock);
+	if (lock.owns_lock()) {
+		if (worker.batchSize > 1)
+			--worker.batchSize;
+	} else {
+		worker.batchSize = std::min(worker.batchSize * 2, maxBatchSize);
+		lock.lock();
+	}
+	
+	// merge the children of the previous batch
+	Batch& children(worker.children);
+	for (Batch::const_iterator it = children.begin(); it != children.end(); ++it) {
+		SearchNode* node(*it);
+		insertNode(node);
+	}
+	if (children.size() > 1)
+		condition.notify_all();
+	else if (children.size() == 1)
+		condition.notify_one();
+	children.clear();
+	for (std::vector<boost::uint64_t>::const_iterator it = worker.expandedLineages.begin(); it != worker.expandedLineages.end(); ++it)
+		releaseLineage(*it);
+	worker.expandedLineages.clear();
+	counters += worker.counters;
+	worker.counters.clear();
+	if (tracer) {
+		// children are generated in the trace of the worker and pruned in that of the planner
+		tracer->write(worker.trace);
+		tracer->write(traceBuffer);
+	}
 	
-	do {
-		if (!plans.empty())
+	if (worker.idle) {
+		worker.idle = false;
+		idleSlotsCount--;
+	} else
+		workingThreadCount--;
+	
+	// without work, the search is over once no thread may generate any, idle slots not counting
+	bool waited(false);
+	while (true) {
+		if (isSearchOver()) {
+			condition.notify_all();
+			return false;
+		}
+		if (hasWork())
+			break;
+		if (workingThreadCount == 0) {
+			condition.notify_all();
 			return false;
-		if (nodes.empty()) {
-			if(workingThreadCount == 0)
-				return false;
-			else
-				condition.wait(lock);
 		}
-	} while (nodes.empty() || !plans.empty());
+		if (!pooled)
+			condition.wait(lock);
+		else if (!waited) {
+			condition.timed_wait(lock, boost::posix_time::milliseconds(1));
+			waited = true;
+		} else {
+			// do not hold a pool thread while others are expanding, retry on the next slice
+			worker.idle = true;
+			idleSlotsCount++;
+			return true;
+		}
+	}
 	
-	SearchNode* node = popNode();
+	// parts of already popped nodes come first, as these nodes were the best ones
+	if (expansions.empty()) {
+		while (worker.nodes.size() < worker.batchSize && !nodes.empty() && nodes.begin()->first < costBound)
+			worker.nodes.push_back(takeNode());
+		iterationCount += worker.nodes.size();
+		counters.sampleFrontier(iterationCount, nodes.size());
+		
+		// if the frontier is too small to feed the other threads, let them share the expansion of this node
+		if (splitExpansions && worker.nodes.size() == 1 && nodes.size() + 1 < threadsCount) {
+			splitExpansion(worker.nodes.front());
+			worker.nodes.clear();
+		}
+	}
+	while (worker.expansions.size() < worker.batchSize && !expansions.empty()) {
+		worker.expansions.push_back(expansions.front());
+		expansions.pop_front();
+	}
+	for (Batch::const_iterator it = worker.nodes.begin(); it != worker.nodes.end(); ++it)
+		if ((*it)->lineage)
+			worker.expandedLineages.push_back((*it)->lineage);
+	for (Expansions::const_iterator it = worker.expansions.begin(); it != worker.expansions.end(); ++it)
+		if (it->node->lineage)
+			worker.expandedLineages.push_back(it->node->lineage);
 	
 	workingThreadCount++;
 	lock.unlock();
 
+	for (Batch::const_iterator it = worker.nodes.begin(); it != worker.nodes.end(); ++it) {
+		SearchNode* node(*it);
+		
+		if (debugStream)
+			*debugStream << "- " << *node << std::endl;
+		
+		visitNode(node);
+
+		delete node;
+	}
+	worker.nodes.clear();
+	
+	for (Expansions::const_iterator it = worker.expansions.begin(); it != worker.expansions.end(); ++it)
+		expand(*it);
+	worker.expansions.clear();
+	
+	return true;
+}
+
+void ThreadedPlanner9::splitExpansion(SearchNode* node) {
 	if (debugStream)
-		*debugStream << "- " << *node << std::endl;
+		*debugStream << "- split " << *node << std::endl;
+	if (tracer)
+		traceExpansion(traceBuffer, node);
 	
-	++iterationCount;
-	visitNode(node);
+	boost::shared_ptr<SearchNode> sharedNode(node);
+	const TaskNetwork::Tasks& t0(node->network.first);
+	const size_t expansionsCount(expansions.size());
+	
+	if (t0.empty())
+		expansions.push_back(Expansion(sharedNode, 0));
+	
+	for (size_t ti = 0; ti < t0.size(); ++ti) {
+		const Method* method(dynamic_cast<const Method*>(t0[ti]->task.head));
+		if (method) {
+			for (size_t ai = 0; ai < method->alternatives.size(); ++ai)
+				expansions.push_back(Expansion(sharedNode, ti, method, ai));
+		} else {
+			expansions.push_back(Expansion(sharedNode, ti));
+		}
+	}
+	
+	// the node is counted once per part instead of once
+	holdLineage(node->lineage, expansions.size() - expansionsCount);
+	releaseLineage(node->lineage);
+	
+	condition.notify_all();
+}
 
-	delete node;
-	return true;
+void ThreadedPlanner9::expand(const Expansion& expansion) {
+	const SearchNode* node(expansion.node.get());
+	if (node->network.first.empty())
+		visitGoal(node);
+	else if (expansion.method)
+		visitAlternative(node, expansion.taskIndex, expansion.method, expansion.alternativeIndex);
+	else
+		visitTask(node, expansion.taskIndex);
 }
 
 void ThreadedPlanner9::operator()() {
+	boost::uint64_t traceIdsBase;
+	{
+		boost::mutex::scoped_lock lock(mutex);
+		traceIdsBase = newTraceIdsBase();
+	}
+	Worker worker(traceIdsBase);
+	localWorker.reset(&worker);
+	
 	// HTN: loop
-	while (step()) {}
+	while (step(worker, false)) {}
+	
+	localWorker.reset();
+}
+
+bool ThreadedPlanner9::runSlice(const boost::shared_ptr<Worker>& worker, bool stopping) {
+	// the pool is going away, end the search so that plan() returns
+	if (stopping) {
+		boost::mutex::scoped_lock lock(mutex);
+		stopped = true;
+	}
+	
+	localWorker.reset(worker.get());
+	const bool again(step(*worker, true));
+	localWorker.reset();
+	
+	if (!again) {
+		boost::mutex::scoped_lock lock(mutex);
+		finishedThreadCount++;
+		condition.notify_all();
+	}
+	return again;
 }
 
 void ThreadedPlanner9::pushNode(SearchNode* node) {
 	if (debugStream)
 		*debugStream << "+ " << *node << std::endl;
 
+	// worker threads collect children locally and merge them in bulk
+	Worker* worker(localWorker.get());
+	if (worker) {
+		worker->children.push_back(node);
+		return;
+	}
+	
 	boost::mutex::scoped_lock lock(mutex);
-	nodes.insert(SearchNodes::value_type(node->getTotalCost(), node));
+	insertNode(node);
 	condition.notify_one();
 }
 
-void ThreadedPlanner9::success(const Plan& plan) {
+SearchCounters& ThreadedPlanner9::getLocalCounters() {
+	// outside worker threads, only the constructor generates nodes
+	Worker* worker(localWorker.get());
+	return worker ? worker->counters : counters;
+}
+
+SearchTraceBuffer& ThreadedPlanner9::getLocalTrace() {
+	// outside worker threads, the frontier lock must be held
+	Worker* worker(localWorker.get());
+	return worker ? worker->trace : traceBuffer;
+}
+
+void ThreadedPlanner9::success(const Plan& plan, Cost cost) {
 	boost::mutex::scoped_lock lock(mutex);
+	if (anytime) {
+		// only keep improvements, and look for better ones only
+		if (cost >= costBound)
+			return;
+		costBound = cost;
+	}
 	plans.push_back(plan);
+	plansCosts.push_back(cost);
 	condition.notify_all();
 }
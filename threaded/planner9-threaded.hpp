@@ -3,31 +3,134 @@
 
 
 #include "../core/planner9.hpp"
+#include "../core/histogram.hpp"
+#include "thread-pool.hpp"
 #include <boost/thread.hpp>
 #include <boost/thread/condition.hpp>
+#include <boost/thread/tss.hpp>
+#include <boost/shared_ptr.hpp>
+#include <deque>
 #include <set>
 #include <map>
 
 
 struct ThreadedPlanner9: SimplePlanner9 {
 	
-	ThreadedPlanner9(const Problem& problem, size_t threadsCount, const CostFunction* costFunction, std::ostream* debugStream = 0);
+	ThreadedPlanner9(const Problem& problem, size_t threadsCount, const CostFunction* costFunction, std::ostream* debugStream = 0, size_t maxBatchSize = 16, bool splitExpansions = false);
+	//! run on the threads of pool, with at most threadsCount of them working on this planner at once, clamped to the threads of pool
+	ThreadedPlanner9(const Problem& problem, ThreadPool& pool, size_t threadsCount, const CostFunction* costFunction, std::ostream* debugStream = 0, size_t maxBatchSize = 16, bool splitExpansions = false);
+	//! run on pool without initial node, nodes are then fed through pushNode()
+	ThreadedPlanner9(const Scope& problemScope, ThreadPool& pool, size_t threadsCount, const CostFunction* costFunction, std::ostream* debugStream = 0, size_t maxBatchSize = 16, bool splitExpansions = false);
+	~ThreadedPlanner9();
 	
+	//! start searching on the pool without waiting, plan() then waits for the result; restarts a search that ran out of nodes
+	void start(int priority = 0);
+	//! abort the search and wait until no pool thread works on it anymore
+	void stop();
+	bool isFinished();
 	boost::optional<Plan> plan();
+	
+	// accessors safe to call while the search is running
+	size_t getNodesCount();
+	//! cost of the node of the given rank in the frontier, InfiniteCost if there is none
+	Cost getNodeCost(size_t rank);
+	//! remove up to count best nodes from the frontier and return them, the caller owns them
+	std::vector<SearchNode*> popNodes(size_t count);
+	size_t getIterationCount();
+	//! counters of all threads, those of nodes being expanded are added once their children are merged
+	SearchCounters getCounters();
+	CostHistogram getCostHistogram();
+	//! copy the plan of the given rank in the order they were found, return false if there is none
+	bool getPlan(size_t index, Plan& plan, Cost& cost);
+	//! whether no node below the cost bound is left to expand
+	bool isExhausted();
+	//! lineages of which no node is left in the frontier or being expanded, since the last call
+	/*!
+		Nodes pushed with a non-zero SearchNode::lineage are counted with
+		their descendants until these are expanded, pruned or popped.
+	*/
+	std::vector<boost::uint64_t> takeRetiredLineages();
+	
+	//! give up after limit iterations, 0 meaning no limit
+	void setIterationLimit(size_t limit) { iterationLimit = limit; }
+	//! if anytime, search goes on after a plan is found, for plans of lower costs only, until no node below the bound is left
+	void setAnytime(bool anytime) { this->anytime = anytime; }
+	//! prune nodes whose cost is not lower than bound, which can only decrease
+	void setCostBound(Cost bound);
+	Cost getCostBound();
 
 	void operator()();
 	
-protected:
+	//! insert node in the frontier, can be called from any thread
 	virtual void pushNode(SearchNode* node);
-	virtual void success(const Plan& plan);
+
+protected:
+	virtual void success(const Plan& plan, Cost cost);
+	virtual SearchCounters& getLocalCounters();
+	virtual SearchTraceBuffer& getLocalTrace();
 
 private:
-	bool step();
+	typedef std::vector<SearchNode*> Batch;
+	typedef std::map<boost::uint64_t, size_t> LineageCounts;
+	
+	//! part of the expansion of a node: a task of T0 or, for methods, one of its alternatives
+	struct Expansion {
+		Expansion(const boost::shared_ptr<SearchNode>& node, size_t taskIndex, const Method* method = 0, size_t alternativeIndex = 0);
+		
+		boost::shared_ptr<SearchNode> node;
+		size_t taskIndex;
+		const Method* method; //!< if 0, the whole task is expanded
+		size_t alternativeIndex;
+	};
+	typedef std::deque<Expansion> Expansions;
+	
+	//! state local to a worker thread
+	struct Worker {
+		Worker(boost::uint64_t traceIdsBase): batchSize(1), idle(false), trace(traceIdsBase) {}
+		
+		Batch nodes; //!< nodes popped for expansion
+		Expansions expansions; //!< parts of split nodes taken for expansion
+		Batch children; //!< generated nodes waiting to be merged into the frontier
+		std::vector<boost::uint64_t> expandedLineages; //!< of the nodes and expansions taken, released once their children are merged
+		size_t batchSize; //!< current number of items taken per lock acquisition
+		bool idle; //!< whether the slot of this worker yielded its pool thread for lack of work
+		SearchCounters counters; //!< counted since the children were last merged
+		SearchTraceBuffer trace; //!< events since the children were last merged
+	};
+
+	void insertNode(SearchNode* node);
+	void holdLineage(boost::uint64_t lineage, size_t count = 1);
+	void releaseLineage(boost::uint64_t lineage);
+	SearchNode* takeNode();
+	bool isSearchOver() const;
+	bool hasWork() const;
+	boost::uint64_t newTraceIdsBase() { return boost::uint64_t(++workersCount) << 40; }
+	bool step(Worker& worker, bool pooled);
+	bool runSlice(const boost::shared_ptr<Worker>& worker, bool stopping);
+	void splitExpansion(SearchNode* node);
+	void expand(const Expansion& expansion);
+	static void keepWorker(Worker*) {}
 
+	ThreadPool* pool; //!< if 0, threads are created for every call to plan()
+	bool started;
+	bool stopped;
 	size_t threadsCount;
+	size_t finishedThreadCount;
+	size_t iterationLimit;
+	bool anytime;
+	Cost costBound; //!< cost of the best plan found or given, nodes not below are pruned
+	size_t maxBatchSize; //!< maximum number of nodes a thread pops per lock acquisition
+	bool splitExpansions; //!< whether idle threads may share the expansion of a single node
 	size_t workingThreadCount;
+	size_t idleSlotsCount; //!< slots requeued on the pool without work, not counted as working
+	size_t workersCount; //!< workers created, each generating trace ids in its own range
+	Expansions expansions; //!< parts of split nodes, expanded before new nodes are popped
+	CostHistogram costHistogram; //!< costs of the nodes in the frontier, maintained incrementally
+	LineageCounts lineageCounts; //!< nodes in the frontier or being expanded, by non-zero lineage
+	std::vector<boost::uint64_t> retiredLineages; //!< not taken yet
 	boost::mutex mutex;
 	boost::condition condition;
+	boost::thread_specific_ptr<Worker> localWorker; //!< worker of the current thread
 };
 
 
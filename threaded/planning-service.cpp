@@ -0,0 +1,40 @@
+#include "planning-service.hpp"
+#include "../core/problem.hpp"
+#include <stdexcept>
+
+PlanningService::Options::Options(int priority, size_t threadsCount, size_t iterationLimit):
+	priority(priority),
+	threadsCount(threadsCount),
+	iterationLimit(iterationLimit) {
+}
+
+PlanningService::PlanningService(const Domain& domain, ThreadPool& pool, const Planner9::CostFunction* costFunction):
+	domain(domain),
+	pool(pool),
+	costFunction(costFunction) {
+}
+
+PlanningService::Request PlanningService::submit(const Problem& problem, const Options& options) {
+	checkProblem(problem);
+	
+	const size_t threadsCount(std::max<size_t>(1, std::min(options.threadsCount, pool.getThreadsCount())));
+	Request request(new ThreadedPlanner9(problem, pool, threadsCount, costFunction));
+	request->setIterationLimit(options.iterationLimit);
+	request->start(options.priority);
+	return request;
+}
+
+boost::optional<Plan> PlanningService::wait(const Request& request) {
+	return request->plan();
+}
+
+void PlanningService::checkProblem(const Problem& problem) const {
+	// every task of the goal must be known to the domain of the service
+	const TaskNetwork& network(problem.network);
+	for (TaskNetwork::Tasks::const_iterator it = network.first.begin(); it != network.first.end(); ++it)
+		if (domain.getHeadIndex((*it)->task.head) == (size_t)-1)
+			throw std::runtime_error("Task " + (*it)->task.head->name + " does not belong to the domain of the planning service");
+	for (TaskNetwork::Predecessors::const_iterator it = network.predecessors.begin(); it != network.predecessors.end(); ++it)
+		if (domain.getHeadIndex(it->first->task.head) == (size_t)-1)
+			throw std::runtime_error("Task " + it->first->task.head->name + " does not belong to the domain of the planning service");
+}
@@ -0,0 +1,47 @@
+#ifndef PLANNINGSERVICE_HPP_
+#define PLANNINGSERVICE_HPP_
+
+
+#include "planner9-threaded.hpp"
+#include <boost/shared_ptr.hpp>
+
+
+//! plans many problems of the same domain on a shared pool of threads
+/*!
+	The domain-level precomputations (compiled preconditions, affected
+	functions of actions) are done once when the domain is built and are
+	shared read-only by all requests, as are the pool and the cost function.
+	Each request gets its own frontier and state.
+*/
+struct PlanningService {
+	//! limits and priority of a request
+	struct Options {
+		Options(int priority = 0, size_t threadsCount = 1, size_t iterationLimit = 0);
+		
+		int priority; //!< requests of higher priority are served first
+		size_t threadsCount; //!< maximum number of pool threads working on the request at once
+		size_t iterationLimit; //!< number of nodes expanded before giving up, 0 meaning no limit
+	};
+	
+	//! dropping the last reference to a request stops it and waits for its slices queued on the pool
+	typedef boost::shared_ptr<ThreadedPlanner9> Request;
+	
+	PlanningService(const Domain& domain, ThreadPool& pool, const Planner9::CostFunction* costFunction);
+	
+	//! start planning problem and return immediately, problem must outlive the request
+	Request submit(const Problem& problem, const Options& options = Options());
+	//! wait for the end of request and return its plan, if any
+	boost::optional<Plan> wait(const Request& request);
+	
+	const Domain& getDomain() const { return domain; }
+
+private:
+	void checkProblem(const Problem& problem) const;
+	
+	const Domain& domain;
+	ThreadPool& pool;
+	const Planner9::CostFunction* costFunction;
+};
+
+
+#endif // PLANNINGSERVICE_HPP_
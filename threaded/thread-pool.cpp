@@ -0,0 +1,76 @@
+#include "thread-pool.hpp"
+#include <boost/bind.hpp>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+ThreadPool::ThreadPool(size_t threadsCount, bool pinThreads):
+	threadsCount(std::max<size_t>(threadsCount, 1)),
+	pinThreads(pinThreads),
+	stopping(false) {
+	for (size_t i = 0; i < this->threadsCount; ++i)
+		threads.create_thread(boost::bind(&ThreadPool::run, this, i));
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		boost::mutex::scoped_lock lock(mutex);
+		stopping = true;
+		condition.notify_all();
+	}
+	threads.join_all();
+}
+
+void ThreadPool::submit(const Job& job, int priority) {
+	boost::mutex::scoped_lock lock(mutex);
+	jobs[priority].push_back(job);
+	condition.notify_one();
+}
+
+void ThreadPool::run(size_t threadIndex) {
+	#ifdef __linux__
+	if (pinThreads) {
+		const size_t cpusCount(std::max<unsigned>(boost::thread::hardware_concurrency(), 1));
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		CPU_SET(threadIndex % cpusCount, &cpus);
+		pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+	}
+	#endif
+	
+	boost::mutex::scoped_lock lock(mutex);
+	while (true) {
+		while (jobs.empty() && !stopping)
+			condition.wait(lock);
+		// when stopping, drain the queued jobs so that none is left waited for
+		if (jobs.empty())
+			return;
+		
+		// serve the highest priority, unless a lower one waited too long
+		PrioritizedJobs::iterator queueIt(jobs.begin());
+		for (PrioritizedJobs::iterator it = jobs.begin(); it != jobs.end(); ++it)
+			if (it->second.skipped >= maxSkippedDispatches) {
+				queueIt = it;
+				break;
+			}
+		for (PrioritizedJobs::iterator it = jobs.begin(); it != jobs.end(); ++it)
+			++it->second.skipped;
+		queueIt->second.skipped = 0;
+		
+		const int priority(queueIt->first);
+		Job job(queueIt->second.front());
+		queueIt->second.pop_front();
+		if (queueIt->second.empty())
+			jobs.erase(queueIt);
+		
+		const bool draining(stopping);
+		lock.unlock();
+		const bool again(job(draining));
+		lock.lock();
+		
+		// requeue at the back so that other jobs get their turn
+		if (again)
+			jobs[priority].push_back(job);
+	}
+}
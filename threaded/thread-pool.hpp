@@ -0,0 +1,61 @@
+#ifndef THREADPOOL_HPP_
+#define THREADPOOL_HPP_
+
+
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+#include <boost/thread/condition.hpp>
+#include <deque>
+#include <functional>
+#include <map>
+
+
+//! long-lived worker threads shared by planners
+/*!
+	Jobs run one slice of work per call and are requeued at the back
+	until they return false, so that concurrent jobs of the same priority
+	share the threads in a round-robin fashion. Jobs of higher priority
+	are run first, but a queue of lower priority passed over
+	maxSkippedDispatches times in a row is served next, so that it is
+	delayed by at most maxSkippedDispatches plus the number of priorities
+	dispatches. A slice must not block indefinitely.
+	
+	When the pool is destroyed, jobs still queued are run with stopping
+	set, in which case they must release their resources, notify whoever
+	waits for them and return false.
+*/
+struct ThreadPool {
+	typedef boost::function<bool (bool stopping)> Job;
+	
+	//! dispatches to higher priorities after which a waiting queue is served anyway
+	static const size_t maxSkippedDispatches = 64;
+	
+	ThreadPool(size_t threadsCount = boost::thread::hardware_concurrency(), bool pinThreads = false);
+	~ThreadPool();
+	
+	void submit(const Job& job, int priority = 0);
+	
+	size_t getThreadsCount() const { return threadsCount; }
+
+private:
+	void run(size_t threadIndex);
+	
+	//! jobs of the same priority
+	struct Jobs: std::deque<Job> {
+		Jobs(): skipped(0) {}
+		
+		size_t skipped; //!< dispatches to other queues since this one was last served
+	};
+	typedef std::map<int, Jobs, std::greater<int> > PrioritizedJobs;
+	
+	const size_t threadsCount;
+	const bool pinThreads; //!< whether thread i is bound to CPU i modulo the CPUs count
+	bool stopping;
+	PrioritizedJobs jobs; //!< non-empty queues of jobs, by decreasing priority
+	boost::mutex mutex;
+	boost::condition condition;
+	boost::thread_group threads;
+};
+
+
+#endif // THREADPOOL_HPP_